@@ -0,0 +1,98 @@
+#include <cstdlib>
+#include <vector>
+
+#include "memory.hpp"
+#include "string.hpp"
+
+#include "benchmark.hpp"
+
+namespace {
+
+constexpr std::size_t iterations = 10000;
+
+// Number of blocks that are alive at once in an iteration
+constexpr std::size_t batch = 256;
+
+// Block sizes of short strings, plus the object header
+auto block_size(std::size_t i) -> std::size_t
+{
+  return sizeof(eml::Obj) + 1 + (i * 7) % 96;
+}
+
+void benchmark_malloc()
+{
+  std::vector<void*> blocks(batch);
+  eml_benchmark::run("malloc/free (short strings)", iterations, [&]() {
+    for (std::size_t i = 0; i < batch; ++i) {
+      blocks[i] = std::malloc(block_size(i));
+    }
+    for (std::size_t i = 0; i < batch; ++i) {
+      std::free(blocks[i]);
+    }
+    return blocks[0] != nullptr;
+  });
+}
+
+void benchmark_pool()
+{
+  eml::PoolAllocator pool;
+  std::vector<void*> blocks(batch);
+  eml_benchmark::run("PoolAllocator (short strings)", iterations, [&]() {
+    for (std::size_t i = 0; i < batch; ++i) {
+      blocks[i] = pool.allocate(block_size(i));
+    }
+    for (std::size_t i = 0; i < batch; ++i) {
+      pool.deallocate(blocks[i], block_size(i));
+    }
+    return blocks[0] != nullptr;
+  });
+}
+
+// Allocates short-lived strings through the garbage collector, which
+// includes the cost of the collections that free them
+void benchmark_garbage_collector()
+{
+  eml::GarbageCollector gc{eml::GcConfig{64 * 1024}};
+  eml_benchmark::run("GarbageCollector (short strings)", iterations, [&]() {
+    bool result = false;
+    for (std::size_t i = 0; i < batch; ++i) {
+      const auto s = eml::make_string("a short string", gc);
+      result ^= s->size() == 0;
+    }
+    return result;
+  });
+}
+
+// The same strings, allocated in the nursery and collected by minor
+// collections at the safepoint after each batch
+void benchmark_nursery()
+{
+  eml::GarbageCollector gc{eml::GcConfig{64 * 1024}};
+  const auto a = eml::make_string("a short ", gc);
+  const auto b = eml::make_string("string", gc);
+  a->pin();
+  b->pin();
+  eml_benchmark::run("GarbageCollector nursery (short strings)", iterations,
+                     [&]() {
+                       bool result = false;
+                       for (std::size_t i = 0; i < batch; ++i) {
+                         const auto s = eml::string_cat(
+                             a, b, gc, eml::Generation::young);
+                         result ^= s->size() == 0;
+                       }
+                       gc.safepoint();
+                       return result;
+                     });
+  a->unpin();
+  b->unpin();
+}
+
+} // anonymous namespace
+
+int main()
+{
+  benchmark_malloc();
+  benchmark_pool();
+  benchmark_garbage_collector();
+  benchmark_nursery();
+}
@@ -0,0 +1,72 @@
+#include <cstdlib>
+#include <string>
+
+#include "ast.hpp"
+#include "eml.hpp"
+
+#include "benchmark.hpp"
+
+namespace {
+
+constexpr std::size_t iterations = 100;
+
+// A sum of 4000 if expressions over arithmetic, which has 24 nodes for each of
+// them, so 96001 nodes
+auto generated_source() -> std::string
+{
+  std::string source = "0";
+  for (int i = 0; i < 4000; ++i) {
+    const auto n = std::to_string(i);
+    source += " + (if (" + n + " * 2 < " + n + " / 3 - -4 == (1 <= 2)) {" +
+              n + " + x} else {x - " + n + " * 2})";
+  }
+  return source;
+}
+
+template <typename T> auto unwrap(T result)
+{
+  if (!result) {
+    std::cerr << "Fails to compile benchmark source\n";
+    std::exit(1);
+  }
+  return std::move(*result);
+}
+
+} // anonymous namespace
+
+// Measures the type checking and the code generation of the arena AST, which
+// dispatch through AstVisitor.
+//
+// A flat AST of parallel arrays in post order got measured against it on this
+// source in a release build, and dropped:
+//   type check:    0.75 ms (tree), 0.80 ms (flat)
+//   generate code: 6.8 ms (tree), 3.6 ms (flat)
+//   flatten:       4.6 ms
+//   footprint:     3.4 MB (tree arena), 4.2 MB (flat)
+// Since the parser builds the tree, the flat code generation only pays off if
+// the flattening is free, which takes a parser that builds the flat AST.
+int main()
+{
+  const auto source = generated_source();
+  eml::GarbageCollector gc;
+  eml::CompilerConfig config;
+  config.shadowing_policy = eml::SameScopeShadowing::allow;
+  eml::Compiler compiler{gc, config};
+  unwrap(compiler.compile("let x = 42"));
+
+  auto tree = unwrap(eml::parse(source, gc));
+  std::cout << "tree bytes: " << tree.arena().capacity() << "\n\n";
+
+  eml_benchmark::run("parse", iterations, [&]() {
+    return eml::parse(source, gc).has_value();
+  });
+
+  eml_benchmark::run("type check", iterations, [&]() {
+    tree = unwrap(compiler.type_check(tree));
+    return true;
+  });
+
+  eml_benchmark::run("generate code", iterations, [&]() {
+    return !std::get<0>(compiler.generate_code(*tree)).instructions().empty();
+  });
+}
@@ -0,0 +1,49 @@
+#ifndef EML_BENCHMARK_HPP
+#define EML_BENCHMARK_HPP
+
+// A minimal timing harness shared by the benchmarks
+
+#include <chrono>
+#include <cstddef>
+#include <iomanip>
+#include <iostream>
+#include <string_view>
+
+namespace eml_benchmark {
+
+inline volatile bool sink = false;
+
+/**
+ * @brief Runs f for a number of iterations and reports the average wall time
+ * of one iteration
+ *
+ * The results of f are folded into a volatile sink, so that the optimizer
+ * cannot discard the measured work.
+ */
+template <typename F>
+auto run(std::string_view name, std::size_t iterations, F f) -> double
+{
+  // Warm up caches and branch predictors
+  for (std::size_t i = 0; i < iterations / 10 + 1; ++i) {
+    sink = f();
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+  for (std::size_t i = 0; i < iterations; ++i) {
+    sink = f();
+  }
+  const auto end = std::chrono::steady_clock::now();
+
+  const double ns_per_iteration =
+      std::chrono::duration<double, std::nano>(end - start).count() /
+      static_cast<double>(iterations);
+
+  std::cout << std::left << std::setw(40) << name << std::right
+            << std::setw(12) << std::fixed << std::setprecision(1)
+            << ns_per_iteration << " ns/iter\n";
+  return ns_per_iteration;
+}
+
+} // namespace eml_benchmark
+
+#endif // EML_BENCHMARK_HPP
@@ -0,0 +1,83 @@
+#include <string>
+#include <utility>
+
+#include "eml.hpp"
+
+#include "benchmark.hpp"
+
+namespace {
+
+constexpr std::size_t iterations = 1000000;
+
+struct Program {
+  const char* name;
+  const char* source;
+};
+
+// The runnable programs of the integration tests, and one with the patterns
+// that the peephole optimizer targets
+constexpr Program programs[] = {
+    {"If Else", "if (5 > 1) {2 + 3} else {4 - 6}"},
+    {"Else If", "if (1 > 10) {\n  2 + 3\n} else if (1 < 4) {\n  33\n} else "
+                "{\n  42\n}"},
+    {"Negations",
+     "if (!(1 > 2)) {if (!(3 < 4)) {-(-5)} else {6}} else {7}"},
+};
+
+constexpr std::pair<eml::OptimizationLevel, const char*> levels[] = {
+    {eml::OptimizationLevel::none, "none"},
+    {eml::OptimizationLevel::peephole, "peephole"},
+    {eml::OptimizationLevel::full, "full"},
+};
+
+// Reports the number of instructions and the run time of a program at each
+// optimization level
+void benchmark_program(const Program& program)
+{
+  eml::GarbageCollector gc;
+  eml::VM vm{gc};
+
+  double baseline_ns = 0;
+  std::size_t baseline_count = 0;
+  for (const auto& [level, level_name] : levels) {
+    eml::CompilerConfig config;
+    config.optimization_level = level;
+    eml::Compiler compiler{gc, config};
+
+    auto compile_result = compiler.compile(program.source);
+    if (!compile_result) {
+      std::cerr << "Fails to compile benchmark source\n";
+      std::exit(1);
+    }
+    const auto& code = std::get<0>(*compile_result);
+
+    const auto count = code.decode().size();
+    const auto name = std::string{program.name} + " (" + level_name + ", " +
+                      std::to_string(count) + " instructions)";
+    const eml::PreparedBytecode prepared{code};
+    const auto ns = eml_benchmark::run(name, iterations, [&]() {
+      const auto result = vm.interpret(prepared);
+      return result && result->is_number();
+    });
+
+    if (level == eml::OptimizationLevel::none) {
+      baseline_ns = ns;
+      baseline_count = count;
+    } else {
+      std::cout << "  " << std::setprecision(0)
+                << 100. * (1. - static_cast<double>(count) /
+                                    static_cast<double>(baseline_count))
+                << "% fewer instructions, " << 100. * (1. - ns / baseline_ns)
+                << "% less time than none\n";
+    }
+  }
+}
+
+} // anonymous namespace
+
+int main()
+{
+  for (const auto& program : programs) {
+    benchmark_program(program);
+  }
+}
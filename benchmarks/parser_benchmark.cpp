@@ -0,0 +1,53 @@
+#include <cstdlib>
+#include <string>
+
+#include "eml.hpp"
+
+#include "benchmark.hpp"
+
+namespace {
+
+constexpr std::size_t iterations = 200;
+
+// A generated source of nested ifs over arithmetic with about 30000 nodes,
+// like the large formulas that embedders generate
+auto generated_source() -> std::string
+{
+  std::string source = "0";
+  for (int i = 0; i < 1000; ++i) {
+    const auto n = std::to_string(i);
+    source = "if (" + n + " * 2 + 1 < " + n + " / 3 - -4 == (1 <= 2)) {" +
+             source + " + (1 + 2) * 3} else {" + n + " - " + n + " * 2}";
+    if (i % 2 == 1) {
+      source = "(" + source + ") * (1 - " + n + ")";
+    }
+  }
+  return source;
+}
+
+} // anonymous namespace
+
+int main()
+{
+  const auto source = generated_source();
+  eml::GarbageCollector gc;
+  eml::Compiler compiler{gc};
+
+  eml_benchmark::run("parse (generated source)", iterations, [&]() {
+    const auto ast = eml::parse(source, gc);
+    return ast.has_value();
+  });
+
+  eml_benchmark::run("parse and type check (generated source)", iterations,
+                     [&]() {
+                       return eml::parse(source, gc)
+                           .and_then([&](auto ast) {
+                             return compiler.type_check(ast);
+                           })
+                           .has_value();
+                     });
+
+  eml_benchmark::run("compile (generated source)", iterations / 10, [&]() {
+    return compiler.compile(source).has_value();
+  });
+}
@@ -0,0 +1,111 @@
+#include <string>
+
+#include "eml.hpp"
+
+#include "benchmark.hpp"
+
+namespace {
+
+constexpr std::size_t iterations = 100000;
+
+// 1 + 2 * 3 - 4 / 5 + 6 * 7 - ...
+auto arithmetic_source(int terms) -> std::string
+{
+  constexpr const char* operators[] = {" + ", " * ", " - ", " / "};
+  std::string source = "1";
+  for (int i = 1; i < terms; ++i) {
+    source += operators[i % 4];
+    source += std::to_string(i % 9 + 1);
+  }
+  return source;
+}
+
+// if (0 > 1) {0} else if (1 > 2) {1} else if ... else {-1}
+auto branch_source(int depth) -> std::string
+{
+  std::string source;
+  for (int i = 0; i < depth; ++i) {
+    source += "if (" + std::to_string(i) + " > " + std::to_string(i + 1) +
+              ") {" + std::to_string(i) + "} else ";
+  }
+  source += "{-1}";
+  return source;
+}
+
+// Compiles without going through the optimizations of `Compiler::compile`, so
+// that the vm executes every instruction of the source
+auto type_check(eml::Compiler& compiler, eml::GarbageCollector& gc,
+                const std::string& source) -> eml::Ast
+{
+  auto ast = eml::parse(source, gc);
+  if (!ast) {
+    std::cerr << "Fails to parse benchmark source\n";
+    std::exit(1);
+  }
+  auto checked_ast = compiler.type_check(*ast);
+  if (!checked_ast) {
+    std::cerr << "Fails to type check benchmark source\n";
+    std::exit(1);
+  }
+  return std::move(*checked_ast);
+}
+
+// Runs the code of source as bytecode, which the vm prepares on the first run,
+// as prepared bytecode, as native code if the jit is supported, as bytecode in
+// the jit execution mode, which translates it on the first run, and as register
+// code
+void benchmark_interpreter(const std::string& name, const std::string& source)
+{
+  eml::GarbageCollector gc;
+  eml::Compiler compiler{gc};
+  eml::VM vm{gc};
+
+  const auto ast = type_check(compiler, gc, source);
+  const auto code = std::get<0>(compiler.generate_code(*ast));
+  eml_benchmark::run(name, iterations, [&]() {
+    const auto result = vm.interpret(code);
+    return result && result->is_number();
+  });
+
+  const eml::PreparedBytecode prepared{code};
+  eml_benchmark::run(name + ", prepared", iterations, [&]() {
+    const auto result = vm.interpret(prepared);
+    return result && result->is_number();
+  });
+
+  if (const auto native = eml::jit_compile(code); native) {
+    eml_benchmark::run(name + ", native", iterations, [&]() {
+      const auto result = vm.interpret(*native);
+      return result && result->is_number();
+    });
+
+    eml::VM jit{gc, eml::VMConfig{256, eml::ExecutionMode::jit}};
+    eml_benchmark::run(name + ", jit mode", iterations, [&]() {
+      const auto result = jit.interpret(code);
+      return result && result->is_number();
+    });
+  }
+
+  const auto register_result = compiler.generate_register_code(*ast);
+  if (!register_result) {
+    std::cerr << "Fails to generate register code of benchmark source\n";
+    std::exit(1);
+  }
+  const auto& register_code = std::get<0>(*register_result);
+  eml_benchmark::run(name + ", registers", iterations, [&]() {
+    const auto result = vm.interpret(register_code);
+    return result && result->is_number();
+  });
+
+  std::cout << "  instructions: " << prepared.instructions().size()
+            << " stack, " << register_code.instructions.size()
+            << " registers\n";
+}
+
+} // anonymous namespace
+
+int main()
+{
+  benchmark_interpreter("arithmetic (100 terms)", arithmetic_source(100));
+  benchmark_interpreter("branches (20 levels)", branch_source(20));
+}
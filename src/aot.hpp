@@ -0,0 +1,67 @@
+#ifndef EML_AOT_HPP
+#define EML_AOT_HPP
+
+#include <functional>
+#include <string_view>
+#include <vector>
+
+#include "memory.hpp"
+#include "string.hpp"
+
+/**
+ * @file aot.hpp
+ * @brief This file contains the runtime support of the C++ code that
+ * `eml --emit-cpp` generates, see Compiler::generate_cpp
+ */
+
+namespace eml {
+
+/**
+ * @brief The strings of a running function of generated C++ code
+ *
+ * The locals of generated code are not roots of the garbage collector, so the
+ * strings they refer to are pinned until the function returns.
+ */
+class AotStrings {
+public:
+  explicit AotStrings(GarbageCollector& gc) : gc_{gc} {}
+
+  ~AotStrings()
+  {
+    for (const auto s : strings_) {
+      s->unpin();
+    }
+  }
+
+  AotStrings(const AotStrings&) = delete;
+  auto operator=(const AotStrings&) -> AotStrings& = delete;
+  AotStrings(AotStrings&&) = delete;
+  auto operator=(AotStrings&&) -> AotStrings& = delete;
+
+  /// @brief Returns the string of a literal
+  [[nodiscard]] auto literal(std::string_view text) -> GcPointer
+  {
+    return keep(make_string(text, gc_));
+  }
+
+  /// @brief Returns the concatenation of two strings
+  [[nodiscard]] auto cat(GcPointer lhs, GcPointer rhs) -> GcPointer
+  {
+    return keep(string_cat(lhs, rhs, gc_));
+  }
+
+private:
+  std::reference_wrapper<GarbageCollector> gc_;
+  std::vector<GcPointer> strings_;
+
+  auto keep(GcPointer s) -> GcPointer
+  {
+    s->pin();
+    strings_.push_back(s);
+    return s;
+  }
+};
+
+} // namespace eml
+
+#endif // EML_AOT_HPP
@@ -0,0 +1,159 @@
+#ifndef EML_ARENA_HPP
+#define EML_ARENA_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+ * @file arena.hpp
+ * @brief This file contains the arena that the nodes of an AST get allocated
+ * from
+ */
+
+namespace eml {
+
+/**
+ * @brief A monotonic buffer that owns the objects it allocates
+ *
+ * Objects get carved out of large chunks and never get freed one by one.
+ * Destroying the arena runs the destructors of its objects, in reverse order of
+ * construction, and then releases all the chunks at once. The objects stay at
+ * the same address when the arena moves.
+ */
+class Arena {
+public:
+  Arena() = default;
+
+  ~Arena()
+  {
+    release();
+  }
+
+  Arena(const Arena&) = delete;
+  auto operator=(const Arena&) -> Arena& = delete;
+
+  Arena(Arena&& other) noexcept
+      : chunks_{std::move(other.chunks_)},
+        destructors_{std::move(other.destructors_)},
+        current_{std::exchange(other.current_, nullptr)},
+        remaining_{std::exchange(other.remaining_, 0)}
+  {
+    other.chunks_.clear();
+    other.destructors_.clear();
+  }
+
+  auto operator=(Arena&& other) noexcept -> Arena&
+  {
+    if (this != &other) {
+      release();
+      chunks_ = std::move(other.chunks_);
+      destructors_ = std::move(other.destructors_);
+      current_ = std::exchange(other.current_, nullptr);
+      remaining_ = std::exchange(other.remaining_, 0);
+      other.chunks_.clear();
+      other.destructors_.clear();
+    }
+    return *this;
+  }
+
+  /**
+   * @brief Constructs an object of type T in the arena
+   *
+   * The arena owns the object, which lives until the arena gets destroyed.
+   */
+  template <typename T, typename... Args> auto make(Args&&... args) -> T*
+  {
+    static_assert(alignof(T) <= alignof(std::max_align_t),
+                  "The arena does not support over-aligned types");
+
+    void* memory = allocate(sizeof(T), alignof(T));
+    T* object = ::new (memory) T(std::forward<Args>(args)...);
+    if constexpr (!std::is_trivially_destructible_v<T>) {
+      destructors_.push_back(
+          {object, [](void* o) { static_cast<T*>(o)->~T(); }});
+    }
+    return object;
+  }
+
+  /// @brief Gets the number of bytes of the chunks of the arena
+  [[nodiscard]] auto capacity() const noexcept -> std::size_t
+  {
+    std::size_t result = 0;
+    for (const auto& chunk : chunks_) {
+      result += chunk.size;
+    }
+    return result;
+  }
+
+private:
+  static constexpr std::size_t first_chunk_size = 4096;
+  static constexpr std::size_t max_chunk_size = 64 * 1024;
+
+  struct Chunk {
+    std::unique_ptr<std::byte[]> memory;
+    std::size_t size = 0;
+  };
+
+  struct Destructor {
+    void* object;
+    void (*destroy)(void*);
+  };
+
+  std::vector<Chunk> chunks_;
+  std::vector<Destructor> destructors_;
+  std::byte* current_ = nullptr;
+  std::size_t remaining_ = 0;
+
+  auto allocate(std::size_t size, std::size_t alignment) -> void*
+  {
+    const std::uintptr_t address = reinterpret_cast<std::uintptr_t>(current_);
+    const std::size_t padding = (alignment - address % alignment) % alignment;
+    if (current_ == nullptr || padding + size > remaining_) {
+      // The chunks grow geometrically, so that large sources need few of them
+      const std::size_t chunk_size =
+          std::max(size, chunks_.empty()
+                             ? first_chunk_size
+                             : std::min(chunks_.back().size * 2,
+                                        max_chunk_size));
+      // Unlike std::make_unique, new[] leaves the bytes uninitialized
+      std::unique_ptr<std::byte[]> memory{new std::byte[chunk_size]};
+      chunks_.push_back({std::move(memory), chunk_size});
+      current_ = chunks_.back().memory.get();
+      remaining_ = chunk_size;
+      return bump(size);
+    }
+
+    current_ += padding;
+    remaining_ -= padding;
+    return bump(size);
+  }
+
+  auto bump(std::size_t size) noexcept -> void*
+  {
+    void* result = current_;
+    current_ += size;
+    remaining_ -= size;
+    return result;
+  }
+
+  void release() noexcept
+  {
+    for (auto itr = destructors_.rbegin(); itr != destructors_.rend(); ++itr) {
+      itr->destroy(itr->object);
+    }
+    destructors_.clear();
+    chunks_.clear();
+    current_ = nullptr;
+    remaining_ = 0;
+  }
+};
+
+} // namespace eml
+
+#endif // EML_ARENA_HPP
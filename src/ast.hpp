@@ -10,11 +10,12 @@
  * Embedded ML
  */
 
+#include "arena.hpp"
 #include "common.hpp"
+#include "symbol.hpp"
 #include "type.hpp"
 #include "value.hpp"
 
-#include <memory>
 #include <optional>
 #include <vector>
 
@@ -23,15 +24,16 @@ namespace eml {
 struct AstNode;
 struct Expr;
 
-/// @brief Provides a wrapper of `std::make_unique` to its derived classes
+/// @brief Provides a wrapper of `Arena::make` to its derived classes
 template <typename Derived> struct FactoryMixin {
   /**
-   * @brief A factory member function that creates a `std::unique_ptr` of itself
+   * @brief A factory member function that creates itself in an arena, which
+   * owns the result
    */
   template <typename... Args>
-  static auto create(Args&&... args) -> std::unique_ptr<Derived>
+  static auto create(Arena& arena, Args&&... args) -> Derived*
   {
-    return std::make_unique<Derived>(std::forward<Args>(args)...);
+    return arena.make<Derived>(std::forward<Args>(args)...);
   }
 };
 
@@ -214,8 +216,8 @@ private:
 
 namespace detail {
 struct Let {
-  std::string_view identifier;
-  std::unique_ptr<Expr> to;
+  Symbol identifier;
+  Expr* to;
   std::optional<Type> type;
 };
 } // namespace detail
@@ -225,13 +227,18 @@ struct Let {
  */
 class Definition : public AstNode, public FactoryMixin<Definition> {
 public:
-  Definition(std::string_view identifier, std::unique_ptr<Expr> to,
-             std::optional<Type> type = {})
-      : AstNode{UnitType{}}, binding_{identifier, std::move(to), type}
+  Definition(Symbol identifier, Expr* to, std::optional<Type> type = {})
+      : AstNode{UnitType{}}, binding_{identifier, to, type}
   {
   }
 
   [[nodiscard]] auto identifier() const -> std::string_view
+  {
+    return binding_.identifier.name();
+  }
+
+  /// @brief Gets the symbol that a definition binds
+  [[nodiscard]] auto symbol() const -> Symbol
   {
     return binding_.identifier;
   }
@@ -254,6 +261,15 @@ public:
     return *binding_.to;
   }
 
+  /**
+   * @brief Gets the pointer of the expression a definition bind to, so that
+   * passes can replace it
+   */
+  [[nodiscard]] auto to_ptr() noexcept -> Expr*&
+  {
+    return binding_.to;
+  }
+
   void accept(AstVisitor& visitor) override
   {
     visitor(*this);
@@ -277,7 +293,8 @@ public:
   explicit Expr(Type type) : AstNode{type} {}
 };
 
-using Expr_ptr = std::unique_ptr<Expr>;
+/// @brief A pointer to an expression in the arena of its AST
+using Expr_ptr = Expr*;
 
 /**
  * @brief A literal expression node of the AST is a Node contains a value
@@ -299,9 +316,28 @@ class LiteralExpr final : public Expr, public FactoryMixin<LiteralExpr> {
   }
 
 public:
-  explicit LiteralExpr(Value v) : Expr{deduce_literal_type(v)}, v_{v} {}
+  // A literal pins the object it refers to until the AST is destroyed, since
+  // collections may run while the rest of the source get parsed
+  explicit LiteralExpr(Value v) : Expr{deduce_literal_type(v)}, v_{v}
+  {
+    pin(v_);
+  }
+
+  LiteralExpr(Value v, Type t) : Expr{t}, v_{std::move(v)}
+  {
+    pin(v_);
+  }
+
+  ~LiteralExpr() override
+  {
+    unpin(v_);
+  }
+
+  LiteralExpr(const LiteralExpr&) = delete;
+  auto operator=(const LiteralExpr&) -> LiteralExpr& = delete;
+  LiteralExpr(LiteralExpr&&) = delete;
+  auto operator=(LiteralExpr&&) -> LiteralExpr& = delete;
 
-  LiteralExpr(Value v, Type t) : Expr{t}, v_{std::move(v)} {}
   auto value() const -> Value
   {
     return v_;
@@ -323,7 +359,7 @@ public:
  */
 class IdentifierExpr final : public Expr, public FactoryMixin<IdentifierExpr> {
 public:
-  explicit IdentifierExpr(std::string name) : name_{std::move(name)} {}
+  explicit IdentifierExpr(Symbol symbol) : symbol_{symbol} {}
 
   void accept(AstVisitor& visitor) override
   {
@@ -335,9 +371,14 @@ public:
     visitor(*this);
   }
 
-  std::string name() const
+  std::string_view name() const
+  {
+    return symbol_.name();
+  }
+
+  Symbol symbol() const
   {
-    return name_;
+    return symbol_;
   }
 
   /**
@@ -357,7 +398,7 @@ public:
   }
 
 private:
-  std::string name_;
+  Symbol symbol_;
   std::optional<Value> value_;
 };
 
@@ -367,7 +408,7 @@ private:
 class IfExpr final : public Expr, public FactoryMixin<IfExpr> {
 public:
   IfExpr(Expr_ptr cond, Expr_ptr If, Expr_ptr Else)
-      : cond_{std::move(cond)}, if_(std::move(If)), else_(std::move(Else))
+      : cond_{cond}, if_{If}, else_{Else}
   {
   }
 
@@ -419,6 +460,33 @@ public:
     return *else_;
   }
 
+  /**
+   * @brief Gets the pointer of the condition, so that passes can
+   * replace it
+   */
+  auto cond_ptr() noexcept -> Expr_ptr&
+  {
+    return cond_;
+  }
+
+  /**
+   * @brief Gets the pointer of the if branch, so that passes can
+   * replace it
+   */
+  auto if_ptr() noexcept -> Expr_ptr&
+  {
+    return if_;
+  }
+
+  /**
+   * @brief Gets the pointer of the else branch, so that passes can
+   * replace it
+   */
+  auto else_ptr() noexcept -> Expr_ptr&
+  {
+    return else_;
+  }
+
   void accept(AstVisitor& visitor) override
   {
     visitor(*this);
@@ -441,7 +509,7 @@ private:
 class LambdaExpr final : public Expr, public FactoryMixin<LambdaExpr> {
 public:
   LambdaExpr(std::vector<std::string> arguments, Expr_ptr expression)
-      : args_{std::move(arguments)}, exprs_{std::move(expression)}
+      : args_{std::move(arguments)}, exprs_{expression}
   {
     EML_ASSERT(exprs_ != nullptr,
                "Cannot create a lambda that evaluate to nothing");
@@ -480,7 +548,7 @@ class UnaryOpExpr : public Expr {
   Expr_ptr operand_;
 
 public:
-  explicit UnaryOpExpr(Expr_ptr operand) : operand_{std::move(operand)}
+  explicit UnaryOpExpr(Expr_ptr operand) : operand_{operand}
   {
     EML_ASSERT(operand_ != nullptr,
                "Operand of unary operation cannot be nullptr");
@@ -490,6 +558,15 @@ public:
   {
     return *operand_;
   }
+
+  /**
+   * @brief Gets the pointer of the operand, so that passes can replace
+   * it
+   */
+  Expr_ptr& operand_ptr() noexcept
+  {
+    return operand_;
+  }
 };
 
 /**
@@ -502,7 +579,7 @@ template <detail::UnaryOpType optype>
 struct UnaryOpExprTemplate final : UnaryOpExpr,
                                    FactoryMixin<UnaryOpExprTemplate<optype>> {
   explicit UnaryOpExprTemplate(Expr_ptr operand)
-      : UnaryOpExpr{std::move(operand)}
+      : UnaryOpExpr{operand}
   {
   }
 
@@ -526,7 +603,7 @@ class BinaryOpExpr : public Expr {
 
 public:
   explicit BinaryOpExpr(Expr_ptr lhs, Expr_ptr rhs)
-      : lhs_{std::move(lhs)}, rhs_{std::move(rhs)}
+      : lhs_{lhs}, rhs_{rhs}
   {
     EML_ASSERT(lhs_ != nullptr, "Operand of unary operation cannot be nullptr");
     EML_ASSERT(rhs_ != nullptr, "Operand of unary operation cannot be nullptr");
@@ -541,6 +618,21 @@ public:
   {
     return *rhs_;
   }
+
+  /**
+   * @brief Gets the pointers of the operands, so that passes can replace
+   * them
+   */
+  Expr_ptr& lhs_ptr() noexcept
+  {
+    return lhs_;
+  }
+
+  /// @copydoc lhs_ptr
+  Expr_ptr& rhs_ptr() noexcept
+  {
+    return rhs_;
+  }
 };
 
 /**
@@ -554,7 +646,7 @@ template <detail::BinaryOpType optype>
 struct BinaryOpExprTemplate final : BinaryOpExpr,
                                     FactoryMixin<BinaryOpExprTemplate<optype>> {
   explicit BinaryOpExprTemplate(Expr_ptr lhs, Expr_ptr rhs)
-      : BinaryOpExpr{std::move(lhs), std::move(rhs)}
+      : BinaryOpExpr{lhs, rhs}
   {
   }
 
@@ -569,6 +661,92 @@ struct BinaryOpExprTemplate final : BinaryOpExpr,
   }
 };
 
+/**
+ * @brief The operators of comparisons
+ *
+ * The code generators fuse a comparison in the condition of an if expression
+ * with its branch, and look up the fused instruction by the operator.
+ */
+enum class ComparisonOp : std::uint8_t {
+  equal,
+  not_equal,
+  less,
+  less_equal,
+  greater,
+  greater_equal,
+};
+
+/**
+ * @brief Returns the operator of expr if it is a comparison, or nullopt
+ * otherwise
+ */
+inline auto comparison_of(const Expr& expr) -> std::optional<ComparisonOp>
+{
+  if (dynamic_cast<const EqOpExpr*>(&expr) != nullptr) {
+    return ComparisonOp::equal;
+  }
+  if (dynamic_cast<const NeqOpExpr*>(&expr) != nullptr) {
+    return ComparisonOp::not_equal;
+  }
+  if (dynamic_cast<const LessOpExpr*>(&expr) != nullptr) {
+    return ComparisonOp::less;
+  }
+  if (dynamic_cast<const LeOpExpr*>(&expr) != nullptr) {
+    return ComparisonOp::less_equal;
+  }
+  if (dynamic_cast<const GreaterOpExpr*>(&expr) != nullptr) {
+    return ComparisonOp::greater;
+  }
+  if (dynamic_cast<const GeExpr*>(&expr) != nullptr) {
+    return ComparisonOp::greater_equal;
+  }
+  return std::nullopt;
+}
+
+/**
+ * @brief An abstract syntax tree, which owns the arena that all of its nodes
+ * live in
+ *
+ * Destroying the tree frees every node at once.
+ */
+class Ast {
+public:
+  Ast(Arena arena, AstNode* root) : arena_{std::move(arena)}, root_{root}
+  {
+    EML_ASSERT(root_ != nullptr, "An AST must have a root");
+  }
+
+  auto operator*() const noexcept -> AstNode&
+  {
+    return *root_;
+  }
+
+  auto operator->() const noexcept -> AstNode*
+  {
+    return root_;
+  }
+
+  /**
+   * @brief Gets the pointer of the root node, so that passes can replace it
+   */
+  auto root_ptr() noexcept -> AstNode*&
+  {
+    return root_;
+  }
+
+  /**
+   * @brief Gets the arena of the nodes, where passes create new nodes
+   */
+  auto arena() noexcept -> Arena&
+  {
+    return arena_;
+  }
+
+private:
+  Arena arena_;
+  AstNode* root_;
+};
+
 } // namespace eml
 
 #endif // EML_AST_HPP
@@ -11,21 +11,10 @@ std::string Bytecode::disassemble() const
 
   std::string result;
 
-  for (auto ip = instructions.begin(); ip != instructions.end(); ++ip) {
+  for (auto ip = instructions_.begin(); ip != instructions_.end(); ++ip) {
     result += disassemble_instruction(ip, offset);
-    const auto instruction = *ip;
-    switch (static_cast<opcode>(instruction)) {
-    case op_push_f64: {
-      ++ip;
-    } break;
-    case op_jmp: {
-      ++ip;
-    } break;
-    case op_jmp_false: {
-      ++ip;
-    } break;
-    default:; // Nothing special
-    }
+    // Skip the operand
+    ip += instruction_size(static_cast<opcode>(*ip)) - 1;
 
     ++offset;
   }
@@ -73,12 +62,40 @@ auto Bytecode::disassemble_instruction(instruction_iterator ip,
     ss << name << ' ' << static_cast<int>(*++current_ip) << '\n';
   };
 
+  // Print instruction with one wide constant argument
+  auto disassemble_instruction_with_one_long_const_float_parem =
+      [&](auto& current_ip, std::string_view name) {
+        print_hex_dump(current_ip, 1 + std::size_t{long_operand_size});
+        const auto index = read_long_operand(++current_ip);
+        const auto v = constants_.at(index);
+        ss << name << ' ' << index << " //"
+           << to_string(eml::NumberType{}, v, PrintType::no) << '\n';
+      };
+
+  // Print global instruction with the slot as its argument
+  auto disassemble_global = [&](auto& current_ip, std::string_view name) {
+    print_hex_dump(current_ip, 2);
+    ss << name << ' ' << std::to_integer<unsigned>(*++current_ip) << '\n';
+  };
+
+  // Print global instruction with the slot as its wide argument
+  auto disassemble_long_global = [&](auto& current_ip, std::string_view name) {
+    print_hex_dump(current_ip, 1 + std::size_t{long_operand_size});
+    ss << name << ' ' << read_long_operand(++current_ip) << '\n';
+  };
+
+  // Print jump instruction with one wide argument
+  auto disassemble_long_jmp = [&](auto& current_ip, std::string_view name) {
+    print_hex_dump(current_ip, 1 + std::size_t{long_operand_size});
+    ss << name << ' ' << read_long_operand(++current_ip) << '\n';
+  };
+
   // Dump file in source line
   constexpr std::size_t linum_digits = 4;
-  if (offset != 0 && lines[offset].value == lines[offset - 1].value) {
+  if (offset != 0 && lines_[offset].value == lines_[offset - 1].value) {
     ss << std::setfill(' ') << std::setw(linum_digits) << '|';
   } else {
-    ss << std::setfill('0') << std::setw(linum_digits) << lines[offset].value;
+    ss << std::setfill('0') << std::setw(linum_digits) << lines_[offset].value;
   }
   ss << "    ";
 
@@ -146,11 +163,220 @@ auto Bytecode::disassemble_instruction(instruction_iterator ip,
   case op_jmp_false:
     disassemble_jmp(ip, "jump_false");
     break;
+  case op_push_f64_long:
+    disassemble_instruction_with_one_long_const_float_parem(ip, "push_long");
+    break;
+  case op_jmp_long:
+    disassemble_long_jmp(ip, "jump_long");
+    break;
+  case op_jmp_false_long:
+    disassemble_long_jmp(ip, "jump_false_long");
+    break;
+  case op_jmp_true:
+    disassemble_jmp(ip, "jump_true");
+    break;
+  case op_jmp_true_long:
+    disassemble_long_jmp(ip, "jump_true_long");
+    break;
+  case op_jmp_if_not_equal:
+    disassemble_jmp(ip, "jump_if_not_equal");
+    break;
+  case op_jmp_if_equal:
+    disassemble_jmp(ip, "jump_if_equal");
+    break;
+  case op_jmp_if_not_less_f64:
+    disassemble_jmp(ip, "jump_if_not_less<f64>");
+    break;
+  case op_jmp_if_not_less_equal_f64:
+    disassemble_jmp(ip, "jump_if_not_less_equal<f64>");
+    break;
+  case op_jmp_if_not_greater_f64:
+    disassemble_jmp(ip, "jump_if_not_greater<f64>");
+    break;
+  case op_jmp_if_not_greater_equal_f64:
+    disassemble_jmp(ip, "jump_if_not_greater_equal<f64>");
+    break;
+  case op_jmp_if_not_equal_long:
+    disassemble_long_jmp(ip, "jump_if_not_equal_long");
+    break;
+  case op_jmp_if_equal_long:
+    disassemble_long_jmp(ip, "jump_if_equal_long");
+    break;
+  case op_jmp_if_not_less_f64_long:
+    disassemble_long_jmp(ip, "jump_if_not_less<f64>_long");
+    break;
+  case op_jmp_if_not_less_equal_f64_long:
+    disassemble_long_jmp(ip, "jump_if_not_less_equal<f64>_long");
+    break;
+  case op_jmp_if_not_greater_f64_long:
+    disassemble_long_jmp(ip, "jump_if_not_greater<f64>_long");
+    break;
+  case op_jmp_if_not_greater_equal_f64_long:
+    disassemble_long_jmp(ip, "jump_if_not_greater_equal<f64>_long");
+    break;
+  case op_add_f64_k:
+    disassemble_instruction_with_one_const_float_parem(ip, "add_k<f64>");
+    break;
+  case op_subtract_f64_k:
+    disassemble_instruction_with_one_const_float_parem(ip, "sub_k<f64>");
+    break;
+  case op_multiply_f64_k:
+    disassemble_instruction_with_one_const_float_parem(ip, "mult_k<f64>");
+    break;
+  case op_divide_f64_k:
+    disassemble_instruction_with_one_const_float_parem(ip, "div_k<f64>");
+    break;
+  case op_less_f64_k:
+    disassemble_instruction_with_one_const_float_parem(ip, "lt_k<f64>");
+    break;
+  case op_less_equal_f64_k:
+    disassemble_instruction_with_one_const_float_parem(ip, "le_k<f64>");
+    break;
+  case op_greater_f64_k:
+    disassemble_instruction_with_one_const_float_parem(ip, "gt_k<f64>");
+    break;
+  case op_greater_equal_f64_k:
+    disassemble_instruction_with_one_const_float_parem(ip, "ge_k<f64>");
+    break;
+  case op_get_global:
+    disassemble_global(ip, "get_global");
+    break;
+  case op_set_global:
+    disassemble_global(ip, "set_global");
+    break;
+  case op_get_global_long:
+    disassemble_long_global(ip, "get_global_long");
+    break;
+  case op_set_global_long:
+    disassemble_long_global(ip, "set_global_long");
+    break;
   }
 
   return ss.str();
 }
 
+namespace {
+
+// Whether the operand of op is the index of a constant
+constexpr auto reads_constant(opcode op) noexcept -> bool
+{
+  switch (op) {
+  case op_push_f64:
+  case op_push_f64_long:
+  case op_add_f64_k:
+  case op_subtract_f64_k:
+  case op_multiply_f64_k:
+  case op_divide_f64_k:
+  case op_less_f64_k:
+  case op_less_equal_f64_k:
+  case op_greater_f64_k:
+  case op_greater_equal_f64_k:
+    return true;
+  default:
+    return false;
+  }
+}
+
+// Returns the single byte operand variant of a global instruction, or nullopt
+// if op does not access a global
+constexpr auto short_global_of(opcode op) noexcept -> std::optional<opcode>
+{
+  switch (op) {
+  case op_get_global:
+  case op_get_global_long:
+    return op_get_global;
+  case op_set_global:
+  case op_set_global_long:
+    return op_set_global;
+  default:
+    return std::nullopt;
+  }
+}
+
+} // anonymous namespace
+
+auto Bytecode::decode() const -> std::vector<DecodedInstruction>
+{
+  std::vector<DecodedInstruction> result;
+  // The index of the instruction that starts at each byte
+  std::vector<std::size_t> instruction_at(instructions_.size() + 1);
+
+  for (std::size_t index = 0; index < instructions_.size();) {
+    const auto op = static_cast<opcode>(instructions_[index]);
+    const auto size = static_cast<std::size_t>(instruction_size(op));
+    instruction_at[index] = result.size();
+
+    std::size_t operand = 0;
+    if (size == 1 + long_operand_size) {
+      operand = read_long_operand(instructions_.begin() +
+                                  static_cast<std::ptrdiff_t>(index) + 1);
+    } else if (size == 2) {
+      operand = std::to_integer<std::size_t>(instructions_[index + 1]);
+    }
+
+    if (is_jump(op)) {
+      // The offset is relative to the end of the instruction. Keeps the byte
+      // index of the target until every instruction is decoded.
+      operand += index + size;
+    }
+    result.push_back(
+        {is_jump(op) ? short_jump_of(op) : op, operand, lines_[index]});
+    index += size;
+  }
+  instruction_at.back() = result.size();
+
+  for (auto& instruction : result) {
+    if (is_jump(instruction.op)) {
+      instruction.operand = instruction_at[instruction.operand];
+    }
+  }
+  return result;
+}
+
+PreparedBytecode::PreparedBytecode(const Bytecode& code) : code_{code}
+{
+  const auto decoded = code.decode();
+  instructions_.reserve(decoded.size());
+  for (const auto& [op, operand, line] : decoded) {
+    PreparedInstruction instruction{op, {}, Value{}};
+    if (is_jump(op)) {
+      instruction.target = static_cast<std::uint32_t>(operand);
+    } else if (reads_constant(op)) {
+      instruction.op = op == op_push_f64_long ? op_push_f64 : op;
+      instruction.constant = code.constants().at(operand);
+    } else if (const auto global = short_global_of(op); global) {
+      instruction.op = *global;
+      instruction.slot = static_cast<std::uint32_t>(operand);
+    }
+    instructions_.push_back(instruction);
+  }
+
+  // The depth on entry to each instruction, or -1 if nothing reaches it. Jumps
+  // go forward, so every way into an instruction is known before it. The
+  // stored depth of the chunk is not used, since writers may not maintain it.
+  std::vector<std::ptrdiff_t> depth_at(decoded.size() + 1, -1);
+  if (!decoded.empty()) {
+    depth_at.front() = 0;
+  }
+  for (std::size_t i = 0; i < decoded.size(); ++i) {
+    const auto depth = depth_at[i];
+    if (depth < 0) {
+      continue;
+    }
+    const auto op = decoded[i].op;
+    const auto after = depth + stack_effect(op);
+    max_stack_depth_ = std::max(
+        max_stack_depth_, static_cast<std::size_t>(std::max(depth, after)));
+    if (is_jump(op)) {
+      auto& target = depth_at[decoded[i].operand];
+      target = std::max(target, after);
+    }
+    if (op != op_jmp) {
+      depth_at[i + 1] = std::max(depth_at[i + 1], after);
+    }
+  }
+}
+
 std::ostream& operator<<(std::ostream& os, const Bytecode& bytecode)
 {
   os << bytecode.disassemble();
@@ -1,11 +1,18 @@
 #ifndef EML_BYTECODE_HPP
 #define EML_BYTECODE_HPP
 
+#include <algorithm>
 #include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
 #include <ostream>
 #include <type_traits>
+#include <unordered_map>
 #include <vector>
 
+#include "module.hpp"
 #include "value.hpp"
 
 /**
@@ -18,72 +25,292 @@ namespace eml {
  * @brief The instruction set of the Embedded ML vm
  */
 enum opcode : std::underlying_type_t<std::byte> {
-  op_return,
-  op_push_f64, /*Pushes a float_64 constant with index [arg] to the stack*/
-  op_pop,      /*Pops and discards the top value of the stack*/
-
-  op_true,  /*Pushes true to the stack*/
-  op_false, /*Pushes false to the stack*/
-  op_unit,  /*Pushes unit to the stack*/
-
-  /*Unary Arithmatics*/
-  op_negate_f64,
-  op_not,
-
-  /*Binary Arithmatics*/
-  op_add_f64,
-  op_subtract_f64,
-  op_multiply_f64,
-  op_divide_f64,
-
-  /*String op*/
-  op_string_cat, // pop two strings and concatenate them, then push the
-                 // result back
-
-  /*Comparisons*/
-  op_equal,
-  op_not_equal,
-  op_less_f64,
-  op_less_equal_f64,
-  op_greater_f64,
-  op_greater_equal_f64,
-
-  /* Jumps */
-  op_jmp,       // Unconditionally jump instruction pointer [arg] forward
-  op_jmp_false, // Pop and if false then jump the instruction pointer [arg]
-                // forward.
-
+#define OPCODE_TABLE_ENTRY(op, stack_effect, operand_size) op,
+#include "opcode_table.inc"
+#undef OPCODE_TABLE_ENTRY
 };
 
 /// @brief The underlying numerical type of the @ref opcode enum
 using opcode_num_type = std::underlying_type_t<opcode>;
 
+/**
+ * @brief Returns the change of the number of values on the stack after
+ * executing the instruction op
+ */
+constexpr auto stack_effect(opcode op) noexcept -> int
+{
+  switch (op) {
+#define OPCODE_TABLE_ENTRY(op, stack_effect, operand_size)                     \
+  case op:                                                                     \
+    return stack_effect;
+#include "opcode_table.inc"
+#undef OPCODE_TABLE_ENTRY
+  }
+
+  return 0; // Unreachable
+}
+
+/**
+ * @brief Returns the number of bytes of the instruction op, including the
+ * opcode itself and its operand
+ */
+constexpr auto instruction_size(opcode op) noexcept -> std::ptrdiff_t
+{
+  switch (op) {
+#define OPCODE_TABLE_ENTRY(op, stack_effect, operand_size)                     \
+  case op:                                                                     \
+    return 1 + operand_size;
+#include "opcode_table.inc"
+#undef OPCODE_TABLE_ENTRY
+  }
+
+  return 1; // Unreachable
+}
+
+/// @brief The largest operand of the single byte operand instructions
+constexpr std::size_t max_short_operand = 0xff;
+
+/// @brief The largest operand of the wide operand instructions
+constexpr std::size_t max_long_operand = 0xffffff;
+
+/// @brief Number of bytes of the operand of the wide operand instructions
+constexpr std::ptrdiff_t long_operand_size = 3;
+
+/**
+ * @brief Returns the wide operand variant of a jump instruction
+ */
+constexpr auto long_jump_of(opcode op) noexcept -> opcode
+{
+  switch (op) {
+  case op_jmp:
+    return op_jmp_long;
+  case op_jmp_false:
+    return op_jmp_false_long;
+  case op_jmp_true:
+    return op_jmp_true_long;
+  case op_jmp_if_not_equal:
+    return op_jmp_if_not_equal_long;
+  case op_jmp_if_equal:
+    return op_jmp_if_equal_long;
+  case op_jmp_if_not_less_f64:
+    return op_jmp_if_not_less_f64_long;
+  case op_jmp_if_not_less_equal_f64:
+    return op_jmp_if_not_less_equal_f64_long;
+  case op_jmp_if_not_greater_f64:
+    return op_jmp_if_not_greater_f64_long;
+  case op_jmp_if_not_greater_equal_f64:
+    return op_jmp_if_not_greater_equal_f64_long;
+  default:
+    return op;
+  }
+}
+
+/**
+ * @brief Returns the single byte operand variant of a jump instruction
+ */
+constexpr auto short_jump_of(opcode op) noexcept -> opcode
+{
+  switch (op) {
+  case op_jmp_long:
+    return op_jmp;
+  case op_jmp_false_long:
+    return op_jmp_false;
+  case op_jmp_true_long:
+    return op_jmp_true;
+  case op_jmp_if_not_equal_long:
+    return op_jmp_if_not_equal;
+  case op_jmp_if_equal_long:
+    return op_jmp_if_equal;
+  case op_jmp_if_not_less_f64_long:
+    return op_jmp_if_not_less_f64;
+  case op_jmp_if_not_less_equal_f64_long:
+    return op_jmp_if_not_less_equal_f64;
+  case op_jmp_if_not_greater_f64_long:
+    return op_jmp_if_not_greater_f64;
+  case op_jmp_if_not_greater_equal_f64_long:
+    return op_jmp_if_not_greater_equal_f64;
+  default:
+    return op;
+  }
+}
+
+/**
+ * @brief Whether op is a jump instruction, whose operand is a forward offset
+ */
+constexpr auto is_jump(opcode op) noexcept -> bool
+{
+  return long_jump_of(op) != op || short_jump_of(op) != op;
+}
+
 /// @brief Line number
 struct line_num {
   std::size_t value;
 };
 
 class VM;
+class PreparedBytecode;
+class NativeCode;
+
+/**
+ * @brief An instruction of a Bytecode with its operand read out of the bytes
+ *
+ * Jumps are kept in their single byte operand variant, and their operand is
+ * the index of the target instruction instead of a byte offset. Other
+ * instructions keep their opcode and operand as they are.
+ */
+struct DecodedInstruction {
+  opcode op;
+  std::size_t operand;
+  line_num line;
+};
+
+/**
+ * @brief Finds the indices of the constants in a constant pool
+ *
+ * Numbers are the same constant if their bits are equal, so 0 and -0 are
+ * different constants and a NaN is the same constant as itself. Objects are
+ * the same constant if they are the same object, which is the case for string
+ * literals of the same text, since they are interned. The pool must pin its
+ * objects, so that they do not move. Other values are never found.
+ */
+class ConstantIndex {
+public:
+  /// @brief Returns the index of a constant that is the same as v, if any
+  [[nodiscard]] auto find(Value v) const -> std::optional<std::size_t>
+  {
+    if (v.is_number()) {
+      return find_in(numbers_, bit_cast<std::uint64_t>(v.unsafe_as_number()));
+    }
+    if (v.is_reference()) {
+      const Obj* object = v.unsafe_as_reference().get();
+      return find_in(objects_, object);
+    }
+    return {};
+  }
+
+  /// @brief Records that the constant v is at index of the pool
+  void insert(Value v, std::size_t index)
+  {
+    if (v.is_number()) {
+      numbers_.emplace(bit_cast<std::uint64_t>(v.unsafe_as_number()), index);
+    } else if (v.is_reference()) {
+      objects_.emplace(v.unsafe_as_reference().get(), index);
+    }
+  }
+
+private:
+  std::unordered_map<std::uint64_t, std::size_t> numbers_;
+  std::unordered_map<const Obj*, std::size_t> objects_;
+
+  template <typename Key>
+  static auto find_in(const std::unordered_map<Key, std::size_t>& indices,
+                      Key key) -> std::optional<std::size_t>
+  {
+    const auto pos = indices.find(key);
+    if (pos == indices.end()) {
+      return {};
+    }
+    return pos->second;
+  }
+};
 
 /**
  * @brief A chunk of eml bytecode
+ *
+ * The vm prepares the chunk on its first run, or translates it into native
+ * code in the jit execution mode, and keeps the result with the chunk for the
+ * later runs, see VM::interpret. The instructions, constants and lines can
+ * only change through the member functions, which drop them, and copies and
+ * moves start without them.
  */
 struct Bytecode {
-  std::vector<std::byte> instructions; // Instructions
-  std::vector<Value> constants;
-  std::vector<line_num> lines; // Source line information
+  /// Number of values on the stack after the last written instruction
+  std::ptrdiff_t stack_height = 0;
+  /// The maximum number of values the chunk has on the stack at once
+  std::size_t max_stack_depth = 0;
+  /// The module whose slots the global instructions of the chunk refer to
+  ModuleLink globals;
+
+  // The chunk pins the objects in its constant pool, so that they outlive
+  // collections for as long as the chunk exists
+  Bytecode() = default;
+
+  ~Bytecode()
+  {
+    for (const auto& constant : constants_) {
+      unpin(constant);
+    }
+  }
+
+  Bytecode(const Bytecode& other)
+      : stack_height{other.stack_height},
+        max_stack_depth{other.max_stack_depth}, globals{other.globals},
+        instructions_{other.instructions_}, constants_{other.constants_},
+        lines_{other.lines_}, constant_index_{other.constant_index_}
+  {
+    for (const auto& constant : constants_) {
+      pin(constant);
+    }
+  }
+
+  Bytecode(Bytecode&& other) noexcept
+      : stack_height{other.stack_height},
+        max_stack_depth{other.max_stack_depth},
+        globals{std::move(other.globals)},
+        instructions_{std::move(other.instructions_)},
+        constants_{std::move(other.constants_)},
+        lines_{std::move(other.lines_)},
+        constant_index_{std::move(other.constant_index_)}
+  {
+    other.constants_.clear();
+    other.drop_derived();
+  }
+
+  auto operator=(Bytecode other) noexcept -> Bytecode&
+  {
+    swap(*this, other);
+    return *this;
+  }
+
+  friend void swap(Bytecode& lhs, Bytecode& rhs) noexcept
+  {
+    using std::swap;
+    swap(lhs.instructions_, rhs.instructions_);
+    swap(lhs.constants_, rhs.constants_);
+    swap(lhs.lines_, rhs.lines_);
+    swap(lhs.stack_height, rhs.stack_height);
+    swap(lhs.max_stack_depth, rhs.max_stack_depth);
+    swap(lhs.globals, rhs.globals);
+    swap(lhs.constant_index_, rhs.constant_index_);
+    lhs.drop_derived();
+    rhs.drop_derived();
+  }
 
   /**
    * @brief Write an instruction to the instructions
+   *
+   * Also tracks the stack height by the stack effect of the instruction. On
+   * its own, the tracking treats all instructions as executed in sequence,
+   * which overestimates the depth of branches. Code generators can be precise
+   * by resetting stack_height at the start of each branch.
+   *
    * @param code The instruction to write
    * @param line The line this instruction in source
    * @return The index of the opcode in instructions
    */
   auto write(opcode code, line_num line) -> std::ptrdiff_t
   {
-    instructions.push_back(static_cast<std::byte>(code));
-    lines.push_back(line);
-    return static_cast<std::ptrdiff_t>(instructions.size() - 1);
+    drop_derived();
+    instructions_.push_back(static_cast<std::byte>(code));
+    lines_.push_back(line);
+
+    stack_height += stack_effect(code);
+    if (stack_height > 0) {
+      max_stack_depth =
+          std::max(max_stack_depth, static_cast<std::size_t>(stack_height));
+    }
+
+    return static_cast<std::ptrdiff_t>(instructions_.size() - 1);
   }
 
   /**
@@ -94,9 +321,23 @@ struct Bytecode {
    */
   auto write(std::byte code, line_num line) -> std::ptrdiff_t
   {
-    instructions.push_back(code);
-    lines.push_back(line);
-    return static_cast<std::ptrdiff_t>(instructions.size() - 1);
+    drop_derived();
+    instructions_.push_back(code);
+    lines_.push_back(line);
+    return static_cast<std::ptrdiff_t>(instructions_.size() - 1);
+  }
+
+  /**
+   * @brief Write a wide operand to the instructions, lowest byte first
+   * @param operand The operand to write, must be at most max_long_operand
+   * @param line The line this instruction in source
+   */
+  void write_long_operand(std::size_t operand, line_num line)
+  {
+    EML_ASSERT(operand <= max_long_operand, "Operand is too large");
+    for (std::ptrdiff_t i = 0; i < long_operand_size; ++i) {
+      write(static_cast<std::byte>(operand >> (8 * i)), line);
+    }
   }
 
   /**
@@ -106,7 +347,37 @@ struct Bytecode {
    */
   void write_at(std::byte code, std::ptrdiff_t index)
   {
-    instructions[static_cast<std::size_t>(index)] = code;
+    drop_derived();
+    instructions_[static_cast<std::size_t>(index)] = code;
+  }
+
+  /**
+   * @brief Write a wide operand to the instructions at a certain index
+   * @param operand The operand to write, must be at most max_long_operand
+   * @param index The place of the first byte of the operand
+   */
+  void write_long_operand_at(std::size_t operand, std::ptrdiff_t index)
+  {
+    EML_ASSERT(operand <= max_long_operand, "Operand is too large");
+    for (std::ptrdiff_t i = 0; i < long_operand_size; ++i) {
+      write_at(static_cast<std::byte>(operand >> (8 * i)), index + i);
+    }
+  }
+
+  /**
+   * @brief Inserts count zero bytes before the instruction at index
+   *
+   * Relative jump offsets are not adjusted, so the inserted bytes must not
+   * be in between a jump that already got patched and its target.
+   */
+  void insert_bytes(std::ptrdiff_t index, std::ptrdiff_t count)
+  {
+    drop_derived();
+    const auto line = lines_[static_cast<std::size_t>(index - 1)];
+    instructions_.insert(instructions_.begin() + index,
+                         static_cast<std::size_t>(count), std::byte{});
+    lines_.insert(lines_.begin() + index, static_cast<std::size_t>(count),
+                  line);
   }
 
   /**
@@ -114,41 +385,189 @@ struct Bytecode {
    */
   auto next_instruction_index() noexcept -> std::ptrdiff_t
   {
-    return static_cast<std::ptrdiff_t>(instructions.size());
+    return static_cast<std::ptrdiff_t>(instructions_.size());
   }
 
   /**
    * @brief Adds a constant value v to the chunk and returns its index
    *
    * Adds a constant value v to the chunk. Returns the index where it was
-   * appended so that we can locate that same constant later.
+   * appended so that we can locate that same constant later. The index needs
+   * a wide operand if it is larger than max_short_operand, and the chunk is
+   * full after max_long_operand constants.
+   *
+   * A constant that is already in the chunk is not appended again, and its
+   * existing index is returned instead, see ConstantIndex.
    */
-  [[nodiscard]] std::optional<opcode_num_type> add_constant(Value v)
+  [[nodiscard]] auto add_constant(Value v) -> std::optional<std::size_t>
   {
-    if (constants.size() >= std::numeric_limits<opcode_num_type>::max()) {
+    if (const auto index = constant_index_.find(v); index) {
+      return index;
+    }
+    if (constants_.size() > max_long_operand) {
       return {};
     }
-    constants.push_back(v);
-    return static_cast<opcode_num_type>(constants.size() - 1);
+    drop_derived();
+    constants_.push_back(v);
+    pin(v);
+    constant_index_.insert(v, constants_.size() - 1);
+    return constants_.size() - 1;
+  }
+
+  /**
+   * @brief Removes every instruction, and keeps the constants
+   */
+  void clear_instructions() noexcept
+  {
+    drop_derived();
+    instructions_.clear();
+    lines_.clear();
+  }
+
+  /// @brief Returns the instructions
+  [[nodiscard]] auto instructions() const noexcept
+      -> const std::vector<std::byte>&
+  {
+    return instructions_;
+  }
+
+  /// @brief Returns the constant pool
+  [[nodiscard]] auto constants() const noexcept -> const std::vector<Value>&
+  {
+    return constants_;
+  }
+
+  /// @brief Returns the source line of each byte of the instructions
+  [[nodiscard]] auto lines() const noexcept -> const std::vector<line_num>&
+  {
+    return lines_;
   }
 
   auto disassemble() const -> std::string;
 
+  /// @brief Returns the instructions of the chunk in order
+  [[nodiscard]] auto decode() const -> std::vector<DecodedInstruction>;
+
   friend std::ostream& operator<<(std::ostream& os, const Bytecode& bytecode);
 
 private:
+  std::vector<std::byte> instructions_; // Instructions
+  std::vector<Value> constants_;
+  std::vector<line_num> lines_; // Source line information
+  ConstantIndex constant_index_;
+  // The forms of the chunk that the vm derived from it, which refer to the
+  // chunk. The vm loads and stores the pointers atomically.
+  mutable std::shared_ptr<const PreparedBytecode> prepared_;
+  // Empty if the chunk has not been translated, and holds nullopt if the jit
+  // does not support it
+  mutable std::shared_ptr<const std::optional<NativeCode>> native_;
+
+  void drop_derived() noexcept
+  {
+    prepared_.reset();
+    native_.reset();
+  }
+
   friend VM;
-  using instruction_iterator = decltype(instructions)::const_iterator;
+  friend PreparedBytecode;
+  using instruction_iterator = decltype(instructions_)::const_iterator;
   auto read_constant(const instruction_iterator& ip) const -> Value
   {
     const auto index = static_cast<std::underlying_type_t<opcode>>(*ip);
-    return constants.at(index);
+    return constants_.at(index);
+  }
+
+  // Reads a wide operand starts from ip
+  static auto read_long_operand(const instruction_iterator& ip) -> std::size_t
+  {
+    std::size_t operand = 0;
+    for (std::ptrdiff_t i = 0; i < long_operand_size; ++i) {
+      operand |= std::to_integer<std::size_t>(*(ip + i)) << (8 * i);
+    }
+    return operand;
   }
 
   auto disassemble_instruction(instruction_iterator ip,
                                std::size_t offset) const -> std::string;
 };
 
+/**
+ * @brief An instruction of a PreparedBytecode, whose operand is decoded
+ */
+struct PreparedInstruction {
+  opcode op;
+  union {
+    /// The index of the instruction that a jump goes to
+    std::uint32_t target = 0;
+    /// The slot of the global that a global instruction reads or writes
+    std::uint32_t slot;
+  };
+  /// The operand of an instruction that reads the constant pool
+  Value constant{};
+};
+
+/**
+ * @brief Bytecode lowered into an array of fixed width instructions
+ *
+ * Preparing decodes every instruction once, so that the vm does not do it on
+ * every execution. Constant indices get resolved to the constants, and jump
+ * offsets to the indices of their target instructions. Global slots stay
+ * indices, since the values in them change between runs. Wide operand variants
+ * become their single byte operand counterparts, since the operands no longer
+ * need to fit in the byte stream. Preparing also follows the stack effects of
+ * the instructions along every path to find the maximum stack depth, which the
+ * vm sizes its stack by.
+ *
+ * A chunk that runs many times should be prepared once and passed to
+ * VM::interpret as the prepared bytecode.
+ */
+class PreparedBytecode {
+public:
+  /**
+   * @brief Prepares code for execution
+   *
+   * The prepared bytecode refers to code, whose constant pool keeps the
+   * objects of the constants alive, so code must outlive it.
+   */
+  explicit PreparedBytecode(const Bytecode& code);
+  explicit PreparedBytecode(Bytecode&& code) = delete;
+
+  /// @brief Returns the decoded instructions
+  [[nodiscard]] auto instructions() const noexcept
+      -> const std::vector<PreparedInstruction>&
+  {
+    return instructions_;
+  }
+
+  /// @brief Returns the bytecode that got prepared
+  [[nodiscard]] auto bytecode() const noexcept -> const Bytecode&
+  {
+    return code_;
+  }
+
+  /// @brief Returns the maximum number of values the code has on the stack
+  [[nodiscard]] auto max_stack_depth() const noexcept -> std::size_t
+  {
+    return max_stack_depth_;
+  }
+
+private:
+  std::reference_wrapper<const Bytecode> code_;
+  std::vector<PreparedInstruction> instructions_;
+  std::size_t max_stack_depth_ = 0;
+};
+
+/**
+ * @brief Rewrites short instruction sequences of code into cheaper ones
+ *
+ * Removes pairs that cancel out, such as two negations or a push of true
+ * followed by a jump if false, fuses a not followed by a conditional jump into
+ * the opposite jump, and makes jumps to unconditional jumps go to their final
+ * targets directly. The jump offsets and line table get rewritten to match.
+ * The stack depth of code stays an upper bound.
+ */
+void peephole_optimize(Bytecode& code);
+
 } // namespace eml
 
 #endif // EML_BYTECODE_HPP
@@ -1,6 +1,9 @@
 #include <algorithm>
+#include <fstream>
 #include <iostream>
+#include <sstream>
 #include <string>
+#include <string_view>
 
 #include "eml.hpp"
 
@@ -55,10 +58,57 @@ void repl()
   }
 }
 
-int main(int argc, char** /*argv*/)
+// Compiles the source file into a C++ function, which gets written to the
+// output file or the standard output
+auto emit_cpp(const char* source_file, const char* function_name,
+              const char* output_file, eml::OptimizationLevel level) -> int
+{
+  std::ifstream input{source_file};
+  if (!input) {
+    std::clog << "Cannot open " << source_file << '\n';
+    return 1;
+  }
+  std::stringstream source;
+  source << input.rdbuf();
+
+  eml::GarbageCollector gc{};
+  eml::Compiler compiler{
+      gc, eml::CompilerConfig{eml::SameScopeShadowing::warning, level}};
+  const auto result = compiler.compile_to_cpp(source.str(), function_name);
+  if (!result) {
+    for (const auto& e : result.error()) {
+      std::clog << eml::to_string(e);
+    }
+    return 1;
+  }
+
+  if (output_file == nullptr) {
+    std::cout << *result;
+    return 0;
+  }
+  std::ofstream output{output_file};
+  output << *result;
+  return output ? 0 : 1;
+}
+
+int main(int argc, char** argv)
 {
   if (argc < 2) {
     repl();
+  } else if (std::string_view{argv[1]} == "--emit-cpp") {
+    // -O0 keeps the constant expressions, which the compiler folds by default
+    const bool fold = argc < 3 || std::string_view{argv[2]} != "-O0";
+    const auto level =
+        fold ? eml::OptimizationLevel::full : eml::OptimizationLevel::none;
+    const int first = fold ? 2 : 3;
+    if (argc - first < 2 || argc - first > 3) {
+      std::clog << "Usage: " << argv[0]
+                << " --emit-cpp [-O0] <source file> <function name> [output "
+                   "file]\n";
+      return 1;
+    }
+    return emit_cpp(argv[first], argv[first + 1],
+                    argc - first == 3 ? argv[first + 2] : nullptr, level);
   } else {
     std::cout << "Read file!\n";
   }
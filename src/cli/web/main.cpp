@@ -10,7 +10,7 @@
 static eml::GarbageCollector gc;
 static eml::CompilerConfig config{eml::SameScopeShadowing::allow};
 static eml::Compiler compiler(gc, config);
-static eml::VM vm;
+static eml::VM vm{gc};
 
 static std::string cache;
 
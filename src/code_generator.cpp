@@ -7,6 +7,29 @@ namespace {
 
 struct CodeGenerator;
 
+// The fused compare and branch instructions that jump if a comparison is
+// false, indexed by ComparisonOp
+constexpr opcode jumps_unless[] = {
+    op_jmp_if_not_equal,
+    op_jmp_if_equal,
+    op_jmp_if_not_less_f64,
+    op_jmp_if_not_less_equal_f64,
+    op_jmp_if_not_greater_f64,
+    op_jmp_if_not_greater_equal_f64,
+};
+
+// Returns the value of expr if the code generator pushes it from the constant
+// pool, or nullopt otherwise. Identifiers are read from the slots of their
+// globals instead.
+auto constant_of(const Expr& expr) -> std::optional<Value>
+{
+  if (const auto* literal = dynamic_cast<const LiteralExpr*>(&expr);
+      literal != nullptr) {
+    return literal->value();
+  }
+  return std::nullopt;
+}
+
 // Emit different push instructions depends on they of an expression
 struct TypeDispatcher {
   CodeGenerator& generator;
@@ -21,29 +44,167 @@ struct TypeDispatcher {
   void operator()(const StringType& /*t*/);
 
   [[noreturn]] void operator()(const ErrorType& /*t*/);
+
+  [[noreturn]] void operator()(const FunctionType& /*t*/);
 };
 
 struct CodeGenerator : AstConstVisitor {
-  friend TypeDispatcher;
+  CodeGenerator(Bytecode& chunk, const std::shared_ptr<Module>& module)
+      : chunk_{chunk}, module_{module}
+  {
+  }
+
+  // Emits a push of the value v of type t
+  void emit_value(Value v, const Type& t)
+  {
+    TypeDispatcher visitor{*this, v};
+    std::visit(visitor, t.structure());
+  }
+
+  // Emits a binary operation on numbers, after the lhs, whose right operand is
+  // the constant rhs. If the index of rhs fits in a byte, emits op_k, which
+  // reads it from the constant pool instead of the stack.
+  void emit_constant_operand(opcode op, opcode op_k, Value rhs)
+  {
+    const auto offset = add_constant(rhs);
+    if (offset <= max_short_operand) {
+      chunk_.write(op_k, line_num{0});
+      chunk_.write(static_cast<std::byte>(offset), line_num{0});
+    } else {
+      emit_push(offset);
+      chunk_.write(op, line_num{0});
+    }
+  }
+
+  // Emits an if expression. emit_cond emits the condition and the jump to the
+  // else branch, and returns the index of its placeholder.
+  template <typename EmitCond, typename EmitIf, typename EmitElse>
+  void emit_branch(EmitCond emit_cond, EmitIf emit_if, EmitElse emit_else)
+  {
+    const auto else_jump_pos = emit_cond();
+    const auto branch_stack_height = chunk_.stack_height;
+
+    emit_if();
+
+    auto if_jump_pos = write_jump(eml::op_jmp, line_num{0});
+
+    if_jump_pos += jump_patch(else_jump_pos);
+
+    // Only one of the branches runs, so both start from the same height
+    chunk_.stack_height = branch_stack_height;
+    emit_else();
+
+    if (jump_patch(if_jump_pos) != 0) {
+      // Widening the jump over the else branch moved the start of it
+      patch_jump(else_jump_pos, if_jump_pos + long_operand_size);
+    }
+  }
+
+  // Emits [instruction] followed by a placeholder for a jump offset. The
+  // placeholder can be patched by calling [jumpPatch]. Returns the index of the
+  // placeholder.
+  auto write_jump(eml::opcode jump_instruction, line_num linum)
+      -> std::ptrdiff_t
+  {
+    chunk_.write(jump_instruction, linum);
+    const auto jump = chunk_.write(std::byte{}, linum);
+    return jump;
+  }
+
+  // Replaces the placeholder argument for a previous jump
+  // instruction with an offset that jumps to the current end of bytecode.
+  // Returns the number of bytes inserted after the placeholder, see
+  // [patch_jump].
+  auto jump_patch(std::ptrdiff_t index) -> std::ptrdiff_t
+  {
+    return patch_jump(index, chunk_.next_instruction_index());
+  }
+
+  // Sets the argument of the jump instruction whose argument starts at index
+  // to an offset that jumps to jump_to. If the offset does not fit in a byte,
+  // the jump is widened to its long variant in place. Returns the number of
+  // bytes inserted after the argument, which shifts every later position by
+  // that amount.
+  auto patch_jump(std::ptrdiff_t index, std::ptrdiff_t jump_to)
+      -> std::ptrdiff_t
+  {
+    const auto jump_instruction = static_cast<opcode>(
+        chunk_.instructions()[static_cast<std::size_t>(index - 1)]);
+    const auto is_long = instruction_size(jump_instruction) > 2;
+
+    // The offset is relative to the last byte of the argument
+    const auto argument_end = index + (is_long ? long_operand_size : 1);
+    const auto jump_by = static_cast<std::size_t>(jump_to - argument_end);
+    if (!is_long && jump_by <= max_short_operand) {
+      chunk_.write_at(static_cast<std::byte>(jump_by), index);
+      return 0;
+    }
+
+    std::ptrdiff_t inserted = 0;
+    if (!is_long) {
+      chunk_.write_at(std::byte{long_jump_of(jump_instruction)}, index - 1);
+      inserted = long_operand_size - 1;
+      // Everything after the argument moves, including the target, so the
+      // offset stays the same
+      chunk_.insert_bytes(index + 1, inserted);
+    }
+    chunk_.write_long_operand_at(jump_by, index);
+    return inserted;
+  }
 
-  explicit CodeGenerator(Bytecode& chunk, const Compiler& compiler)
-      : chunk_{chunk}, compiler_{compiler}
+  // Adds v to the constant pool and returns its index
+  auto add_constant(Value v) -> std::size_t
   {
+    const auto offset = chunk_.add_constant(v);
+    EML_ASSERT(offset != std::nullopt, "Too many constants in one chunk");
+    return *offset;
+  }
+
+  // Emits a push of the constant with index offset, with a wide operand if
+  // needed
+  void emit_push(std::size_t offset)
+  {
+    if (offset <= max_short_operand) {
+      chunk_.write(eml::op_push_f64, line_num{0});
+      chunk_.write(static_cast<std::byte>(offset), line_num{0});
+    } else {
+      chunk_.write(eml::op_push_f64_long, line_num{0});
+      chunk_.write_long_operand(offset, line_num{0});
+    }
+  }
+
+  // Emits a push of the constant v
+  void emit_constant(Value v)
+  {
+    emit_push(add_constant(v));
+  }
+
+  // Emits op, or op_long if the slot does not fit in a byte, on the slot of the
+  // global of identifier. Links the chunk to the module of the slot.
+  void emit_global(opcode op, opcode op_long, Symbol identifier)
+  {
+    const auto binding = module_->find(identifier);
+    EML_ASSERT(binding.has_value(),
+               "Identifiers passed to the code generator are garanteed to be "
+               "bound");
+    chunk_.globals.use(module_, *binding);
+    if (binding->slot <= max_short_operand) {
+      chunk_.write(op, line_num{0});
+      chunk_.write(static_cast<std::byte>(binding->slot), line_num{0});
+    } else {
+      chunk_.write(op_long, line_num{0});
+      chunk_.write_long_operand(binding->slot, line_num{0});
+    }
   }
 
   void operator()(const LiteralExpr& constant) override
   {
-    TypeDispatcher visitor{*this, constant.value()};
-    std::visit(visitor, constant.type());
+    emit_value(constant.value(), constant.type());
   }
 
-  void operator()([[maybe_unused]] const IdentifierExpr& id) override
+  void operator()(const IdentifierExpr& id) override
   {
-    EML_ASSERT(id.value() != std::nullopt,
-               "Identifier expression passed to the code generator are "
-               "garanteed to have a value");
-    TypeDispatcher visitor{*this, *id.value()};
-    std::visit(visitor, id.type());
+    emit_global(op_get_global, op_get_global_long, id.symbol());
   }
 
   void unary_common(const UnaryOpExpr& expr, opcode op)
@@ -69,21 +230,34 @@ struct CodeGenerator : AstConstVisitor {
     chunk_.write(op, line_num{0});
   }
 
+  // Emits a binary operation on numbers, see emit_constant_operand
+  void arithmetic_common(const BinaryOpExpr& expr, opcode op, opcode op_k)
+  {
+    const auto rhs = constant_of(expr.rhs());
+    if (!rhs) {
+      binary_common(expr, op);
+      return;
+    }
+
+    expr.lhs().accept(*this);
+    emit_constant_operand(op, op_k, *rhs);
+  }
+
   void operator()(const PlusOpExpr& expr) override
   {
-    binary_common(expr, op_add_f64);
+    arithmetic_common(expr, op_add_f64, op_add_f64_k);
   }
   void operator()(const MinusOpExpr& expr) override
   {
-    binary_common(expr, op_subtract_f64);
+    arithmetic_common(expr, op_subtract_f64, op_subtract_f64_k);
   }
   void operator()(const MultOpExpr& expr) override
   {
-    binary_common(expr, op_multiply_f64);
+    arithmetic_common(expr, op_multiply_f64, op_multiply_f64_k);
   }
   void operator()(const DivOpExpr& expr) override
   {
-    binary_common(expr, op_divide_f64);
+    arithmetic_common(expr, op_divide_f64, op_divide_f64_k);
   }
 
   void operator()(const AppendOpExpr& expr) override
@@ -101,19 +275,19 @@ struct CodeGenerator : AstConstVisitor {
   }
   void operator()(const LessOpExpr& expr) override
   {
-    binary_common(expr, op_less_f64);
+    arithmetic_common(expr, op_less_f64, op_less_f64_k);
   }
   void operator()(const LeOpExpr& expr) override
   {
-    binary_common(expr, op_less_equal_f64);
+    arithmetic_common(expr, op_less_equal_f64, op_less_equal_f64_k);
   }
   void operator()(const GreaterOpExpr& expr) override
   {
-    binary_common(expr, op_greater_f64);
+    arithmetic_common(expr, op_greater_f64, op_greater_f64_k);
   }
   void operator()(const GeExpr& expr) override
   {
-    binary_common(expr, op_greater_equal_f64);
+    arithmetic_common(expr, op_greater_equal_f64, op_greater_equal_f64_k);
   }
 
   void operator()(const LambdaExpr& /*expr*/) override
@@ -121,25 +295,6 @@ struct CodeGenerator : AstConstVisitor {
     throw "TODO";
   }
 
-  // Emits [instruction] followed by a placeholder for a jump offset. The
-  // placeholder can be patched by calling [jumpPatch]. Returns the index of the
-  // placeholder.
-  auto write_jump(eml::opcode jump_instruction, line_num linum)
-      -> std::ptrdiff_t
-  {
-    chunk_.write(jump_instruction, linum);
-    const auto jump = chunk_.write(std::byte{}, linum);
-    return jump;
-  }
-
-  // Replaces the placeholder argument for a previous jump
-  // instruction with an offset that jumps to the current end of bytecode.
-  void jump_patch(std::ptrdiff_t index)
-  {
-    const auto jump_to = chunk_.next_instruction_index();
-    chunk_.write_at(static_cast<std::byte>(jump_to - index - 1), index);
-  }
-
   void operator()(const IfExpr& expr) override
   {
     EML_ASSERT(eml::match(expr.cond().type(), BoolType{}),
@@ -147,40 +302,45 @@ struct CodeGenerator : AstConstVisitor {
     EML_ASSERT(eml::match(expr.If().type(), expr.Else().type()),
                "Type of different branches must match");
 
-    expr.cond().accept(*this);
-    const auto else_jump_pos = write_jump(eml::op_jmp_false, line_num{0});
-
-    expr.If().accept(*this);
-
-    const auto if_jump_pos = write_jump(eml::op_jmp, line_num{0});
-
-    jump_patch(else_jump_pos);
-
-    expr.Else().accept(*this);
-
-    jump_patch(if_jump_pos);
+    emit_branch(
+        [&]() {
+          // A comparison branches directly, instead of pushing a boolean for
+          // op_jmp_false to pop
+          if (const auto op = comparison_of(expr.cond()); op) {
+            const auto& comparison =
+                static_cast<const BinaryOpExpr&>(expr.cond());
+            comparison.lhs().accept(*this);
+            comparison.rhs().accept(*this);
+            return write_jump(jumps_unless[static_cast<std::size_t>(*op)],
+                              line_num{0});
+          }
+          expr.cond().accept(*this);
+          return write_jump(eml::op_jmp_false, line_num{0});
+        },
+        [&]() { expr.If().accept(*this); },
+        [&]() { expr.Else().accept(*this); });
   }
 
-  void operator()(const Definition& /*def*/) override {} // no-op
+  // The value of a definition is already folded, and gets stored again when the
+  // chunk runs, so running it restores the global
+  void operator()(const Definition& def) override
+  {
+    def.to().accept(*this);
+    emit_global(op_set_global, op_set_global_long, def.symbol());
+  }
 
   Bytecode& chunk_; // Not null
-  const Compiler& compiler_;
+  const std::shared_ptr<Module>& module_;
 };
 
 void TypeDispatcher::operator()(const NumberType&)
 {
-  const auto offset = generator.chunk_.add_constant(v);
-
-  generator.chunk_.write(eml::op_push_f64, line_num{0});
-  generator.chunk_.write(std::byte{*offset}, line_num{0});
+  generator.emit_constant(v);
 }
 
 void TypeDispatcher::operator()(const StringType&)
 {
-  const auto offset = generator.chunk_.add_constant(v);
-
-  generator.chunk_.write(eml::op_push_f64, line_num{0});
-  generator.chunk_.write(std::byte{*offset}, line_num{0});
+  generator.emit_constant(v);
 }
 
 void TypeDispatcher::operator()(const BoolType&)
@@ -202,13 +362,19 @@ void TypeDispatcher::operator()(const ErrorType& /*t*/)
   EML_UNREACHABLE();
 }
 
+// Functions are not implemented yet
+void TypeDispatcher::operator()(const FunctionType& /*t*/)
+{
+  EML_UNREACHABLE();
+}
+
 } // anonymous namespace
 
-auto Compiler::generate_code(const AstNode& expr) const
+auto Compiler::generate_code(const AstNode& expr)
     -> std::tuple<Bytecode, Type>
 {
   Bytecode code;
-  CodeGenerator code_generator{code, *this};
+  CodeGenerator code_generator{code, module_};
   expr.accept(code_generator);
   return std::tuple(code, expr.type());
 }
@@ -31,6 +31,18 @@ struct BuildOptions {
 #else
   constexpr static bool debug_print_ast = false;
 #endif
+
+#ifdef EML_NAN_BOXING
+  constexpr static bool nan_boxing = true;
+#else
+  constexpr static bool nan_boxing = false;
+#endif
+
+#ifdef EML_JIT
+  constexpr static bool jit = true;
+#else
+  constexpr static bool jit = false;
+#endif
 };
 static constexpr BuildOptions build_options;
 
@@ -1,8 +1,10 @@
 #ifndef EML_COMPILER_HPP
 #define EML_COMPILER_HPP
 
+#include <memory>
+#include <optional>
+#include <string>
 #include <string_view>
-#include <unordered_map>
 #include <vector>
 
 #include "bytecode.hpp"
@@ -10,6 +12,8 @@
 #include "expected.hpp"
 #include "memory.hpp"
 #include "module.hpp"
+#include "register_bytecode.hpp"
+#include "symbol.hpp"
 #include "type.hpp"
 #include "value.hpp"
 
@@ -22,23 +26,67 @@
 
 namespace eml {
 
+struct Expr;
+
+/**
+ * @brief How much the compiler optimizes the code it generates
+ *
+ * Global definitions always get folded, since their values must be known at
+ * compile time. Unless the configuration inlines globals, both backends of the
+ * vm read the other uses of globals from their slots instead of folding them,
+ * so that the code stays valid when they change, and C++ code cannot use them,
+ * see CompilerConfig::inline_globals.
+ */
+enum class OptimizationLevel {
+  none,     ///< @brief Generates code for every expression as written
+  peephole, ///< @brief Runs the peephole optimizer over the bytecode
+  full,     ///< @brief Also folds constant expressions before generating code
+};
+
+/**
+ * @brief Which instruction set of the vm the compiler generates code for
+ */
+enum class Backend {
+  stack,     ///< @brief Stack based bytecode, see Bytecode
+  registers, ///< @brief Three-address register code, see RegisterBytecode
+};
+
 /**
  * @brief Runtime configurations that decides how the eml compiler should behave
  */
 struct CompilerConfig {
   SameScopeShadowing shadowing_policy = SameScopeShadowing::warning;
+  OptimizationLevel optimization_level = OptimizationLevel::full;
+  Backend backend = Backend::stack;
+  /**
+   * @brief Whether the full optimization folds identifiers into the current
+   * values of their globals
+   *
+   * Expressions over globals then fold like expressions over literals. The
+   * code of the vm is stale once one of the globals it inlined gets
+   * redefined, see StaleCodeError, but does not see the writes of definitions
+   * that run after it got compiled. C++ code keeps the inlined values.
+   */
+  bool inline_globals = false;
 };
 
 /**
  * @brief The compiler for the EML
  * This class provides the API for the EML frontend.
+ *
+ * The values of global definitions live in the module of the compiler, see
+ * Module.
  */
 class Compiler {
 public:
-  using TypeCheckResult =
-      expected<std::unique_ptr<AstNode>, std::vector<CompilationError>>;
+  using TypeCheckResult = expected<Ast, std::vector<CompilationError>>;
   using CompileResult =
       expected<std::tuple<Bytecode, Type>, std::vector<CompilationError>>;
+  using ProgramResult =
+      expected<std::tuple<Program, Type>, std::vector<CompilationError>>;
+  using RegisterCodeResult = expected<std::tuple<RegisterBytecode, Type>,
+                                      std::vector<CompilationError>>;
+  using CppResult = expected<std::string, std::vector<CompilationError>>;
 
   /**
    * @brief Constructs a compiler object
@@ -46,14 +94,27 @@ public:
    * @arg options Runtime configuration of the compiler. If unprovided, have
    * sensible defaults
    */
-  explicit Compiler(GarbageCollector& gc, CompilerConfig options = {}) noexcept
-      : options_{options}, garbage_collector_{gc}
+  explicit Compiler(GarbageCollector& gc, CompilerConfig options = {})
+      : options_{options}, garbage_collector_{gc},
+        module_{std::make_shared<Module>("main", gc)}
   {
   }
 
+  Compiler(const Compiler&) = delete;
+  auto operator=(const Compiler&) -> Compiler& = delete;
+  Compiler(Compiler&&) = delete;
+  auto operator=(Compiler&&) -> Compiler& = delete;
+
   /**
    * @brief compiles the source into bytecode
    *
+   * The code is always stack bytecode, whatever the backend of the
+   * configuration is, see compile_program.
+   *
+   * The chunk is linked to the module of the compiler and keeps it alive, so
+   * the chunk can outlive the compiler, but not its garbage collector. The
+   * chunk is stale once a global it uses gets redefined with another type.
+   *
    * @return A bytecode chunk if the compilation process succeed, a vector of
    * errors otherwise
    */
@@ -61,47 +122,189 @@ public:
   {
     return eml::parse(src, garbage_collector_)
         .and_then([this](auto ast) { return type_check(ast); })
-        .map([this](const auto& ast) { return generate_code(*ast); });
+        .map([this](auto ast) {
+          ModuleLink inlined;
+          if (options_.optimization_level >= OptimizationLevel::full) {
+            inlined = optimize(ast);
+          }
+          auto result = generate_code(*ast);
+          std::get<0>(result).globals.merge(inlined);
+          if (options_.optimization_level >= OptimizationLevel::peephole) {
+            peephole_optimize(std::get<0>(result));
+          }
+          return result;
+        });
+  }
+
+  /**
+   * @brief compiles the source into code for the backend of the configuration
+   *
+   * The peephole optimizer only runs over stack bytecode.
+   *
+   * @return A program if the compilation process succeed, a vector of errors
+   * otherwise
+   */
+  auto compile_program(std::string_view src) -> ProgramResult
+  {
+    if (options_.backend == Backend::stack) {
+      return compile(src).map([](auto result) {
+        auto& [code, type] = result;
+        return std::tuple<Program, Type>{std::move(code), std::move(type)};
+      });
+    }
+
+    return eml::parse(src, garbage_collector_)
+        .and_then([this](auto ast) { return type_check(ast); })
+        .and_then([this](auto ast) {
+          ModuleLink inlined;
+          if (options_.optimization_level >= OptimizationLevel::full) {
+            inlined = optimize(ast);
+          }
+          return generate_register_code(*ast).map([&inlined](auto result) {
+            auto& [code, type] = result;
+            code.globals.merge(inlined);
+            return std::tuple<Program, Type>{std::move(code), std::move(type)};
+          });
+        });
+  }
+
+  /**
+   * @brief compiles the source into a C++ function, see generate_cpp
+   *
+   * @return The C++ source if the compilation process succeed, a vector of
+   * errors otherwise
+   */
+  auto compile_to_cpp(std::string_view src, std::string_view function_name)
+      -> CppResult
+  {
+    return eml::parse(src, garbage_collector_)
+        .and_then([this](auto ast) { return type_check(ast); })
+        .and_then([this, function_name](auto ast) {
+          if (options_.optimization_level >= OptimizationLevel::full) {
+            optimize(ast);
+          }
+          return generate_cpp(*ast, function_name);
+        });
   }
 
+  /**
+   * @brief Folds the constant expressions of a type checked ast
+   *
+   * Arithmetics, comparisons, `!` and string concatenations on constants become
+   * literals, and an if expression with a constant condition becomes the branch
+   * that it takes. Identifiers are constants only if the configuration inlines
+   * globals, otherwise the code reads their globals at run time.
+   *
+   * @return The slots of the globals that got inlined, which the code of the
+   * ast must be linked to, see ModuleLink::merge
+   */
+  auto optimize(Ast& ast) const -> ModuleLink;
+
+  /**
+   * @brief Folds the value of a global definition into a literal
+   *
+   * Unlike the overload for a whole ast, identifiers are constants of the
+   * current values of their globals, since the value of a definition must be
+   * known at compile time. The folded literals get created in arena.
+   */
+  void optimize(Expr_ptr& expr, Arena& arena) const;
+
   /**
    * @brief Compiles the AST Expr node expr into bytecode
+   *
+   * Identifiers read their globals from the slots of the module, and
+   * definitions write their values to them, so the chunk is linked to the
+   * module, see compile.
    */
-  auto generate_code(const eml::AstNode& expr) const
-      -> std::tuple<Bytecode, Type>;
+  auto generate_code(const eml::AstNode& expr) -> std::tuple<Bytecode, Type>;
 
   /**
-   * @brief  Adds a global constants to a byte code chunk
+   * @brief Compiles the AST node into code of the register backend
+   *
+   * Every expression gets a register for its value. The registers of the
+   * operands of an expression get reused once the expression is evaluated.
+   * Globals are read from and written to the slots of the module like in
+   * generate_code.
+   *
+   * @return The code, or a CodeGenerationError if the code needs more than
+   * max_register_count registers
+   */
+  auto generate_register_code(const eml::AstNode& node) const
+      -> RegisterCodeResult;
+
+  /**
+   * @brief Compiles the AST node into the source of a C++ function
+   *
+   * The function is `function_name(eml::GarbageCollector& gc)`, and returns a
+   * `double`, `bool` or `eml::GcPointer` for numbers, booleans and strings,
+   * and nothing for units and definitions. Numbers and booleans are C++
+   * locals, and strings get created through AotStrings. The function is inline,
+   * so the source can be a header.
+   *
+   * The function has no module, so reading a global is an error, unless the
+   * configuration inlines globals, see CompilerConfig::inline_globals.
+   *
+   * @return The C++ source, or a CodeGenerationError if function_name is not
+   * a valid C++ identifier or is reserved, such as a keyword or main, or the
+   * errors of the reads of globals
+   * @warning Like the result of the vm, a returned string is not a root of the
+   * garbage collector
    */
-  void add_global(const std::string& identifier, Type t, Value v)
+  auto generate_cpp(const eml::AstNode& node,
+                    std::string_view function_name) const -> CppResult;
+
+  /**
+   * @brief Binds a global to the value v of type t in the module
+   */
+  void add_global(Symbol identifier, Type t, Value v)
   {
-    auto query_result = constexpr_env_.find(identifier);
-    if (query_result != constexpr_env_.end()) { // Shadowing
-
-      if (options_.shadowing_policy == SameScopeShadowing::warning) {
-        std::clog << "Warning: Global value definition of " << identifier
-                  << " shadows earlier binding "
-                     "in the global scope\n";
-      }
-
-      constexpr_env_[identifier] = std::pair{std::move(t), std::move(v)};
-    } else {
-      constexpr_env_.emplace(identifier, std::pair{std::move(t), std::move(v)});
+    if (module_->find(identifier) &&
+        options_.shadowing_policy == SameScopeShadowing::warning) {
+      std::clog << "Warning: Global value definition of " << identifier.name()
+                << " shadows earlier binding "
+                   "in the global scope\n";
     }
+    module_->add_binding(identifier, t, v);
   }
 
   /**
    * @brief Gets the global value from the envirnment if it exist
+   * @return The type and the current value of the global, or nullopt
    */
-  [[nodiscard]] auto get_global(std::string_view identifier) const
-      -> std::optional<const std::pair<Type, Value>>
+  [[nodiscard]] auto get_global(Symbol identifier) const
+      -> std::optional<std::pair<Type, Value>>
   {
-    const auto pos = constexpr_env_.find(std::string{identifier});
-    if (pos != constexpr_env_.end()) {
-      return {pos->second};
-    } else {
+    const auto binding = module_->find(identifier);
+    if (!binding) {
       return {};
     }
+    return std::pair{binding->type, module_->value(binding->slot)};
+  }
+
+  /// @overload
+  [[nodiscard]] auto get_global(std::string_view identifier) const
+      -> std::optional<std::pair<Type, Value>>
+  {
+    const auto symbol = Symbol::find(identifier);
+    return symbol ? get_global(*symbol) : std::nullopt;
+  }
+
+  /**
+   * @brief Gets the module that holds the globals
+   *
+   * The stack bytecode of the compiler is linked to the module, and reads the
+   * globals from their slots when it runs. Setting the value of a slot updates
+   * the global for every chunk that uses it.
+   */
+  [[nodiscard]] auto module() noexcept -> Module&
+  {
+    return *module_;
+  }
+
+  /// @overload
+  [[nodiscard]] auto module() const noexcept -> const Module&
+  {
+    return *module_;
   }
 
   /**
@@ -110,14 +313,13 @@ public:
    * This function returns an ast that all nodes have types if successful, or a
    * vector of error if it find type errors
    */
-  auto type_check(std::unique_ptr<AstNode>& ptr) -> TypeCheckResult;
+  auto type_check(Ast& ast) -> TypeCheckResult;
 
 private:
   CompilerConfig options_;
   std::reference_wrapper<GarbageCollector> garbage_collector_;
 
-  std::unordered_map<std::string, std::pair<Type, Value>>
-      constexpr_env_; // Identifier to (type, value index) mapping for globals
+  std::shared_ptr<Module> module_; // Not null
 };
 
 } // namespace eml
@@ -0,0 +1,366 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "ast.hpp"
+#include "compiler.hpp"
+
+namespace eml {
+
+namespace {
+
+// The names that a function at namespace scope of the generated header cannot
+// have: the keywords and alternative tokens of C++, main, and the namespaces
+// that the header uses
+constexpr std::string_view reserved_names[] = {
+    "alignas", "alignof", "and", "and_eq", "asm", "auto", "bitand", "bitor",
+    "bool", "break", "case", "catch", "char", "char8_t", "char16_t", "char32_t",
+    "class", "co_await", "co_return", "co_yield", "compl", "concept", "const",
+    "const_cast", "consteval", "constexpr", "constinit", "continue", "decltype",
+    "default", "delete", "do", "double", "dynamic_cast", "else", "enum",
+    "explicit", "export", "extern", "false", "float", "for", "friend", "goto",
+    "if", "inline", "int", "long", "mutable", "namespace", "new", "noexcept",
+    "not", "not_eq", "nullptr", "operator", "or", "or_eq", "private",
+    "protected", "public", "register", "reinterpret_cast", "requires", "return",
+    "short", "signed", "sizeof", "static", "static_assert", "static_cast",
+    "struct", "switch", "template", "this", "thread_local", "throw", "true",
+    "try", "typedef", "typeid", "typename", "union", "unsigned", "using",
+    "virtual", "void", "volatile", "wchar_t", "while", "xor", "xor_eq", "main",
+    "eml", "std"};
+
+// Whether name can be the name of the generated function. Names with a double
+// underscore, or an underscore followed by a capital letter, are reserved for
+// the C++ implementation.
+auto is_function_name(std::string_view name) -> bool
+{
+  const auto is_letter = [](char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+  };
+  const auto is_digit = [](char c) { return c >= '0' && c <= '9'; };
+
+  if (name.empty() || !is_letter(name.front()) ||
+      !std::all_of(name.begin(), name.end(),
+                   [&](char c) { return is_letter(c) || is_digit(c); })) {
+    return false;
+  }
+  if (name.find("__") != std::string_view::npos ||
+      (name.size() > 1 && name[0] == '_' && name[1] >= 'A' && name[1] <= 'Z')) {
+    return false;
+  }
+  return std::find(std::begin(reserved_names), std::end(reserved_names),
+                   name) == std::end(reserved_names);
+}
+
+// Returns the C++ type of the values of type t
+auto cpp_type(const Type& t) -> std::string_view
+{
+  if (eml::match(t, NumberType{})) {
+    return "double";
+  }
+  if (eml::match(t, BoolType{})) {
+    return "bool";
+  }
+  if (eml::match(t, StringType{})) {
+    return "eml::GcPointer";
+  }
+  return "void";
+}
+
+// Returns the shortest C++ literal that is exactly the number v
+auto number_literal(double v) -> std::string
+{
+  if (std::isnan(v)) { // Keeps the sign that printing shows
+    return std::signbit(v) ? "-std::numeric_limits<double>::quiet_NaN()"
+                           : "std::numeric_limits<double>::quiet_NaN()";
+  }
+  if (std::isinf(v)) {
+    return v > 0 ? "std::numeric_limits<double>::infinity()"
+                 : "-std::numeric_limits<double>::infinity()";
+  }
+
+  char buffer[32];
+  for (int precision = 1;; ++precision) {
+    std::snprintf(buffer, sizeof(buffer), "%.*g", precision, v);
+    if (std::strtod(buffer, nullptr) == v || precision == 17) {
+      break;
+    }
+  }
+
+  std::string literal = buffer;
+  if (literal.find_first_of(".e") == std::string::npos) {
+    literal += ".0"; // So that -0 stays a negative zero
+  }
+  return literal;
+}
+
+// Returns the C++ string literal of text
+auto string_literal(const std::string& text) -> std::string
+{
+  std::string literal = "\"";
+  for (const auto c : text) {
+    const auto byte = static_cast<unsigned char>(c);
+    if (c == '"' || c == '\\') {
+      literal += '\\';
+      literal += c;
+    } else if (byte < 0x20 || byte >= 0x7f) {
+      // Octal escapes take at most three digits, unlike hexadecimal ones
+      char escape[8];
+      std::snprintf(escape, sizeof(escape), "\\%03o", byte);
+      literal += escape;
+    } else {
+      literal += c;
+    }
+  }
+  return literal + '"';
+}
+
+// Generates the statements of a C++ function. Every subexpression that is not
+// a constant gets a local, and the visit of an expression leaves the C++
+// expression of its value in result_. Units have no C++ value.
+struct CppCodeGenerator : AstConstVisitor {
+  std::stringstream body;
+  std::string result_;
+  int indentation = 1;
+  int local_count = 0;
+  bool uses_strings = false;
+  std::vector<CompilationError> errors;
+
+  auto generate(const Expr& expr) -> std::string
+  {
+    expr.accept(*this);
+    return result_;
+  }
+
+  auto indent() -> std::ostream&
+  {
+    return body << std::string(static_cast<std::size_t>(indentation) * 2, ' ');
+  }
+
+  // Stores the C++ expression value in a new local of type t
+  void define(const Type& t, const std::string& value)
+  {
+    result_ = 'v' + std::to_string(local_count++);
+    indent() << "const " << cpp_type(t) << ' ' << result_ << " = " << value
+             << ";\n";
+  }
+
+  void constant(const Type& t, Value v)
+  {
+    if (eml::match(t, NumberType{})) {
+      result_ = number_literal(v.unsafe_as_number());
+    } else if (eml::match(t, BoolType{})) {
+      result_ = v.unsafe_as_boolean() ? "true" : "false";
+    } else if (eml::match(t, StringType{})) {
+      uses_strings = true;
+      define(t, "strings.literal(" +
+                    string_literal(to_std_string(*v.unsafe_as_reference())) +
+                    ")");
+    } else {
+      result_.clear();
+    }
+  }
+
+  void operator()(const LiteralExpr& expr) override
+  {
+    constant(expr.type(), expr.value());
+  }
+
+  // The C++ function has no module to read the slots of globals from
+  void operator()(const IdentifierExpr& expr) override
+  {
+    std::stringstream ss;
+    ss << "Cannot read the global " << expr.name()
+       << " in C++ code, since its value is only known at run time\n";
+    errors.emplace_back(std::in_place_type<CodeGenerationError>, ss.str());
+    result_.clear();
+  }
+
+  void unary(const UnaryOpExpr& expr, std::string_view op)
+  {
+    auto operand = generate(expr.operand());
+    if (operand.front() == '-') { // Keeps `-` `-1` from becoming `--1`
+      operand = '(' + operand + ')';
+    }
+    define(expr.type(), std::string{op} + operand);
+  }
+
+  void operator()(const UnaryNegateExpr& expr) override
+  {
+    unary(expr, "-");
+  }
+
+  void operator()(const UnaryNotExpr& expr) override
+  {
+    unary(expr, "!");
+  }
+
+  void binary(const BinaryOpExpr& expr, std::string_view op)
+  {
+    const auto lhs = generate(expr.lhs());
+    const auto rhs = generate(expr.rhs());
+    define(expr.type(), lhs + ' ' + std::string{op} + ' ' + rhs);
+  }
+
+  void operator()(const PlusOpExpr& expr) override
+  {
+    binary(expr, "+");
+  }
+  void operator()(const MinusOpExpr& expr) override
+  {
+    binary(expr, "-");
+  }
+  void operator()(const MultOpExpr& expr) override
+  {
+    binary(expr, "*");
+  }
+  void operator()(const DivOpExpr& expr) override
+  {
+    binary(expr, "/");
+  }
+
+  void operator()(const AppendOpExpr& expr) override
+  {
+    uses_strings = true;
+    const auto lhs = generate(expr.lhs());
+    const auto rhs = generate(expr.rhs());
+    define(expr.type(), "strings.cat(" + lhs + ", " + rhs + ')');
+  }
+
+  void equality(const BinaryOpExpr& expr, bool negate)
+  {
+    const auto& operand_type = expr.lhs().type();
+    if (eml::match(operand_type, StringType{})) {
+      const auto lhs = generate(expr.lhs());
+      const auto rhs = generate(expr.rhs());
+      define(expr.type(), std::string{negate ? "!" : ""} +
+                              "eml::string_equal(*" + lhs + ", *" + rhs + ')');
+    } else if (eml::match(operand_type, UnitType{})) {
+      generate(expr.lhs());
+      generate(expr.rhs());
+      result_ = negate ? "false" : "true";
+    } else {
+      binary(expr, negate ? "!=" : "==");
+    }
+  }
+
+  void operator()(const EqOpExpr& expr) override
+  {
+    equality(expr, false);
+  }
+  void operator()(const NeqOpExpr& expr) override
+  {
+    equality(expr, true);
+  }
+  void operator()(const LessOpExpr& expr) override
+  {
+    binary(expr, "<");
+  }
+  void operator()(const LeOpExpr& expr) override
+  {
+    binary(expr, "<=");
+  }
+  void operator()(const GreaterOpExpr& expr) override
+  {
+    binary(expr, ">");
+  }
+  void operator()(const GeExpr& expr) override
+  {
+    binary(expr, ">=");
+  }
+
+  void operator()(const LambdaExpr& /*expr*/) override
+  {
+    errors.emplace_back(std::in_place_type<CodeGenerationError>,
+                        "Functions cannot be compiled to C++\n");
+    result_.clear();
+  }
+
+  // Generates a branch of an if expression, whose value goes to the local
+  void branch(const Expr& expr, const std::string& local)
+  {
+    ++indentation;
+    const auto value = generate(expr);
+    if (eml::match(expr.type(), StringType{})) {
+      indent() << local << " = " << value << ".get();\n";
+    } else if (!local.empty()) {
+      indent() << local << " = " << value << ";\n";
+    }
+    --indentation;
+  }
+
+  void operator()(const IfExpr& expr) override
+  {
+    const auto cond = generate(expr.cond());
+
+    // A GcPointer cannot be null, so the local of a string is a raw pointer
+    // that both branches assign
+    const auto& type = expr.type();
+    const bool is_string = eml::match(type, StringType{});
+    std::string local;
+    if (!eml::match(type, UnitType{})) {
+      local = 'v' + std::to_string(local_count++);
+      indent() << (is_string ? "eml::Obj*" : cpp_type(type)) << ' ' << local
+               << "{};\n";
+    }
+
+    indent() << "if (" << cond << ") {\n";
+    branch(expr.If(), local);
+    indent() << "} else {\n";
+    branch(expr.Else(), local);
+    indent() << "}\n";
+
+    result_ = is_string ? "eml::GcPointer{" + local + '}' : local;
+  }
+
+  void operator()(const Definition& /*def*/) override {} // no-op
+};
+
+} // anonymous namespace
+
+auto Compiler::generate_cpp(const AstNode& node,
+                            std::string_view function_name) const
+    -> CppResult
+{
+  if (!is_function_name(function_name)) {
+    std::stringstream ss;
+    ss << "Cannot name the C++ function " << function_name
+       << ", since it is not a valid C++ identifier or is reserved\n";
+    return unexpected{std::vector<CompilationError>{
+        CompilationError{std::in_place_type<CodeGenerationError>, ss.str()}}};
+  }
+
+  CppCodeGenerator code_generator;
+  node.accept(code_generator);
+  if (!code_generator.errors.empty()) {
+    return unexpected{std::move(code_generator.errors)};
+  }
+
+  const auto& type = node.type();
+  const auto* expr = dynamic_cast<const Expr*>(&node);
+  const auto return_type =
+      expr != nullptr ? cpp_type(type) : std::string_view{"void"};
+
+  std::stringstream ss;
+  ss << "// Generated by eml --emit-cpp\n"
+     << "#include <limits>\n\n"
+     << "#include \"eml.hpp\"\n\n"
+     << "inline auto " << function_name
+     << "([[maybe_unused]] eml::GarbageCollector& gc) -> " << return_type
+     << "\n{\n";
+  if (code_generator.uses_strings) {
+    ss << "  eml::AotStrings strings{gc};\n";
+  }
+  ss << code_generator.body.str();
+  if (return_type != "void") {
+    ss << "  return " << code_generator.result_ << ";\n";
+  }
+  ss << "}\n";
+  return ss.str();
+}
+
+} // namespace eml
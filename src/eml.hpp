@@ -10,8 +10,10 @@
  * @brief This file provides the public api of EML
  */
 
+#include "aot.hpp"
 #include "compiler.hpp"
 #include "memory.hpp"
+#include "static_eval.hpp"
 #include "vm.hpp"
 
 /**
@@ -31,6 +31,11 @@ struct ErrorPrinter {
   {
     os_ << "Type Error: " << e.msg;
   }
+
+  void operator()(const CodeGenerationError& e)
+  {
+    os_ << "Code Generation Error: " << e.msg;
+  }
 };
 
 std::string to_string(const CompilationError& error)
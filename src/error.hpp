@@ -32,7 +32,16 @@ struct TypeError {
   explicit TypeError(std::string msg_in) : msg{std::move(msg_in)} {}
 };
 
-using CompilationError = std::variant<SyntaxError, TypeError>;
+/// @brief An error of a program that is valid, but exceeds a limit of the code
+/// generator
+struct CodeGenerationError {
+  std::string msg;
+
+  explicit CodeGenerationError(std::string msg_in) : msg{std::move(msg_in)} {}
+};
+
+using CompilationError =
+    std::variant<SyntaxError, TypeError, CodeGenerationError>;
 
 std::string to_string(const CompilationError& error);
 
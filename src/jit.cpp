@@ -0,0 +1,1030 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <initializer_list>
+#include <utility>
+#include <vector>
+
+#ifdef EML_JIT
+#include <sys/mman.h>
+#endif
+
+#include "jit.hpp"
+#include "string.hpp"
+
+namespace eml {
+
+NativeCode::NativeCode(NativeCode&& other) noexcept
+    : memory_{std::exchange(other.memory_, nullptr)},
+      size_{std::exchange(other.size_, 0)},
+      max_stack_depth_{other.max_stack_depth_},
+      result_depth_{other.result_depth_}, result_kind_{other.result_kind_},
+      globals_{std::move(other.globals_)}
+{
+}
+
+auto NativeCode::operator=(NativeCode&& other) noexcept -> NativeCode&
+{
+  std::swap(memory_, other.memory_);
+  std::swap(size_, other.size_);
+  max_stack_depth_ = other.max_stack_depth_;
+  result_depth_ = other.result_depth_;
+  result_kind_ = other.result_kind_;
+  std::swap(globals_, other.globals_);
+  return *this;
+}
+
+#ifdef EML_JIT
+
+NativeCode::~NativeCode()
+{
+  if (memory_ != nullptr) {
+    munmap(memory_, size_);
+  }
+}
+
+auto NativeCode::run(JitFrame& frame) const -> bool
+{
+  using Function = bool (*)(JitFrame*);
+  // Converting between object and function pointers is conditionally
+  // supported, but POSIX requires it to work
+  Function function = nullptr;
+  static_assert(sizeof(function) == sizeof(memory_));
+  std::memcpy(&function, &memory_, sizeof(function));
+  return function(&frame);
+}
+
+namespace {
+
+// General purpose registers
+constexpr int rax = 0;
+constexpr int r12 = 12;
+constexpr int r13 = 13;
+
+// The slots of the stack below this depth live in the xmm register of their
+// depth, the slots above in memory. The last two xmm registers are scratch.
+constexpr std::size_t register_slots = 14;
+constexpr int scratch0 = 14;
+constexpr int scratch1 = 15;
+
+// Condition codes, negating one flips its lowest bit
+constexpr std::uint8_t cc_ae = 0x3;
+constexpr std::uint8_t cc_e = 0x4;
+constexpr std::uint8_t cc_ne = 0x5;
+constexpr std::uint8_t cc_a = 0x7;
+constexpr std::uint8_t cc_p = 0xa;
+constexpr std::uint8_t cc_np = 0xb;
+
+// Opcodes of the scalar double arithmetics
+constexpr std::uint8_t sse_add = 0x58;
+constexpr std::uint8_t sse_mul = 0x59;
+constexpr std::uint8_t sse_sub = 0x5c;
+constexpr std::uint8_t sse_div = 0x5e;
+
+constexpr std::uint64_t one_bits = 0x3ff0000000000000;
+constexpr std::uint64_t sign_bit = 0x8000000000000000;
+
+// Encodes x86-64 instructions
+class Assembler {
+public:
+  [[nodiscard]] auto code() const noexcept -> const std::vector<std::uint8_t>&
+  {
+    return code_;
+  }
+
+  [[nodiscard]] auto offset() const noexcept -> std::size_t
+  {
+    return code_.size();
+  }
+
+  void byte(std::uint8_t b)
+  {
+    code_.push_back(b);
+  }
+
+  void bytes(std::initializer_list<std::uint8_t> bs)
+  {
+    code_.insert(code_.end(), bs);
+  }
+
+  void imm32(std::uint32_t v)
+  {
+    for (int i = 0; i < 4; ++i) {
+      byte(static_cast<std::uint8_t>(v >> (8 * i)));
+    }
+  }
+
+  void imm64(std::uint64_t v)
+  {
+    for (int i = 0; i < 8; ++i) {
+      byte(static_cast<std::uint8_t>(v >> (8 * i)));
+    }
+  }
+
+  // push rbx; push r12; push r13; mov rbx, rdi; mov r12, [rdi + slots];
+  // mov r13, [rdi + references]
+  void prologue()
+  {
+    bytes({0x53, 0x41, 0x54, 0x41, 0x55, 0x48, 0x89, 0xfb});
+    bytes({0x4c, 0x8b, 0xa7});
+    imm32(offsetof(JitFrame, slots));
+    bytes({0x4c, 0x8b, 0xaf});
+    imm32(offsetof(JitFrame, references));
+  }
+
+  // mov eax, result; pop r13; pop r12; pop rbx; ret
+  void epilogue(bool result)
+  {
+    byte(0xb8);
+    imm32(result ? 1 : 0);
+    bytes({0x41, 0x5d, 0x41, 0x5c, 0x5b, 0xc3});
+  }
+
+  // An SSE instruction between two xmm registers
+  void sse(std::uint8_t prefix, std::uint8_t op, int reg, int rm)
+  {
+    byte(prefix);
+    rex(false, reg, rm);
+    bytes({0x0f, op, modrm_direct(reg, rm)});
+  }
+
+  // An SSE instruction whose rm operand is [base + disp]
+  void sse_memory(std::uint8_t prefix, std::uint8_t op, int reg, int base,
+                  std::int32_t disp)
+  {
+    byte(prefix);
+    rex(false, reg, base);
+    bytes({0x0f, op});
+    modrm_memory(reg, base, disp);
+  }
+
+  void movsd(int dest, int src)
+  {
+    sse(0xf2, 0x10, dest, src);
+  }
+
+  void movsd_load(int dest, int base, std::int32_t disp)
+  {
+    sse_memory(0xf2, 0x10, dest, base, disp);
+  }
+
+  void movsd_store(int base, std::int32_t disp, int src)
+  {
+    sse_memory(0xf2, 0x11, src, base, disp);
+  }
+
+  // movq xmm, rax
+  void movq_from_rax(int xmm)
+  {
+    byte(0x66);
+    rex(true, xmm, rax);
+    bytes({0x0f, 0x6e, modrm_direct(xmm, rax)});
+  }
+
+  void mov_rax(std::uint64_t v)
+  {
+    bytes({0x48, 0xb8});
+    imm64(v);
+  }
+
+  // mov [base + disp], rax
+  void store_rax(int base, std::int32_t disp)
+  {
+    rex(true, rax, base);
+    byte(0x89);
+    modrm_memory(rax, base, disp);
+  }
+
+  // Loads the bits of a double into xmm
+  void load_bits(int xmm, std::uint64_t bits)
+  {
+    mov_rax(bits);
+    movq_from_rax(xmm);
+  }
+
+  // setcc al, or cl if second
+  void setcc(std::uint8_t cc, bool second = false)
+  {
+    bytes({0x0f, static_cast<std::uint8_t>(0x90 | cc),
+           static_cast<std::uint8_t>(second ? 0xc1 : 0xc0)});
+  }
+
+  // Converts al, which is 0 or 1, into a double in xmm
+  void bool_to_double(int xmm)
+  {
+    bytes({0x0f, 0xb6, 0xc0}); // movzx eax, al
+    byte(0xf2);                // cvtsi2sd xmm, eax
+    rex(false, xmm, rax);
+    bytes({0x0f, 0x2a, modrm_direct(xmm, rax)});
+  }
+
+  // Returns the position of the displacement to patch
+  auto jcc(std::uint8_t cc) -> std::size_t
+  {
+    bytes({0x0f, static_cast<std::uint8_t>(0x80 | cc)});
+    imm32(0);
+    return offset() - 4;
+  }
+
+  // Returns the position of the displacement to patch
+  auto jmp() -> std::size_t
+  {
+    byte(0xe9);
+    imm32(0);
+    return offset() - 4;
+  }
+
+  void patch(std::size_t at, std::size_t target)
+  {
+    const auto displacement = static_cast<std::uint32_t>(
+        static_cast<std::int64_t>(target) - static_cast<std::int64_t>(at + 4));
+    for (std::size_t i = 0; i < 4; ++i) {
+      code_[at + i] = static_cast<std::uint8_t>(displacement >> (8 * i));
+    }
+  }
+
+  // Calls function(frame, argument, second), with the frame in rbx
+  void call(std::uintptr_t function, std::uint32_t argument,
+            std::uint32_t second)
+  {
+    bytes({0x48, 0x89, 0xdf}); // mov rdi, rbx
+    byte(0xbe);                // mov esi, argument
+    imm32(argument);
+    byte(0xba); // mov edx, second
+    imm32(second);
+    mov_rax(function);
+    bytes({0xff, 0xd0}); // call rax
+  }
+
+private:
+  std::vector<std::uint8_t> code_;
+
+  void rex(bool wide, int reg, int rm)
+  {
+    const auto prefix = static_cast<std::uint8_t>(
+        0x40 | (wide ? 8 : 0) | (reg >= 8 ? 4 : 0) | (rm >= 8 ? 1 : 0));
+    if (prefix != 0x40) {
+      byte(prefix);
+    }
+  }
+
+  static auto modrm_direct(int reg, int rm) -> std::uint8_t
+  {
+    return static_cast<std::uint8_t>(0xc0 | (reg & 7) << 3 | (rm & 7));
+  }
+
+  // [base + disp32], base needs a SIB byte if it is rsp or r12
+  void modrm_memory(int reg, int base, std::int32_t disp)
+  {
+    byte(static_cast<std::uint8_t>(0x80 | (reg & 7) << 3 | (base & 7)));
+    if ((base & 7) == 4) {
+      byte(0x24);
+    }
+    imm32(static_cast<std::uint32_t>(disp));
+  }
+};
+
+// The helpers that native code calls for strings. They get the frame and the
+// depth of the left operand, whose slot receives the result.
+
+auto jit_string_cat(JitFrame* frame, std::uint32_t slot) noexcept -> bool
+{
+  try {
+    // Every reference is in the frame here, so young objects can move
+    auto& gc = *frame->gc;
+    gc.safepoint();
+
+    auto* operands = frame->references + slot;
+    operands[0] = Value{string_cat(operands[0].unsafe_as_reference(),
+                                   operands[1].unsafe_as_reference(), gc,
+                                   Generation::young)};
+    return true;
+  } catch (...) {
+    *frame->error = std::current_exception();
+    return false;
+  }
+}
+
+auto jit_references_equal(JitFrame* frame, std::uint32_t slot) noexcept -> bool
+{
+  return string_equal(frame->references[slot].unsafe_as_reference(),
+                      frame->references[slot + 1].unsafe_as_reference(),
+                      *frame->gc);
+}
+
+// The helpers that native code calls for globals. They get the frame, the
+// depth of the value to read into or to write from, and the slot of the global.
+
+template <JitValueKind kind>
+void jit_get_global(JitFrame* frame, std::uint32_t depth,
+                    std::uint32_t slot) noexcept
+{
+  const auto v = frame->globals[slot];
+  if constexpr (kind == JitValueKind::reference) {
+    frame->references[depth] = v;
+  } else if constexpr (kind == JitValueKind::number) {
+    frame->slots[depth] = v.unsafe_as_number();
+  } else if constexpr (kind == JitValueKind::boolean) {
+    frame->slots[depth] = v.unsafe_as_boolean() ? 1 : 0;
+  } else {
+    frame->slots[depth] = 0;
+  }
+}
+
+template <JitValueKind kind>
+auto jit_set_global(JitFrame* frame, std::uint32_t depth,
+                    std::uint32_t slot) noexcept -> bool
+{
+  try {
+    if constexpr (kind == JitValueKind::reference) {
+      // The global outlives the run, so it must not stay in the nursery
+      frame->globals[slot] = Value{frame->gc->tenure(
+          frame->references[depth].unsafe_as_reference())};
+    } else if constexpr (kind == JitValueKind::number) {
+      frame->globals[slot] = Value{frame->slots[depth]};
+    } else if constexpr (kind == JitValueKind::boolean) {
+      frame->globals[slot] = Value{frame->slots[depth] != 0};
+    } else {
+      frame->globals[slot] = Value{};
+    }
+    return true;
+  } catch (...) {
+    *frame->error = std::current_exception();
+    return false;
+  }
+}
+
+template <JitValueKind kind>
+auto global_helper_of(bool set) -> std::uintptr_t
+{
+  return set ? reinterpret_cast<std::uintptr_t>(&jit_set_global<kind>)
+             : reinterpret_cast<std::uintptr_t>(&jit_get_global<kind>);
+}
+
+// Returns jit_set_global if set, jit_get_global otherwise, for values of kind
+auto global_helper(JitValueKind kind, bool set) -> std::uintptr_t
+{
+  switch (kind) {
+  case JitValueKind::number:
+    return global_helper_of<JitValueKind::number>(set);
+  case JitValueKind::boolean:
+    return global_helper_of<JitValueKind::boolean>(set);
+  case JitValueKind::unit:
+    return global_helper_of<JitValueKind::unit>(set);
+  case JitValueKind::reference:
+    return global_helper_of<JitValueKind::reference>(set);
+  }
+  return 0; // Unreachable
+}
+
+// The comparisons of two numbers
+enum class Comparison { less, less_equal, greater, greater_equal };
+
+struct UnsupportedCode {};
+
+// Translates prepared bytecode into machine code, and throws UnsupportedCode
+// on code it cannot translate
+class JitCompiler {
+public:
+  explicit JitCompiler(const PreparedBytecode& code) : code_{code} {}
+
+  void compile()
+  {
+    const auto& instructions = code_.get().instructions();
+    const auto count = instructions.size();
+    states_.resize(count + 1);
+    labels_.resize(count + 1);
+
+    assembler_.prologue();
+    for (std::size_t i = 0; i < count; ++i) {
+      enter(i);
+      if (reachable_) {
+        translate(i, instructions[i]);
+      }
+    }
+    enter(count);
+    finish();
+
+    for (const auto& [at, target] : fixups_) {
+      assembler_.patch(at, labels_[target]);
+    }
+  }
+
+  [[nodiscard]] auto assembler() const noexcept -> const Assembler&
+  {
+    return assembler_;
+  }
+
+  [[nodiscard]] auto result_depth() const noexcept -> std::size_t
+  {
+    return stack_.size();
+  }
+
+  [[nodiscard]] auto result_kind() const noexcept -> JitValueKind
+  {
+    return stack_.empty() ? JitValueKind::unit : stack_.back();
+  }
+
+private:
+  std::reference_wrapper<const PreparedBytecode> code_;
+  Assembler assembler_;
+  std::vector<JitValueKind> stack_; // The kinds of the values on the stack
+  bool reachable_ = true;
+  // The stack at every jump target, and where the target starts in the code
+  std::vector<std::optional<std::vector<JitValueKind>>> states_;
+  std::vector<std::size_t> labels_;
+  // The jumps to patch, as the positions of their displacements and targets
+  std::vector<std::pair<std::size_t, std::size_t>> fixups_;
+  std::size_t error_jump_ = 0;
+  std::vector<std::size_t> error_fixups_;
+
+  static void require(bool condition)
+  {
+    if (!condition) {
+      throw UnsupportedCode{};
+    }
+  }
+
+  // Starts the instruction at index, which joins the stacks of the jumps to it
+  void enter(std::size_t index)
+  {
+    labels_[index] = assembler_.offset();
+    if (const auto& state = states_[index]; state) {
+      require(!reachable_ || *state == stack_);
+      stack_ = *state;
+      reachable_ = true;
+    }
+  }
+
+  void jump_to(std::size_t target, std::size_t at)
+  {
+    fixups_.emplace_back(at, target);
+    auto& state = states_[target];
+    if (state) {
+      require(*state == stack_);
+    } else {
+      state = stack_;
+    }
+  }
+
+  static auto disp(std::size_t depth) -> std::int32_t
+  {
+    return static_cast<std::int32_t>(depth * sizeof(double));
+  }
+
+  static auto reference_disp(std::size_t depth) -> std::int32_t
+  {
+    return static_cast<std::int32_t>(depth * sizeof(Value));
+  }
+
+  // Returns the register that holds the slot at depth, which gets loaded into
+  // scratch if the slot lives in memory
+  auto load(std::size_t depth, int scratch) -> int
+  {
+    if (depth < register_slots) {
+      return static_cast<int>(depth);
+    }
+    assembler_.movsd_load(scratch, r12, disp(depth));
+    return scratch;
+  }
+
+  // Writes the register xmm to the slot at depth
+  void store(std::size_t depth, int xmm)
+  {
+    if (depth >= register_slots) {
+      assembler_.movsd_store(r12, disp(depth), xmm);
+    } else if (xmm != static_cast<int>(depth)) {
+      assembler_.movsd(static_cast<int>(depth), xmm);
+    }
+  }
+
+  // Returns the register to compute the value of the slot at depth in
+  auto target_register(std::size_t depth) -> int
+  {
+    return depth < register_slots ? static_cast<int>(depth) : scratch0;
+  }
+
+  auto top_depth(std::size_t operands) -> std::size_t
+  {
+    require(stack_.size() >= operands);
+    return stack_.size() - operands;
+  }
+
+  void push(JitValueKind kind, std::uint64_t bits)
+  {
+    const auto depth = stack_.size();
+    require(depth < code_.get().max_stack_depth());
+    assembler_.mov_rax(bits);
+    if (depth < register_slots) {
+      assembler_.movq_from_rax(static_cast<int>(depth));
+    } else {
+      assembler_.store_rax(r12, disp(depth));
+    }
+    stack_.push_back(kind);
+  }
+
+  void push_constant(Value constant)
+  {
+    if (constant.is_number()) {
+      push(JitValueKind::number,
+           bit_cast<std::uint64_t>(constant.unsafe_as_number()));
+      return;
+    }
+    require(constant.is_reference());
+
+    // The reference is copied into its slot as the bytes of the Value
+    static_assert(std::is_trivially_copyable_v<Value> &&
+                  sizeof(Value) % sizeof(std::uint64_t) == 0);
+    const auto depth = stack_.size();
+    require(depth < code_.get().max_stack_depth());
+    for (std::size_t i = 0; i < sizeof(Value) / sizeof(std::uint64_t); ++i) {
+      std::uint64_t chunk = 0;
+      std::memcpy(&chunk,
+                  reinterpret_cast<const std::byte*>(&constant) +
+                      i * sizeof(std::uint64_t),
+                  sizeof(chunk));
+      assembler_.mov_rax(chunk);
+      assembler_.store_rax(r13, reference_disp(depth) +
+                                    static_cast<std::int32_t>(
+                                        i * sizeof(std::uint64_t)));
+    }
+    stack_.push_back(JitValueKind::reference);
+  }
+
+  // Calls a helper on the values from depth up, with an extra argument. The
+  // registers are caller saved, so the values below get spilled around it.
+  void call_helper(std::uintptr_t helper, std::size_t depth,
+                   std::uint32_t argument)
+  {
+    const auto live = std::min(depth, register_slots);
+    for (std::size_t below = 0; below < live; ++below) {
+      if (stack_[below] != JitValueKind::reference) {
+        assembler_.movsd_store(r12, disp(below), static_cast<int>(below));
+      }
+    }
+    assembler_.call(helper, static_cast<std::uint32_t>(depth), argument);
+    for (std::size_t below = 0; below < live; ++below) {
+      if (stack_[below] != JitValueKind::reference) {
+        assembler_.movsd_load(static_cast<int>(below), r12, disp(below));
+      }
+    }
+  }
+
+  // Calls a string helper on the two values on the top of the stack
+  void call_helper(std::uintptr_t helper)
+  {
+    call_helper(helper, top_depth(2), 0);
+  }
+
+  // Returns the kind of the values of the global in slot, which is the type
+  // that the code got compiled against
+  auto global_kind(std::uint32_t slot) const -> JitValueKind
+  {
+    const auto& types = code_.get().bytecode().globals.types;
+    const auto used =
+        std::find_if(types.begin(), types.end(),
+                     [slot](const auto& entry) { return entry.first == slot; });
+    require(used != types.end());
+    const auto type = used->second;
+    if (type == NumberType{}) {
+      return JitValueKind::number;
+    }
+    if (type == BoolType{}) {
+      return JitValueKind::boolean;
+    }
+    if (type == UnitType{}) {
+      return JitValueKind::unit;
+    }
+    require(type == StringType{});
+    return JitValueKind::reference;
+  }
+
+  // Pushes the value of the global in slot
+  void get_global(std::uint32_t slot)
+  {
+    const auto kind = global_kind(slot);
+    const auto depth = stack_.size();
+    require(depth < code_.get().max_stack_depth());
+    call_helper(global_helper(kind, false), depth, slot);
+    stack_.push_back(kind);
+    if (kind != JitValueKind::reference && depth < register_slots) {
+      assembler_.movsd_load(static_cast<int>(depth), r12, disp(depth));
+    }
+  }
+
+  // Pops the value on the top of the stack into the global in slot
+  void set_global(std::uint32_t slot)
+  {
+    const auto top = top_depth(1);
+    const auto kind = global_kind(slot);
+    require(stack_[top] == kind);
+    if (kind != JitValueKind::reference && top < register_slots) {
+      assembler_.movsd_store(r12, disp(top), static_cast<int>(top));
+    }
+    call_helper(global_helper(kind, true), top, slot);
+    assembler_.bytes({0x84, 0xc0}); // test al, al
+    error_fixups_.push_back(assembler_.jcc(cc_e));
+    stack_.pop_back();
+  }
+
+  void arithmetic(std::uint8_t op)
+  {
+    const auto lhs = top_depth(2);
+    require(stack_[lhs] == JitValueKind::number &&
+            stack_[lhs + 1] == JitValueKind::number);
+    const auto left = load(lhs, scratch0);
+    const auto right = load(lhs + 1, scratch1);
+    assembler_.sse(0xf2, op, left, right);
+    store(lhs, left);
+    stack_.pop_back();
+  }
+
+  // Operates on the top of the stack and a constant right operand
+  void constant_arithmetic(std::uint8_t op, Value constant)
+  {
+    const auto top = top_depth(1);
+    require(stack_[top] == JitValueKind::number && constant.is_number());
+    const auto left = load(top, scratch0);
+    assembler_.load_bits(scratch1,
+                         bit_cast<std::uint64_t>(constant.unsafe_as_number()));
+    assembler_.sse(0xf2, op, left, scratch1);
+    store(top, left);
+  }
+
+  // Compares two registers, and returns the condition code that is set if the
+  // comparison is true. A comparison with NaN is false.
+  auto compare(Comparison comparison, int left, int right) -> std::uint8_t
+  {
+    switch (comparison) {
+    case Comparison::less:
+      assembler_.sse(0x66, 0x2e, right, left); // ucomisd
+      return cc_a;
+    case Comparison::less_equal:
+      assembler_.sse(0x66, 0x2e, right, left);
+      return cc_ae;
+    case Comparison::greater:
+      assembler_.sse(0x66, 0x2e, left, right);
+      return cc_a;
+    case Comparison::greater_equal:
+      assembler_.sse(0x66, 0x2e, left, right);
+      return cc_ae;
+    }
+    return cc_a; // Unreachable
+  }
+
+  // Compares the two values on the top of the stack, and returns the condition
+  // code that is set if the comparison is true
+  auto compare_top(Comparison comparison) -> std::uint8_t
+  {
+    const auto lhs = top_depth(2);
+    require(stack_[lhs] == JitValueKind::number &&
+            stack_[lhs + 1] == JitValueKind::number);
+    const auto cc =
+        compare(comparison, load(lhs, scratch0), load(lhs + 1, scratch1));
+    stack_.resize(lhs);
+    return cc;
+  }
+
+  // Replaces the value at depth with the boolean in al
+  void store_boolean(std::size_t depth)
+  {
+    const auto xmm = target_register(depth);
+    assembler_.bool_to_double(xmm);
+    store(depth, xmm);
+    stack_.resize(depth + 1);
+    stack_[depth] = JitValueKind::boolean;
+  }
+
+  void comparison(Comparison comparison)
+  {
+    const auto lhs = top_depth(2);
+    assembler_.setcc(compare_top(comparison));
+    store_boolean(lhs);
+  }
+
+  void constant_comparison(Comparison comparison, Value constant)
+  {
+    const auto top = top_depth(1);
+    require(stack_[top] == JitValueKind::number && constant.is_number());
+    const auto left = load(top, scratch0);
+    assembler_.load_bits(scratch1,
+                         bit_cast<std::uint64_t>(constant.unsafe_as_number()));
+    assembler_.setcc(compare(comparison, left, scratch1));
+    store_boolean(top);
+  }
+
+  // Tests the equality of the two values on the top of the stack, and leaves
+  // the result in al
+  void equal_top(bool negate)
+  {
+    const auto lhs = top_depth(2);
+    require(stack_[lhs] == stack_[lhs + 1]);
+    if (stack_[lhs] == JitValueKind::reference) {
+      call_helper(reinterpret_cast<std::uintptr_t>(&jit_references_equal));
+      if (negate) {
+        assembler_.bytes({0x34, 0x01}); // xor al, 1
+      }
+    } else {
+      // Booleans and units are numbers, with the same number for equal values
+      const auto left = load(lhs, scratch0);
+      const auto right = load(lhs + 1, scratch1);
+      assembler_.sse(0x66, 0x2e, left, right); // ucomisd
+      // Unordered operands are not equal
+      assembler_.setcc(negate ? cc_ne : cc_e);
+      assembler_.setcc(negate ? cc_p : cc_np, true);
+      assembler_.bytes({static_cast<std::uint8_t>(negate ? 0x08 : 0x20),
+                        0xc8}); // or / and al, cl
+    }
+  }
+
+  void equality(bool negate)
+  {
+    const auto lhs = top_depth(2);
+    equal_top(negate);
+    store_boolean(lhs);
+  }
+
+  void jump(std::uint8_t cc, std::size_t target)
+  {
+    jump_to(target, assembler_.jcc(cc));
+  }
+
+  // Jumps to target if the boolean on the top of the stack is value
+  void jump_if(bool value, std::size_t target)
+  {
+    const auto top = top_depth(1);
+    require(stack_[top] == JitValueKind::boolean);
+    const auto xmm = load(top, scratch0);
+    assembler_.sse(0x66, 0x57, scratch1, scratch1); // xorpd
+    assembler_.sse(0x66, 0x2e, xmm, scratch1);      // ucomisd
+    stack_.pop_back();
+    jump(value ? cc_ne : cc_e, target);
+  }
+
+  void jump_unless(Comparison comparison, std::size_t target)
+  {
+    const auto cc = compare_top(comparison);
+    jump(static_cast<std::uint8_t>(cc ^ 1), target);
+  }
+
+  void jump_if_equal(bool equal, std::size_t target)
+  {
+    const auto lhs = top_depth(2);
+    const auto kind = stack_[lhs];
+    require(kind == stack_[lhs + 1]);
+    if (kind == JitValueKind::reference) {
+      equal_top(false);
+      stack_.resize(lhs);
+      assembler_.bytes({0x84, 0xc0}); // test al, al
+      jump(equal ? cc_ne : cc_e, target);
+      return;
+    }
+
+    const auto left = load(lhs, scratch0);
+    const auto right = load(lhs + 1, scratch1);
+    assembler_.sse(0x66, 0x2e, left, right); // ucomisd
+    stack_.resize(lhs);
+    if (equal) {
+      const auto unordered = assembler_.jcc(cc_p);
+      jump(cc_e, target);
+      assembler_.patch(unordered, assembler_.offset());
+    } else {
+      jump(cc_ne, target);
+      jump(cc_p, target);
+    }
+  }
+
+  void translate(std::size_t index, const PreparedInstruction& instruction)
+  {
+    // Jumps only go forward, so the stacks of their targets are known before
+    // the targets get translated
+    if (is_jump(instruction.op)) {
+      require(instruction.target > index);
+    }
+
+    switch (instruction.op) {
+    case op_push_f64:
+      push_constant(instruction.constant);
+      break;
+    case op_pop:
+      top_depth(1);
+      stack_.pop_back();
+      break;
+    case op_unit:
+      push(JitValueKind::unit, 0);
+      break;
+    case op_true:
+      push(JitValueKind::boolean, one_bits);
+      break;
+    case op_false:
+      push(JitValueKind::boolean, 0);
+      break;
+    case op_negate_f64: {
+      const auto top = top_depth(1);
+      require(stack_[top] == JitValueKind::number);
+      const auto xmm = load(top, scratch0);
+      assembler_.load_bits(scratch1, sign_bit);
+      assembler_.sse(0x66, 0x57, xmm, scratch1); // xorpd
+      store(top, xmm);
+      break;
+    }
+    case op_not: {
+      const auto top = top_depth(1);
+      require(stack_[top] == JitValueKind::boolean);
+      const auto xmm = load(top, scratch0);
+      assembler_.load_bits(scratch1, one_bits);
+      assembler_.sse(0xf2, sse_sub, scratch1, xmm);
+      store(top, scratch1);
+      break;
+    }
+    case op_add_f64:
+      arithmetic(sse_add);
+      break;
+    case op_subtract_f64:
+      arithmetic(sse_sub);
+      break;
+    case op_multiply_f64:
+      arithmetic(sse_mul);
+      break;
+    case op_divide_f64:
+      arithmetic(sse_div);
+      break;
+    case op_string_cat: {
+      const auto lhs = top_depth(2);
+      require(stack_[lhs] == JitValueKind::reference &&
+              stack_[lhs + 1] == JitValueKind::reference);
+      call_helper(reinterpret_cast<std::uintptr_t>(&jit_string_cat));
+      assembler_.bytes({0x84, 0xc0}); // test al, al
+      error_fixups_.push_back(assembler_.jcc(cc_e));
+      stack_.pop_back();
+      break;
+    }
+    case op_equal:
+      equality(false);
+      break;
+    case op_not_equal:
+      equality(true);
+      break;
+    case op_less_f64:
+      comparison(Comparison::less);
+      break;
+    case op_less_equal_f64:
+      comparison(Comparison::less_equal);
+      break;
+    case op_greater_f64:
+      comparison(Comparison::greater);
+      break;
+    case op_greater_equal_f64:
+      comparison(Comparison::greater_equal);
+      break;
+    case op_jmp:
+      jump_to(instruction.target, assembler_.jmp());
+      reachable_ = false;
+      break;
+    case op_jmp_false:
+      jump_if(false, instruction.target);
+      break;
+    case op_jmp_true:
+      jump_if(true, instruction.target);
+      break;
+    case op_jmp_if_not_equal:
+      jump_if_equal(false, instruction.target);
+      break;
+    case op_jmp_if_equal:
+      jump_if_equal(true, instruction.target);
+      break;
+    case op_jmp_if_not_less_f64:
+      jump_unless(Comparison::less, instruction.target);
+      break;
+    case op_jmp_if_not_less_equal_f64:
+      jump_unless(Comparison::less_equal, instruction.target);
+      break;
+    case op_jmp_if_not_greater_f64:
+      jump_unless(Comparison::greater, instruction.target);
+      break;
+    case op_jmp_if_not_greater_equal_f64:
+      jump_unless(Comparison::greater_equal, instruction.target);
+      break;
+    case op_add_f64_k:
+      constant_arithmetic(sse_add, instruction.constant);
+      break;
+    case op_subtract_f64_k:
+      constant_arithmetic(sse_sub, instruction.constant);
+      break;
+    case op_multiply_f64_k:
+      constant_arithmetic(sse_mul, instruction.constant);
+      break;
+    case op_divide_f64_k:
+      constant_arithmetic(sse_div, instruction.constant);
+      break;
+    case op_less_f64_k:
+      constant_comparison(Comparison::less, instruction.constant);
+      break;
+    case op_less_equal_f64_k:
+      constant_comparison(Comparison::less_equal, instruction.constant);
+      break;
+    case op_greater_f64_k:
+      constant_comparison(Comparison::greater, instruction.constant);
+      break;
+    case op_greater_equal_f64_k:
+      constant_comparison(Comparison::greater_equal, instruction.constant);
+      break;
+    case op_get_global:
+      get_global(instruction.slot);
+      break;
+    case op_set_global:
+      set_global(instruction.slot);
+      break;
+    case op_return:
+      throw UnsupportedCode{};
+    // Prepared code only has the short forms of instructions with operands
+    case op_push_f64_long:
+    case op_jmp_long:
+    case op_jmp_false_long:
+    case op_jmp_true_long:
+    case op_jmp_if_not_equal_long:
+    case op_jmp_if_equal_long:
+    case op_jmp_if_not_less_f64_long:
+    case op_jmp_if_not_less_equal_f64_long:
+    case op_jmp_if_not_greater_f64_long:
+    case op_jmp_if_not_greater_equal_f64_long:
+    case op_get_global_long:
+    case op_set_global_long:
+      EML_UNREACHABLE();
+    }
+  }
+
+  // Leaves the value on the top of the stack in its slot and returns
+  void finish()
+  {
+    require(reachable_);
+    if (!stack_.empty() && stack_.back() != JitValueKind::reference) {
+      const auto top = stack_.size() - 1;
+      if (top < register_slots) {
+        assembler_.movsd_store(r12, disp(top), static_cast<int>(top));
+      }
+    }
+    assembler_.epilogue(true);
+
+    const auto error = assembler_.offset();
+    assembler_.epilogue(false);
+    for (const auto at : error_fixups_) {
+      assembler_.patch(at, error);
+    }
+  }
+};
+
+} // anonymous namespace
+
+auto jit_compile(const Bytecode& code) -> std::optional<NativeCode>
+{
+  const PreparedBytecode prepared{code};
+  JitCompiler compiler{prepared};
+  try {
+    compiler.compile();
+  } catch (const UnsupportedCode&) {
+    return std::nullopt;
+  }
+
+  const auto& machine_code = compiler.assembler().code();
+  const auto size = machine_code.size();
+  // The memory is never writable and executable at the same time
+  void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (memory == MAP_FAILED) {
+    return std::nullopt;
+  }
+  std::memcpy(memory, machine_code.data(), size);
+  if (mprotect(memory, size, PROT_READ | PROT_EXEC) != 0) {
+    munmap(memory, size);
+    return std::nullopt;
+  }
+
+  NativeCode native;
+  native.memory_ = memory;
+  native.size_ = size;
+  native.max_stack_depth_ = prepared.max_stack_depth();
+  native.result_depth_ = compiler.result_depth();
+  native.result_kind_ = compiler.result_kind();
+  native.globals_ = code.globals;
+  return native;
+}
+
+#else
+
+NativeCode::~NativeCode() = default;
+
+auto NativeCode::run(JitFrame& /*frame*/) const -> bool
+{
+  EML_ASSERT(false, "Native code only exists in builds with the jit");
+  return false;
+}
+
+auto jit_compile(const Bytecode& /*code*/) -> std::optional<NativeCode>
+{
+  return std::nullopt;
+}
+
+#endif
+
+} // namespace eml
@@ -0,0 +1,126 @@
+#ifndef EML_JIT_HPP
+#define EML_JIT_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <optional>
+
+#include "bytecode.hpp"
+#include "memory.hpp"
+
+/**
+ * @file jit.hpp
+ * @brief This file contains the just-in-time compiler that translates bytecode
+ * into x86-64 machine code
+ */
+
+namespace eml {
+
+/**
+ * @brief The kind of the value in a slot of the stack of native code
+ */
+enum class JitValueKind : std::uint8_t {
+  number,
+  boolean,
+  unit,
+  reference,
+};
+
+/**
+ * @brief The memory that native code runs on
+ *
+ * Numbers, booleans and units live in the xmm registers while native code
+ * runs, and only the stack slots that do not fit in the registers get a home
+ * in slots. Booleans are the numbers 0 and 1, and units are 0. References
+ * always live in references, so that they stay roots of the garbage collector
+ * when a string operation allocates.
+ */
+struct JitFrame {
+  double* slots = nullptr;     // One slot for every value of the stack
+  Value* references = nullptr; // One slot for every value of the stack
+  GarbageCollector* gc = nullptr;
+  std::exception_ptr* error = nullptr; // The exception of a failed string op
+  Value* globals = nullptr;            // The slots of the module of the code
+};
+
+/**
+ * @brief A chunk of bytecode translated into x86-64 machine code
+ *
+ * Only supported on Linux x86-64, when eml is built with the EML_JIT option.
+ * The native code refers to the objects of the constant pool of its bytecode,
+ * so the bytecode must outlive it. It shares the module of the globals of its
+ * bytecode, see ModuleLink.
+ */
+class NativeCode {
+public:
+  NativeCode(NativeCode&& other) noexcept;
+  auto operator=(NativeCode&& other) noexcept -> NativeCode&;
+  NativeCode(const NativeCode&) = delete;
+  auto operator=(const NativeCode&) -> NativeCode& = delete;
+  ~NativeCode();
+
+  /// @brief Returns the number of stack slots that the code needs
+  [[nodiscard]] auto max_stack_depth() const noexcept -> std::size_t
+  {
+    return max_stack_depth_;
+  }
+
+  /// @brief Returns the number of values on the stack when the code ends
+  [[nodiscard]] auto result_depth() const noexcept -> std::size_t
+  {
+    return result_depth_;
+  }
+
+  /// @brief Returns the kind of the value on the top of the stack when the
+  /// code ends, which is meaningless if the stack is empty
+  [[nodiscard]] auto result_kind() const noexcept -> JitValueKind
+  {
+    return result_kind_;
+  }
+
+  /// @brief Returns the slots of the module that the code uses
+  [[nodiscard]] auto globals() const noexcept -> const ModuleLink&
+  {
+    return globals_;
+  }
+
+  /**
+   * @brief Runs the code on frame
+   *
+   * The slots and references of the frame must hold max_stack_depth values,
+   * and the references must be roots of the garbage collector. The globals of
+   * the frame must be the slots of globals(). The value on the top of the
+   * stack is left in its slot when the code ends.
+   *
+   * @return false if a string operation or a write to a global threw, whose
+   * exception is stored in the error of the frame
+   */
+  auto run(JitFrame& frame) const -> bool;
+
+private:
+  friend auto jit_compile(const Bytecode& code) -> std::optional<NativeCode>;
+
+  NativeCode() = default;
+
+  void* memory_ = nullptr;
+  std::size_t size_ = 0;
+  std::size_t max_stack_depth_ = 0;
+  std::size_t result_depth_ = 0;
+  JitValueKind result_kind_ = JitValueKind::unit;
+  ModuleLink globals_;
+};
+
+/**
+ * @brief Translates code into native code
+ *
+ * @return The native code, or nullopt if the jit is not supported by the build
+ * or the code has instructions that the jit does not know how to translate
+ */
+[[nodiscard]] auto jit_compile(const Bytecode& code)
+    -> std::optional<NativeCode>;
+auto jit_compile(Bytecode&& code) -> std::optional<NativeCode> = delete;
+
+} // namespace eml
+
+#endif // EML_JIT_HPP
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <cstdlib>
 #include <new>
 
@@ -5,41 +6,346 @@
 
 namespace eml {
 
+PoolAllocator::PoolAllocator(PoolAllocator&& other) noexcept
+    : free_lists_{other.free_lists_}, slabs_{std::move(other.slabs_)}
+{
+  other.free_lists_ = {};
+}
+
+auto PoolAllocator::operator=(PoolAllocator&& other) noexcept
+    -> PoolAllocator&
+{
+  std::swap(free_lists_, other.free_lists_);
+  std::swap(slabs_, other.slabs_);
+  return *this;
+}
+
+auto PoolAllocator::size_class_of(std::size_t bytes) noexcept -> std::size_t
+{
+  std::size_t size_class = 0;
+  while ((min_block_size << size_class) < bytes) {
+    ++size_class;
+  }
+  return size_class;
+}
+
+auto PoolAllocator::allocate(std::size_t bytes) -> void*
+{
+  if (bytes > max_block_size) {
+    void* ptr = std::malloc(bytes);
+    if (ptr == nullptr) {
+      throw std::bad_alloc{};
+    }
+    return ptr;
+  }
+
+  const auto size_class = size_class_of(bytes);
+  if (free_lists_[size_class] == nullptr) {
+    refill(size_class);
+  }
+  FreeBlock* block = free_lists_[size_class];
+  free_lists_[size_class] = block->next;
+  return block;
+}
+
+void PoolAllocator::deallocate(void* ptr, std::size_t bytes) noexcept
+{
+  if (bytes > max_block_size) {
+    std::free(ptr);
+    return;
+  }
+
+  const auto size_class = size_class_of(bytes);
+  auto* block = new (ptr) FreeBlock{free_lists_[size_class]};
+  free_lists_[size_class] = block;
+}
+
+// Carves a new slab into blocks of the size class and puts them on the free
+// list of the class
+void PoolAllocator::refill(std::size_t size_class)
+{
+  const std::size_t block_size = min_block_size << size_class;
+  slabs_.push_back(std::make_unique<std::byte[]>(slab_size));
+  std::byte* slab = slabs_.back().get();
+
+  for (std::size_t offset = slab_size; offset >= block_size;) {
+    offset -= block_size;
+    free_lists_[size_class] =
+        new (slab + offset) FreeBlock{free_lists_[size_class]};
+  }
+}
+
+namespace {
+
+constexpr auto allocate_size_of(std::size_t bytes) noexcept -> std::size_t
+{
+  return Obj::allocation_size(bytes);
+}
+
+// Returns the number of bytes an object takes in the nursery, which keeps the
+// objects aligned
+constexpr auto young_allocate_size_of(std::size_t bytes) noexcept
+    -> std::size_t
+{
+  constexpr std::size_t alignment = alignof(Obj);
+  return (allocate_size_of(bytes) + alignment - 1) / alignment * alignment;
+}
+
+// Returns the references of an object of the pair kind
+auto references_of(Obj& obj) noexcept -> Obj**
+{
+  return reinterpret_cast<Obj**>(obj.data());
+}
+
+constexpr std::size_t pair_reference_count = 2;
+
+} // anonymous namespace
+
 GarbageCollector::~GarbageCollector()
 {
   Obj* object = root_;
   while (object != nullptr) {
     Obj* next = object->next();
 
-    // const std::size_t allocate_size = sizeof(Obj) - 1 + object->size();
-
+    const std::size_t allocate_size = allocate_size_of(object->size());
     object->~Obj();
-    std::free(object);
+    pool_.deallocate(object, allocate_size);
 
     object = next;
   }
 }
 
-GarbageCollector::GarbageCollector(GarbageCollector&& other) noexcept
-    : root_{other.root_}
+GarbageCollector::GarbageCollector(GcConfig config)
+    : threshold_{config.initial_threshold},
+      initial_threshold_{config.initial_threshold},
+      max_interned_cat_size_{config.max_interned_cat_size}
 {
-  other.root_ = nullptr;
+  if (config.nursery_size != 0) {
+    nursery_ = std::make_unique<std::byte[]>(config.nursery_size);
+    nursery_top_ = nursery_.get();
+    nursery_end_ = nursery_top_ + config.nursery_size;
+  }
 }
 
-auto GarbageCollector::operator=(GarbageCollector&& other) noexcept
-    -> GarbageCollector&
+auto GarbageCollector::allocate(std::size_t bytes, Generation generation,
+                                ObjKind kind) -> GcPointer
 {
-  std::swap(root_, other.root_);
-  return *this;
+  if (generation == Generation::young) {
+    const std::size_t young_size = young_allocate_size_of(bytes);
+    const auto nursery_left =
+        static_cast<std::size_t>(nursery_end_ - nursery_top_);
+    if (young_size <= nursery_left) {
+      auto* object = new (nursery_top_) Obj{bytes, nullptr};
+      object->young_ = true;
+      object->kind_ = kind;
+      nursery_top_ += young_size;
+      return GcPointer{object};
+    }
+    minor_collection_requested_ = nursery_ != nullptr;
+  }
+
+  if (bytes_allocated_ + allocate_size_of(bytes) > threshold_) {
+    collect_old();
+  }
+  Obj* object = allocate_old(bytes);
+  object->kind_ = kind;
+  return GcPointer{object};
 }
 
-auto GarbageCollector::allocate(std::size_t bytes) -> GcPointer
+// Allocates an object in the old space without running any collection
+auto GarbageCollector::allocate_old(std::size_t bytes) -> Obj*
 {
-  const std::size_t allocate_size = sizeof(Obj) - 1 + bytes;
-  void* ptr = std::malloc(allocate_size);
+  const std::size_t allocate_size = allocate_size_of(bytes);
+  void* ptr = pool_.allocate(allocate_size);
   auto* object = new (ptr) Obj{bytes, root_};
   root_ = object;
-  return GcPointer{object};
+  bytes_allocated_ += allocate_size;
+  return object;
+}
+
+// Copies a young object into the old space, and leaves the address of the
+// copy in the young object, so that later references to it get the same copy
+auto GarbageCollector::evacuate(GcPointer obj) -> GcPointer
+{
+  if (obj->marked_) {
+    return GcPointer{obj->next_};
+  }
+
+  Obj* copy = allocate_old(obj->size());
+  std::memcpy(copy->data(), obj->data(), obj->size());
+  copy->hash_ = obj->hash_;
+  copy->kind_ = obj->kind_;
+  obj->marked_ = true;
+  obj->next_ = copy;
+
+  // The references of the copy still point into the nursery
+  if (copy->kind_ == ObjKind::pair) {
+    gray_.push_back(copy);
+  }
+
+  // The copy becomes the canonical object. The original may still be used
+  // until the next minor collection, and compares by its data meanwhile
+  if (obj->interned_) {
+    copy->interned_ = true;
+    obj->interned_ = false;
+    replace_interned(obj.get(), copy);
+  }
+  return GcPointer{copy};
+}
+
+void GarbageCollector::collect()
+{
+  collect_young();
+  collect_old();
+}
+
+void GarbageCollector::collect_young()
+{
+  minor_collection_requested_ = false;
+  if (nursery_top_ == nursery_.get()) {
+    return;
+  }
+
+  collecting_young_ = true;
+  for (auto* provider : root_providers_) {
+    provider->mark_roots(*this);
+  }
+  gray_.insert(gray_.end(), remembered_.begin(), remembered_.end());
+  remembered_.clear();
+  evacuate_gray();
+  collecting_young_ = false;
+
+  // The interned young objects that moved were replaced by their copies
+  for (Obj* obj : young_interned_) {
+    if (obj->interned_) {
+      replace_interned(obj, nullptr);
+    }
+  }
+  young_interned_.clear();
+
+  nursery_top_ = nursery_.get();
+}
+
+// Moves the young objects that the gray objects refer to, until every
+// reachable young object moved
+void GarbageCollector::evacuate_gray()
+{
+  while (!gray_.empty()) {
+    Obj* obj = gray_.back();
+    gray_.pop_back();
+
+    Obj** references = references_of(*obj);
+    for (std::size_t i = 0; i < pair_reference_count; ++i) {
+      if (references[i] != nullptr && references[i]->young_) {
+        references[i] = evacuate(GcPointer{references[i]}).get();
+      }
+    }
+  }
+}
+
+// Marks the old objects that the gray objects refer to, until every reachable
+// object is marked
+void GarbageCollector::mark_gray()
+{
+  while (!gray_.empty()) {
+    Obj* obj = gray_.back();
+    gray_.pop_back();
+
+    Obj** references = references_of(*obj);
+    for (std::size_t i = 0; i < pair_reference_count; ++i) {
+      if (references[i] != nullptr) {
+        GcPointer reference{references[i]};
+        mark(reference);
+      }
+    }
+  }
+}
+
+// Marks and sweeps the old space. Young objects do not move and are not freed,
+// and the old objects that they or pinned objects refer to survive
+void GarbageCollector::collect_old()
+{
+  for (auto* provider : root_providers_) {
+    provider->mark_roots(*this);
+  }
+  for (auto* top = nursery_.get(); top != nursery_top_;) {
+    auto* obj = reinterpret_cast<Obj*>(top);
+    if (obj->kind_ == ObjKind::pair) {
+      gray_.push_back(obj);
+    }
+    top += young_allocate_size_of(obj->size());
+  }
+  for (Obj* obj = root_; obj != nullptr; obj = obj->next_) {
+    if (obj->pin_count_ > 0 && obj->kind_ == ObjKind::pair) {
+      gray_.push_back(obj);
+    }
+  }
+  mark_gray();
+
+  remembered_.erase(std::remove_if(remembered_.begin(), remembered_.end(),
+                                   [](const Obj* obj) {
+                                     return !obj->marked_ &&
+                                            obj->pin_count_ == 0;
+                                   }),
+                    remembered_.end());
+  sweep();
+
+  threshold_ = std::max(initial_threshold_, bytes_allocated_ * 2);
+}
+
+void GarbageCollector::sweep() noexcept
+{
+  Obj** link = &root_;
+  while (*link != nullptr) {
+    Obj* object = *link;
+    if (object->marked_ || object->pin_count_ > 0) {
+      object->marked_ = false;
+      link = &object->next_;
+    } else {
+      *link = object->next_;
+      if (object->interned_) {
+        replace_interned(object, nullptr);
+      }
+      const std::size_t allocate_size = allocate_size_of(object->size());
+      bytes_allocated_ -= allocate_size;
+
+      object->~Obj();
+      pool_.deallocate(object, allocate_size);
+    }
+  }
+}
+
+void GarbageCollector::intern(GcPointer obj)
+{
+  interned_.emplace(obj->hash_, obj.get());
+  obj->interned_ = true;
+  if (obj->young_) {
+    young_interned_.push_back(obj.get());
+  }
+}
+
+// Replaces obj in the interning table, or removes it if replacement is null
+void GarbageCollector::replace_interned(Obj* obj, Obj* replacement) noexcept
+{
+  const auto [first, last] = interned_.equal_range(obj->hash_);
+  const auto pos = std::find_if(
+      first, last, [obj](const auto& entry) { return entry.second == obj; });
+  EML_ASSERT(pos != last, "The interned object is not in the table");
+
+  if (replacement != nullptr) {
+    pos->second = replacement;
+  } else {
+    interned_.erase(pos);
+  }
+}
+
+void GarbageCollector::remove_root_provider(GcRootProvider& provider) noexcept
+{
+  const auto pos =
+      std::find(root_providers_.begin(), root_providers_.end(), &provider);
+  EML_ASSERT(pos != root_providers_.end(),
+             "Remove a root provider that is not registered");
+  root_providers_.erase(pos);
 }
 
 } // namespace eml
@@ -1,8 +1,13 @@
 #ifndef EML_MEMORY_HPP
 #define EML_MEMORY_HPP
 
+#include <array>
 #include <cstddef>
+#include <cstdint>
 #include <cstring>
+#include <memory>
+#include <unordered_map>
+#include <vector>
 
 #include "common.hpp"
 
@@ -34,11 +39,83 @@ enum PrintType {
 
 class GarbageCollector;
 
+/// @brief The initial state of hash_bytes
+constexpr std::uint32_t hash_bytes_seed = 2166136261u;
+
+/// @brief The multiplier of the polynomial of hash_bytes
+constexpr std::uint32_t hash_bytes_multiplier = 16777619u;
+
+/**
+ * @brief Hashes size bytes from data with a polynomial rolling hash
+ *
+ * Hashing continues from an earlier hash when it is passed as seed. The hash
+ * of a concatenation can also be computed from the hashes of its parts, see
+ * hash_concat.
+ */
+inline auto hash_bytes(const std::byte* data, std::size_t size,
+                       std::uint32_t seed = hash_bytes_seed) noexcept
+    -> std::uint32_t
+{
+  std::uint32_t hash = seed;
+  for (std::size_t i = 0; i < size; ++i) {
+    hash = hash * hash_bytes_multiplier +
+           std::to_integer<std::uint32_t>(data[i]);
+  }
+  return hash;
+}
+
+/// @brief Returns hash_bytes_multiplier to the power of size, in O(log size)
+constexpr auto hash_power(std::size_t size) noexcept -> std::uint32_t
+{
+  std::uint32_t result = 1;
+  std::uint32_t base = hash_bytes_multiplier;
+  for (; size != 0; size >>= 1) {
+    if ((size & 1) != 0) {
+      result *= base;
+    }
+    base *= base;
+  }
+  return result;
+}
+
+/**
+ * @brief Returns the hash_bytes of a concatenation in O(1), from the hashes of
+ * its parts and the hash_power of the size of the second part
+ */
+constexpr auto hash_concat(std::uint32_t first, std::uint32_t second,
+                           std::uint32_t second_power) noexcept
+    -> std::uint32_t
+{
+  return (first - hash_bytes_seed) * second_power + second;
+}
+
+/**
+ * @brief The layout of the data of an object, which the garbage collector
+ * traces
+ */
+enum class ObjKind : std::uint8_t {
+  bytes, ///< @brief Plain bytes, such as the text of a flat string
+  pair,  ///< @brief Starts with two, possibly null, Obj* to other objects
+};
+
 /**
  * @brief A heap allocated, and garbage-collection managed object in EML
  */
 class Obj {
 public:
+  /// @brief Returns the number of bytes that an object with size bytes of
+  /// data takes
+  [[nodiscard]] static constexpr auto allocation_size(std::size_t size) noexcept
+      -> std::size_t
+  {
+    return offsetof(Obj, data_) + size;
+  }
+
+  [[nodiscard]] constexpr auto kind() const noexcept -> ObjKind
+  {
+    return kind_;
+  }
+
   [[nodiscard]] constexpr auto size() const noexcept -> std::size_t
   {
     return size_;
@@ -59,10 +136,60 @@ public:
     return static_cast<std::byte*>(data_);
   }
 
+  /// @brief Returns the hash of the data, see set_hash
+  [[nodiscard]] constexpr auto hash() const noexcept -> std::uint32_t
+  {
+    return hash_;
+  }
+
+  /// @brief Stores hash_bytes of the data, after the creator filled it
+  constexpr void set_hash(std::uint32_t hash) noexcept
+  {
+    hash_ = hash;
+  }
+
+  /// @brief Whether the object is the canonical one of its contents
+  [[nodiscard]] constexpr auto is_interned() const noexcept -> bool
+  {
+    return interned_;
+  }
+
+  /// @brief Whether the object is in the nursery, where it cannot be pinned
+  [[nodiscard]] constexpr auto is_young() const noexcept -> bool
+  {
+    return young_;
+  }
+
+  /**
+   * @brief Keeps the object alive until the matching unpin, whether it is
+   * reachable from the roots or not
+   *
+   * Used by holders of references that live outside of the vm, such as the
+   * constant pool of a chunk. Pins nest.
+   */
+  void pin() noexcept
+  {
+    EML_ASSERT(!young_, "Young objects move, so they cannot be pinned");
+    ++pin_count_;
+  }
+
+  /// @brief Undoes one pin
+  void unpin() noexcept
+  {
+    EML_ASSERT(pin_count_ > 0, "Unpin an object that is not pinned");
+    --pin_count_;
+  }
+
 private:
   std::size_t size_;
   Obj* next_ = nullptr;
-  std::byte data_[1];
+  std::uint32_t pin_count_ = 0;
+  std::uint32_t hash_ = hash_bytes_seed;
+  bool marked_ = false; // For a young object, whether it was moved to next_
+  bool young_ = false;  // Whether the object is in the nursery
+  bool interned_ = false;
+  ObjKind kind_ = ObjKind::bytes;
+  alignas(std::max_align_t) std::byte data_[1];
 
   constexpr explicit Obj(std::size_t size, Obj* next)
       : size_{size}, next_{next}, data_{}
@@ -84,6 +211,11 @@ public:
     EML_ASSERT(obj_ != nullptr, "The refered to object cannot be null");
   }
 
+  [[nodiscard]] constexpr auto get() const noexcept -> Obj*
+  {
+    return obj_;
+  }
+
   [[nodiscard]] constexpr auto operator-> () const noexcept -> Obj*
   {
     return obj_;
@@ -94,8 +226,8 @@ public:
     return *obj_;
   }
 
-  [[nodiscard]] constexpr auto operator==(const GcPointer& other) noexcept
-      -> bool
+  [[nodiscard]] constexpr auto operator==(const GcPointer& other) const
+      noexcept -> bool
   {
     return obj_ == other.obj_;
   }
@@ -104,18 +236,281 @@ private:
   Obj* obj_;
 };
 
+/**
+ * @brief Interface of the holders of references to garbage collector managed
+ * objects
+ *
+ * Registered root providers are asked to mark the objects that they refer to
+ * at the start of every collection.
+ */
+class GcRootProvider {
+public:
+  GcRootProvider() = default;
+  virtual ~GcRootProvider() = default;
+  GcRootProvider(const GcRootProvider&) = default;
+  auto operator=(const GcRootProvider&) -> GcRootProvider& = default;
+  GcRootProvider(GcRootProvider&&) noexcept = default;
+  auto operator=(GcRootProvider&&) noexcept -> GcRootProvider& = default;
+
+  virtual void mark_roots(GarbageCollector& gc) = 0;
+};
+
+/**
+ * @brief A slab allocator with power of two size classes
+ *
+ * Requests up to max_block_size bytes are rounded up to the next size class
+ * and served from the free list of that class, which gets refilled by carving
+ * a whole slab into blocks. Larger requests go to the system allocator.
+ * Memory of the slabs is only returned to the system when the allocator get
+ * destroyed.
+ */
+class PoolAllocator {
+public:
+  /// @brief The smallest size class
+  static constexpr std::size_t min_block_size = 32;
+  /// @brief The largest size class, larger requests use malloc
+  static constexpr std::size_t max_block_size = 512;
+  /// @brief Number of bytes of a slab that refills a free list
+  static constexpr std::size_t slab_size = 16 * 1024;
+
+  PoolAllocator() = default;
+  ~PoolAllocator() = default;
+
+  PoolAllocator(const PoolAllocator& other) = delete;
+  auto operator=(const PoolAllocator& other) -> PoolAllocator& = delete;
+  PoolAllocator(PoolAllocator&& other) noexcept;
+  auto operator=(PoolAllocator&& other) noexcept -> PoolAllocator&;
+
+  /**
+   * @brief Allocates a block of at least bytes bytes
+   * @throw std::bad_alloc if the system is out of memory
+   */
+  [[nodiscard]] auto allocate(std::size_t bytes) -> void*;
+
+  /**
+   * @brief Frees a block that was returned by allocate(bytes)
+   */
+  void deallocate(void* ptr, std::size_t bytes) noexcept;
+
+private:
+  struct FreeBlock {
+    FreeBlock* next;
+  };
+
+  // Size classes are min_block_size, 2 * min_block_size, ..., max_block_size
+  static constexpr std::size_t size_class_count = 5;
+  static_assert((min_block_size << (size_class_count - 1)) == max_block_size);
+
+  std::array<FreeBlock*, size_class_count> free_lists_{};
+  std::vector<std::unique_ptr<std::byte[]>> slabs_;
+
+  static auto size_class_of(std::size_t bytes) noexcept -> std::size_t;
+  void refill(std::size_t size_class);
+};
+
+/**
+ * @brief Runtime configurations that decides how the garbage collector should
+ * behave
+ */
+struct GcConfig {
+  /// @brief Number of allocated bytes that triggers the first collection
+  std::size_t initial_threshold = std::size_t{1} << 20;
+  /// @brief Number of bytes of the nursery of young objects, 0 turns off the
+  /// generational mode
+  std::size_t nursery_size = std::size_t{256} << 10;
+  /// @brief Concatenation results larger than this many bytes are not
+  /// interned, since hashing and looking up long strings that are unlikely
+  /// to repeat costs more than it saves
+  std::size_t max_interned_cat_size = 64;
+};
+
+/**
+ * @brief The generation that an object get allocated in
+ */
+enum class Generation {
+  old,   ///< @brief Objects that may live long, or that get pinned
+  young, ///< @brief Short-lived objects that are only referred by roots
+};
+
+/**
+ * @brief A tracing mark-and-sweep garbage collector
+ *
+ * Objects that are neither pinned nor marked by a registered root provider get
+ * freed by a collection. A collection runs when an allocation would push the
+ * number of allocated bytes over a threshold, which is set to twice the
+ * surviving bytes afterwards, so the collections get rarer as the live heap
+ * grows.
+ *
+ * In the generational mode, young objects are bump allocated in a nursery. A
+ * minor collection copies the young objects that the roots refer to into the
+ * old space, updates the roots, and empties the nursery, so its cost scales
+ * with the surviving objects. Since copying invalidates every reference that
+ * a root provider does not know about, minor collections only run at
+ * safepoints. A full nursery falls back to the old space and requests one.
+ *
+ * Objects of the pair kind can refer to other objects. Old objects that may
+ * refer to young ones are recorded by write_barrier in a remembered set, which
+ * is a root of the next minor collection. A major collection treats the
+ * nursery as a root instead.
+ *
+ * The collector also owns the table of interned objects, which does not keep
+ * its objects alive.
+ *
+ * @warning An allocation may free every object that is not reachable from the
+ * roots, so callers must keep the objects they still need reachable, for
+ * example on the vm stack, across allocations.
+ */
 class GarbageCollector {
 public:
-  explicit GarbageCollector() = default;
+  explicit GarbageCollector(GcConfig config = {});
 
   ~GarbageCollector();
 
   GarbageCollector(const GarbageCollector& other) = delete;
   auto operator=(const GarbageCollector& other) -> GarbageCollector& = delete;
-  GarbageCollector(GarbageCollector&& other) noexcept;
-  auto operator=(GarbageCollector&& other) noexcept -> GarbageCollector&;
+  // Root providers refer to the collector they registered with, so it stays
+  // where it is
+  GarbageCollector(GarbageCollector&& other) = delete;
+  auto operator=(GarbageCollector&& other) -> GarbageCollector& = delete;
+
+  /**
+   * @brief Allocates an object with bytes of data, may run a collection of the
+   * old space first
+   * @note Objects of the pair kind must fill their references before the next
+   * allocation
+   */
+  auto allocate(std::size_t bytes, Generation generation = Generation::old,
+                ObjKind kind = ObjKind::bytes) -> GcPointer;
+
+  /**
+   * @brief Records that obj may refer to young objects, must be called after
+   * setting the references of an object of the pair kind
+   */
+  void write_barrier(GcPointer obj)
+  {
+    if (!obj->young_ && obj->kind_ == ObjKind::pair) {
+      remembered_.push_back(obj.get());
+    }
+  }
+
+  /**
+   * @brief Runs a minor and then a major collection now, and frees every
+   * unreachable object
+   * @warning Moves the young objects, see safepoint
+   */
+  void collect();
 
-  auto allocate(std::size_t bytes) -> GcPointer;
+  /**
+   * @brief Copies the young objects that the roots refer to into the old
+   * space, and empties the nursery
+   * @warning Moves the young objects, see safepoint
+   */
+  void collect_young();
+
+  /**
+   * @brief Runs the minor collection that a full nursery requested
+   *
+   * Callers must only reach a safepoint when every reference to a young
+   * object that they still need is visible to a root provider.
+   */
+  void safepoint()
+  {
+    if (minor_collection_requested_) {
+      collect_young();
+    }
+  }
+
+  /**
+   * @brief Returns a reference to a copy of obj in the old space if obj is
+   * young, or obj itself otherwise
+   *
+   * The young objects that obj refers to get tenured as well. The nursery
+   * copies stay until the next minor collection. Tenuring never runs a
+   * collection.
+   */
+  [[nodiscard]] auto tenure(GcPointer obj) -> GcPointer
+  {
+    if (!obj->young_) {
+      return obj;
+    }
+    const auto copy = evacuate(obj);
+    evacuate_gray();
+    return copy;
+  }
+
+  /**
+   * @brief Marks the object that obj points to as reachable in the ongoing
+   * collection
+   *
+   * In a minor collection, a young object get moved and obj is updated to
+   * point to its new place.
+   */
+  void mark(GcPointer& obj)
+  {
+    if (obj->young_) {
+      if (collecting_young_) {
+        obj = evacuate(obj);
+      }
+    } else if (!collecting_young_ && !obj->marked_) {
+      obj->marked_ = true;
+      if (obj->kind_ == ObjKind::pair) {
+        gray_.push_back(obj.get());
+      }
+    }
+  }
+
+  /**
+   * @brief Returns the interned object with the hash, size, and the data that
+   * equal accepts, or nullptr if there is none
+   * @param equal Called with the data of candidate objects of the same size
+   */
+  template <typename Equal>
+  [[nodiscard]] auto find_interned(std::uint32_t hash, std::size_t size,
+                                   Equal equal) const -> Obj*
+  {
+    const auto [first, last] = interned_.equal_range(hash);
+    for (auto it = first; it != last; ++it) {
+      Obj* candidate = it->second;
+      if (candidate->size() == size && equal(candidate->data())) {
+        return candidate;
+      }
+    }
+    return nullptr;
+  }
+
+  /**
+   * @brief Makes obj the canonical object of its data
+   * @pre obj has its hash set, and no interned object has the same data
+   */
+  void intern(GcPointer obj);
+
+  /// @brief Returns the maximum size of the interned concatenation results
+  [[nodiscard]] auto max_interned_cat_size() const noexcept -> std::size_t
+  {
+    return max_interned_cat_size_;
+  }
+
+  /**
+   * @brief Registers a root provider
+   * @warning The provider must be removed before it get destroyed
+   */
+  void add_root_provider(GcRootProvider& provider)
+  {
+    root_providers_.push_back(&provider);
+  }
+
+  /**
+   * @brief Unregisters a root provider that was registered before
+   */
+  void remove_root_provider(GcRootProvider& provider) noexcept;
+
+  /// @brief Returns the number of bytes that the objects use, including the
+  /// used part of the nursery
+  [[nodiscard]] auto bytes_allocated() const noexcept -> std::size_t
+  {
+    return bytes_allocated_ +
+           static_cast<std::size_t>(nursery_top_ - nursery_.get());
+  }
 
   auto is_equal(const GarbageCollector& other) const noexcept -> bool
   {
@@ -124,6 +519,32 @@ public:
 
 private:
   Obj* root_ = nullptr; // List of allocated objects
+  PoolAllocator pool_;  // Storage of the objects
+  std::vector<GcRootProvider*> root_providers_;
+  std::size_t bytes_allocated_ = 0;
+  std::size_t threshold_; // Collects when bytes_allocated_ would exceed it
+  std::size_t initial_threshold_;
+
+  std::unique_ptr<std::byte[]> nursery_;
+  std::byte* nursery_top_ = nullptr; // Next free byte of the nursery
+  std::byte* nursery_end_ = nullptr;
+  bool minor_collection_requested_ = false;
+  bool collecting_young_ = false;
+
+  std::unordered_multimap<std::uint32_t, Obj*> interned_; // By their hashes
+  std::vector<Obj*> young_interned_; // Interned objects in the nursery
+  std::size_t max_interned_cat_size_;
+
+  std::vector<Obj*> remembered_; // Old objects that may refer to young ones
+  std::vector<Obj*> gray_; // Reached objects whose references are not traced
+
+  auto allocate_old(std::size_t bytes) -> Obj*;
+  void evacuate_gray();
+  void mark_gray();
+  void replace_interned(Obj* obj, Obj* replacement) noexcept;
+  auto evacuate(GcPointer obj) -> GcPointer;
+  void collect_old();
+  void sweep() noexcept;
 };
 
 } // namespace eml
@@ -1,10 +1,20 @@
 #ifndef EML_MODULE_HPP
 #define EML_MODULE_HPP
 
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <stdexcept>
 #include <string>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
+#include "common.hpp"
+#include "memory.hpp"
+#include "symbol.hpp"
 #include "type.hpp"
 #include "value.hpp"
 
@@ -21,41 +31,256 @@ enum class SameScopeShadowing {
   warning, ///< @brief Warn on shadowing in the same scope
 };
 
-using SymbolTable = std::unordered_map<std::string, std::pair<Type, Value>>;
-
 /**
  * @brief A module and the top-level bindings it defined
+ *
+ * The values of the bindings live in a dense array of slots, which the chunks
+ * linked to the module read and write at run time, see op_get_global and
+ * op_set_global. Rebinding an identifier reuses its slot, so the chunks that
+ * use it see the new value without getting compiled again. If the rebinding
+ * changes the type of the slot, the chunks compiled against the old type are
+ * stale and refuse to run, see ModuleLink. Every rebinding also starts a new
+ * generation of the slot, which makes the chunks that inlined its old value
+ * stale.
+ *
+ * The module is shared by the compiler and the chunks linked to it, and its
+ * slots are roots of the garbage collector for as long as it exists.
  */
-class Module {
+class Module : private GcRootProvider {
 public:
-  explicit Module(std::string name) : name_{std::move(name)} {}
+  /// @brief The index of a slot of the module
+  using Slot = std::uint32_t;
+
+  /// @brief The number of times that a slot got rebound
+  using Generation = std::uint32_t;
+
+  /// @brief The type of a binding and the slot that holds its value
+  struct Binding {
+    Type type;
+    Slot slot;
+  };
 
-  void add_binding(const std::string& identifier, Type t, Value v)
+  Module(std::string name, GarbageCollector& gc)
+      : name_{std::move(name)}, garbage_collector_{gc}
   {
-    //    auto query_result = global_env_.find(identifier);
-    //    if (query_result != global_env_.end()) { // Shadowing
+    garbage_collector_.get().add_root_provider(*this);
+  }
+
+  ~Module() override
+  {
+    garbage_collector_.get().remove_root_provider(*this);
+  }
 
-    //      //      if (options_.shadowing_policy ==
-    //      SameScopeShadowing::warning) {
-    //      //        std::clog << "Warning: Global value definition of " <<
-    //      //        identifier
-    //      //                  << " shadows earlier binding "
-    //      //                     "in the global scope\n";
-    //      //      }
+  Module(const Module&) = delete;
+  auto operator=(const Module&) -> Module& = delete;
+  Module(Module&&) = delete;
+  auto operator=(Module&&) -> Module& = delete;
 
-    //      global_env_[identifier] = std::pair{std::move(t), std::move(v)};
-    //    } else {
-    //      global_env_.emplace(identifier, std::pair{std::move(t),
-    //      std::move(v)});
-    //    }
+  /**
+   * @brief Binds identifier to the value v of type t
+   * @return The slot of the binding
+   */
+  auto add_binding(Symbol identifier, Type t, Value v) -> Slot
+  {
+    const auto [pos, inserted] = bindings_.try_emplace(
+        identifier.id(), static_cast<Slot>(slots_.size()));
+    const auto slot = pos->second;
+    if (inserted) {
+      types_.push_back(t);
+      generations_.push_back(0);
+      slots_.push_back(v);
+    } else {
+      types_[slot] = t;
+      ++generations_[slot];
+      slots_[slot] = v;
+    }
+    return slot;
+  }
+
+  /// @brief Gets the binding of identifier if it exists
+  [[nodiscard]] auto find(Symbol identifier) const noexcept
+      -> std::optional<Binding>
+  {
+    const auto pos = bindings_.find(identifier.id());
+    if (pos == bindings_.end()) {
+      return {};
+    }
+    const auto slot = pos->second;
+    return Binding{types_[slot], slot};
+  }
+
+  /// @brief Gets the type of the value in a slot
+  [[nodiscard]] auto type(Slot slot) const -> Type
+  {
+    EML_ASSERT(slot < types_.size(), "Not a slot of the module");
+    return types_[slot];
+  }
 
-    global_env_.insert_or_assign(identifier,
-                                 std::pair{std::move(t), std::move(v)});
+  /// @brief Gets the number of times that a slot got rebound
+  [[nodiscard]] auto generation(Slot slot) const -> Generation
+  {
+    EML_ASSERT(slot < generations_.size(), "Not a slot of the module");
+    return generations_[slot];
+  }
+
+  /// @brief Gets the value in a slot
+  [[nodiscard]] auto value(Slot slot) const -> Value
+  {
+    EML_ASSERT(slot < slots_.size(), "Not a slot of the module");
+    return slots_[slot];
+  }
+
+  /**
+   * @brief Replaces the value in a slot
+   *
+   * The chunks that read the slot get the new value on their next run. The
+   * value must have the type of the slot.
+   */
+  void set_value(Slot slot, Value v)
+  {
+    EML_ASSERT(slot < slots_.size(), "Not a slot of the module");
+    slots_[slot] = v;
+  }
+
+  /**
+   * @brief Gets the slots, which get invalidated by the next add_binding
+   */
+  [[nodiscard]] auto slots() noexcept -> Value*
+  {
+    return slots_.data();
+  }
+
+  /// @brief Gets the number of slots
+  [[nodiscard]] auto slot_count() const noexcept -> std::size_t
+  {
+    return slots_.size();
+  }
+
+  [[nodiscard]] auto name() const noexcept -> const std::string&
+  {
+    return name_;
   }
 
 private:
+  void mark_roots(GarbageCollector& gc) override
+  {
+    for (auto& v : slots_) {
+      mark(gc, v);
+    }
+  }
+
   std::string name_;
-  SymbolTable global_env_;
+  std::reference_wrapper<GarbageCollector> garbage_collector_;
+  // The slots of the identifiers that the module binds, keyed by symbol ids,
+  // which are shared by every module of the program
+  std::unordered_map<Symbol::Id, Slot> bindings_;
+  std::vector<Type> types_;
+  std::vector<Generation> generations_;
+  std::vector<Value> slots_;
+};
+
+/**
+ * @brief Thrown by the vm when it runs code compiled against a slot whose type
+ * has changed since, or that inlined the value of a slot that got rebound
+ */
+class StaleCodeError : public std::runtime_error {
+public:
+  using std::runtime_error::runtime_error;
+};
+
+/**
+ * @brief The slots of a module that a chunk uses
+ *
+ * The chunk shares the ownership of the module with the compiler, so the
+ * chunk stays runnable after the compiler is gone. It still must not outlive
+ * the garbage collector of the compiler.
+ */
+struct ModuleLink {
+  std::shared_ptr<Module> module;
+  /// The slots that the chunk uses, with the types it got compiled against
+  std::vector<std::pair<Module::Slot, Type>> types;
+  /// The slots whose values the chunk inlined, with their generations then
+  std::vector<std::pair<Module::Slot, Module::Generation>> inlined;
+
+  /// @brief Records that the chunk uses the slot of binding in m
+  void use(const std::shared_ptr<Module>& m, Module::Binding binding)
+  {
+    link(m);
+    if (!contains(types, binding.slot)) {
+      types.emplace_back(binding.slot, binding.type);
+    }
+  }
+
+  /// @brief Records that the chunk inlined the current value of slot in m
+  void inline_value(const std::shared_ptr<Module>& m, Module::Slot slot)
+  {
+    link(m);
+    if (!contains(inlined, slot)) {
+      inlined.emplace_back(slot, m->generation(slot));
+    }
+  }
+
+  /// @brief Records the slots that other records as well
+  void merge(const ModuleLink& other)
+  {
+    if (other.module == nullptr) {
+      return;
+    }
+    for (const auto& [slot, type] : other.types) {
+      use(other.module, Module::Binding{type, slot});
+    }
+    for (const auto& entry : other.inlined) {
+      link(other.module);
+      if (!contains(inlined, entry.first)) {
+        inlined.push_back(entry);
+      }
+    }
+  }
+
+  /**
+   * @brief Gets the slots for a run of the chunk
+   * @throw StaleCodeError if the type of a slot that the chunk uses changed,
+   * or a slot whose value the chunk inlined got rebound
+   * @return nullptr if the chunk uses no slots
+   */
+  [[nodiscard]] auto slots() const -> Value*
+  {
+    if (module == nullptr) {
+      return nullptr;
+    }
+    for (const auto& [slot, type] : types) {
+      if (module->type(slot) != type) {
+        throw StaleCodeError{
+            "EML: The code is stale, since a global it uses got redefined "
+            "with another type"};
+      }
+    }
+    for (const auto& [slot, generation] : inlined) {
+      if (module->generation(slot) != generation) {
+        throw StaleCodeError{
+            "EML: The code is stale, since a global whose value it inlined "
+            "got redefined"};
+      }
+    }
+    return module->slots();
+  }
+
+private:
+  void link(const std::shared_ptr<Module>& m)
+  {
+    EML_ASSERT(module == nullptr || module == m,
+               "A chunk can only be linked to one module");
+    module = m;
+  }
+
+  template <typename T>
+  static auto contains(const std::vector<std::pair<Module::Slot, T>>& entries,
+                       Module::Slot slot) -> bool
+  {
+    return std::any_of(
+        entries.begin(), entries.end(),
+        [slot](const auto& entry) { return entry.first == slot; });
+  }
 };
 
 } // namespace eml
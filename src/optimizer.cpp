@@ -0,0 +1,202 @@
+#include "ast.hpp"
+#include "compiler.hpp"
+#include "string.hpp"
+
+#include <functional>
+#include <memory>
+#include <utility>
+
+namespace eml {
+
+namespace {
+
+// Replaces every expression whose value is known at compile time by a literal
+// of that value. The type checker already resolved identifiers to the values of
+// globals, but only the values of definitions and the code that inlines
+// globals fold them, since code reads the globals at run time otherwise. The
+// slots of the globals that get folded are recorded in inlined, if any.
+struct ConstantFolder : AstVisitor {
+  ConstantFolder(GarbageCollector& gc, Arena& arena, bool fold_globals,
+                 const std::shared_ptr<Module>& module,
+                 ModuleLink* inlined = nullptr)
+      : gc_{gc}, arena_{arena}, fold_globals_{fold_globals}, module_{module},
+        inlined_{inlined}
+  {
+  }
+
+  // Folds the node that node points to, and returns its value if it is a
+  // constant expression. The nodes that get replaced stay in the arena until
+  // the AST gets destroyed. The result is cleared once the fold returns, so an
+  // expression that does not fold never takes the result of an operand.
+  template <typename Node> auto fold(Node*& node) -> std::optional<Value>
+  {
+    node->accept(*this);
+    if (replacement_ != nullptr) {
+      node = std::exchange(replacement_, nullptr);
+    }
+    return std::exchange(constant_, std::nullopt);
+  }
+
+  // Sets the result of the expression that is visiting to the constant v
+  void fold_to(Value v, const Type& type)
+  {
+    constant_ = v;
+    replacement_ = LiteralExpr::create(arena_, v, type);
+  }
+
+  void operator()(LiteralExpr& expr) override
+  {
+    constant_ = expr.value();
+  }
+
+  void operator()(IdentifierExpr& expr) override
+  {
+    if (const auto v = expr.value(); v && fold_globals_) {
+      fold_to(*v, expr.type());
+      if (inlined_ != nullptr) {
+        inlined_->inline_value(module_, module_->find(expr.symbol())->slot);
+      }
+    }
+  }
+
+  // The operands that got folded are already replaced in place, so the
+  // expression itself is only replaced if it folds as well
+  template <typename F> void unary_common(UnaryOpExpr& expr, F f)
+  {
+    if (const auto operand = fold(expr.operand_ptr()); operand) {
+      fold_to(f(*operand), expr.type());
+    }
+  }
+
+  void operator()(UnaryNegateExpr& expr) override
+  {
+    unary_common(expr,
+                 [](Value v) { return Value{-v.unsafe_as_number()}; });
+  }
+
+  void operator()(UnaryNotExpr& expr) override
+  {
+    unary_common(expr,
+                 [](Value v) { return Value{!v.unsafe_as_boolean()}; });
+  }
+
+  template <typename F> void binary_common(BinaryOpExpr& expr, F f)
+  {
+    const auto lhs = fold(expr.lhs_ptr());
+    const auto rhs = fold(expr.rhs_ptr());
+    if (lhs && rhs) {
+      fold_to(f(*lhs, *rhs), expr.type());
+    }
+  }
+
+  // Folds a binary operation on two numbers
+  template <typename F> void arithmetic_common(BinaryOpExpr& expr, F f)
+  {
+    binary_common(expr, [f](Value lhs, Value rhs) {
+      return Value{f(lhs.unsafe_as_number(), rhs.unsafe_as_number())};
+    });
+  }
+
+  void operator()(PlusOpExpr& expr) override
+  {
+    arithmetic_common(expr, std::plus<double>{});
+  }
+  void operator()(MinusOpExpr& expr) override
+  {
+    arithmetic_common(expr, std::minus<double>{});
+  }
+  void operator()(MultOpExpr& expr) override
+  {
+    arithmetic_common(expr, std::multiplies<double>{});
+  }
+  void operator()(DivOpExpr& expr) override
+  {
+    arithmetic_common(expr, std::divides<double>{});
+  }
+
+  void operator()(AppendOpExpr& expr) override
+  {
+    // The literals of the operands pin them while the result get allocated
+    binary_common(expr, [this](Value lhs, Value rhs) {
+      return Value{string_cat(lhs.unsafe_as_reference(),
+                              rhs.unsafe_as_reference(), gc_)};
+    });
+  }
+
+  void operator()(EqOpExpr& expr) override
+  {
+    binary_common(expr, [](Value lhs, Value rhs) { return Value{lhs == rhs}; });
+  }
+  void operator()(NeqOpExpr& expr) override
+  {
+    binary_common(expr, [](Value lhs, Value rhs) { return Value{lhs != rhs}; });
+  }
+  void operator()(LessOpExpr& expr) override
+  {
+    arithmetic_common(expr, std::less<double>{});
+  }
+  void operator()(LeOpExpr& expr) override
+  {
+    arithmetic_common(expr, std::less_equal<double>{});
+  }
+  void operator()(GreaterOpExpr& expr) override
+  {
+    arithmetic_common(expr, std::greater<double>{});
+  }
+  void operator()(GeExpr& expr) override
+  {
+    arithmetic_common(expr, std::greater_equal<double>{});
+  }
+
+  void operator()(IfExpr& expr) override
+  {
+    const auto cond = fold(expr.cond_ptr());
+    if (!cond) {
+      fold(expr.if_ptr());
+      fold(expr.else_ptr());
+      return;
+    }
+
+    // Only the branch that gets taken remains
+    auto& branch =
+        cond->unsafe_as_boolean() ? expr.if_ptr() : expr.else_ptr();
+    const auto v = fold(branch);
+    replacement_ = branch;
+    constant_ = v;
+  }
+
+  void operator()(LambdaExpr& /*expr*/) override {} // no-op
+
+  void operator()(Definition& def) override
+  {
+    fold(def.to_ptr());
+  }
+
+private:
+  std::reference_wrapper<GarbageCollector> gc_;
+  std::reference_wrapper<Arena> arena_;
+  bool fold_globals_;
+  const std::shared_ptr<Module>& module_;
+  ModuleLink* inlined_;
+  std::optional<Value> constant_;
+  Expr_ptr replacement_ = nullptr;
+};
+
+} // anonymous namespace
+
+auto Compiler::optimize(Ast& ast) const -> ModuleLink
+{
+  ModuleLink inlined;
+  ConstantFolder folder{garbage_collector_, ast.arena(),
+                        options_.inline_globals, module_, &inlined};
+  folder.fold(ast.root_ptr());
+  return inlined;
+}
+
+void Compiler::optimize(Expr_ptr& expr, Arena& arena) const
+{
+  ConstantFolder folder{garbage_collector_, arena, true, module_};
+  folder.fold(expr);
+}
+
+} // namespace eml
@@ -25,7 +25,7 @@ class ErrorExpr final : public Expr, public FactoryMixin<ErrorExpr> {
 };
 
 struct Parser;
-auto parse_toplevel(Parser& parser) -> std::unique_ptr<AstNode>;
+auto parse_toplevel(Parser& parser) -> AstNode*;
 auto parse_expression(Parser& parser) -> Expr_ptr;
 
 struct Parser {
@@ -40,6 +40,7 @@ struct Parser {
   eml::Token previous;
   std::vector<CompilationError> errors;
   std::reference_wrapper<GarbageCollector> garbage_collector;
+  Arena arena; // Owns all the nodes of the AST
 
   bool had_error = false;
   bool panic_mode = false; // Ignore errors if in panic
@@ -217,13 +218,13 @@ auto parse_branch(Parser& parser) -> Expr_ptr
 
   auto Else = parse_expression(parser);
 
-  return IfExpr::create(std::move(cond), std::move(If), std::move(Else));
+  return IfExpr::create(parser.arena, cond, If, Else);
 }
 
 auto parse_number(Parser& parser) -> Expr_ptr
 {
   const double number = strtod(parser.previous.text.data(), nullptr);
-  return LiteralExpr::create(Value{number}, NumberType{});
+  return LiteralExpr::create(parser.arena, Value{number}, NumberType{});
 }
 
 auto parse_string(Parser& parser) -> Expr_ptr
@@ -233,10 +234,10 @@ auto parse_string(Parser& parser) -> Expr_ptr
   text.remove_suffix(1);
 
   auto s_obj = eml::make_string(text, parser.garbage_collector);
-  return LiteralExpr::create(Value{s_obj}, StringType{});
+  return LiteralExpr::create(parser.arena, Value{s_obj}, StringType{});
 }
 
-auto parse_definition(Parser& parser) -> std::unique_ptr<AstNode>
+auto parse_definition(Parser& parser) -> AstNode*
 {
   parser.advance();
   const auto id = parser.current_itr->text;
@@ -246,25 +247,25 @@ auto parse_definition(Parser& parser) -> std::unique_ptr<AstNode>
 
   parser.advance();
 
-  return Definition::create(id, std::move(expr));
+  return Definition::create(parser.arena, Symbol{id}, expr);
 }
 
-auto parse_identifier(Parser& parser) -> std::unique_ptr<Expr>
+auto parse_identifier(Parser& parser) -> Expr_ptr
 {
-  return IdentifierExpr::create(std::string{parser.previous.text});
+  return IdentifierExpr::create(parser.arena, Symbol{parser.previous.text});
 }
 
 auto parse_literal(Parser& parser) -> Expr_ptr
 {
   switch (parser.previous.type) {
   case token_type::keyword_unit:
-    return LiteralExpr::create(Value{}, UnitType{});
+    return LiteralExpr::create(parser.arena, Value{}, UnitType{});
 
   case token_type::keyword_true:
-    return LiteralExpr::create(Value{true}, BoolType{});
+    return LiteralExpr::create(parser.arena, Value{true}, BoolType{});
 
   case token_type::keyword_false:
-    return LiteralExpr::create(Value{false}, BoolType{});
+    return LiteralExpr::create(parser.arena, Value{false}, BoolType{});
 
   default:
     EML_UNREACHABLE();
@@ -278,13 +279,13 @@ auto parse_precedence(Parser& parser, Precedence precedence) -> Expr_ptr
 
   if (parser.previous.type == token_type::error) {
     parser.error_at_previous(std::string{parser.previous.text});
-    return ErrorExpr::create();
+    return ErrorExpr::create(parser.arena);
   }
 
   const auto prefix_rule = get_rule(parser.previous.type).prefix;
   if (prefix_rule == nullptr) {
     parser.error_at_previous("expect a prefix operator");
-    return ErrorExpr::create();
+    return ErrorExpr::create(parser.arena);
   }
 
   auto left_ptr = prefix_rule(parser);
@@ -294,15 +295,15 @@ auto parse_precedence(Parser& parser, Precedence precedence) -> Expr_ptr
     const auto infix_rule = get_rule(parser.previous.type).infix;
     if (infix_rule == nullptr) {
       parser.error_at_previous("expect a infix operator");
-      return ErrorExpr::create();
+      return ErrorExpr::create(parser.arena);
     }
-    left_ptr = infix_rule(parser, std::move(left_ptr));
+    left_ptr = infix_rule(parser, left_ptr);
   }
 
   return left_ptr;
 }
 
-auto parse_toplevel(Parser& parser) -> std::unique_ptr<AstNode>
+auto parse_toplevel(Parser& parser) -> AstNode*
 {
   switch (parser.current_itr->type) {
   case token_type::keyword_let:
@@ -333,7 +334,7 @@ auto parse_lambda(Parser& parser) -> Expr_ptr
 
   auto expr_ptr = parse_expression(parser);
 
-  return LambdaExpr::create(std::move(args), std::move(expr_ptr));
+  return LambdaExpr::create(parser.arena, std::move(args), expr_ptr);
 }
 
 auto parse_unary(Parser& parser) -> Expr_ptr
@@ -346,9 +347,9 @@ auto parse_unary(Parser& parser) -> Expr_ptr
   // Emit the operator instruction.
   switch (operator_type) {
   case token_type::bang:
-    return UnaryNotExpr::create(std::move(operand_ptr));
+    return UnaryNotExpr::create(parser.arena, operand_ptr);
   case token_type::minus:
-    return UnaryNegateExpr::create(std::move(operand_ptr));
+    return UnaryNegateExpr::create(parser.arena, operand_ptr);
   default:
     EML_UNREACHABLE();
   }
@@ -367,36 +368,36 @@ auto parse_binary(Parser& parser, Expr_ptr left_ptr) -> Expr_ptr
   // Emit the operator instruction.
   switch (operator_type) {
   case token_type::plus:
-    return PlusOpExpr::create(std::move(left_ptr), std::move(rhs_ptr));
+    return PlusOpExpr::create(parser.arena, left_ptr, rhs_ptr);
   case token_type::minus:
-    return MinusOpExpr::create(std::move(left_ptr), std::move(rhs_ptr));
+    return MinusOpExpr::create(parser.arena, left_ptr, rhs_ptr);
 
   case token_type::star:
-    return MultOpExpr::create(std::move(left_ptr), std::move(rhs_ptr));
+    return MultOpExpr::create(parser.arena, left_ptr, rhs_ptr);
 
   case token_type::slash:
-    return DivOpExpr::create(std::move(left_ptr), std::move(rhs_ptr));
+    return DivOpExpr::create(parser.arena, left_ptr, rhs_ptr);
 
   case token_type::double_equal:
-    return EqOpExpr::create(std::move(left_ptr), std::move(rhs_ptr));
+    return EqOpExpr::create(parser.arena, left_ptr, rhs_ptr);
 
   case token_type::bang_equal:
-    return NeqOpExpr::create(std::move(left_ptr), std::move(rhs_ptr));
+    return NeqOpExpr::create(parser.arena, left_ptr, rhs_ptr);
 
   case token_type::less:
-    return LessOpExpr::create(std::move(left_ptr), std::move(rhs_ptr));
+    return LessOpExpr::create(parser.arena, left_ptr, rhs_ptr);
 
   case token_type::less_equal:
-    return LeOpExpr::create(std::move(left_ptr), std::move(rhs_ptr));
+    return LeOpExpr::create(parser.arena, left_ptr, rhs_ptr);
 
   case token_type::greator:
-    return GreaterOpExpr::create(std::move(left_ptr), std::move(rhs_ptr));
+    return GreaterOpExpr::create(parser.arena, left_ptr, rhs_ptr);
 
   case token_type::greater_equal:
-    return GeExpr::create(std::move(left_ptr), std::move(rhs_ptr));
+    return GeExpr::create(parser.arena, left_ptr, rhs_ptr);
 
   case token_type::plus_plus:
-    return AppendOpExpr::create(std::move(left_ptr), std::move(rhs_ptr));
+    return AppendOpExpr::create(parser.arena, left_ptr, rhs_ptr);
 
   default:
     EML_UNREACHABLE();
@@ -431,7 +432,7 @@ auto parse(std::string_view source, GarbageCollector& gc) -> ParseResult
   if constexpr (eml::BuildOptions::debug_print_ast) {
     std::cout << eml::to_string(*expr) << '\n';
   }
-  return expr;
+  return Ast{std::move(parser.arena), expr};
 }
 
 } // namespace eml
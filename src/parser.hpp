@@ -1,10 +1,10 @@
 #ifndef EML_PARSER_HPP
 #define EML_PARSER_HPP
 
-#include <memory>
 #include <optional>
 #include <string_view>
 
+#include "ast.hpp"
 #include "error.hpp"
 #include "expected.hpp"
 #include "memory.hpp"
@@ -17,10 +17,7 @@
 
 namespace eml {
 
-struct AstNode;
-
-using ParseResult =
-    expected<std::unique_ptr<AstNode>, std::vector<CompilationError>>;
+using ParseResult = expected<Ast, std::vector<CompilationError>>;
 
 auto parse(std::string_view source, GarbageCollector& gc) -> ParseResult;
 
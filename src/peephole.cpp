@@ -0,0 +1,173 @@
+#include "bytecode.hpp"
+
+namespace eml {
+
+namespace {
+
+// Applies one round of rewrites, returns whether anything changed
+auto rewrite(std::vector<DecodedInstruction>& instructions) -> bool
+{
+  const auto count = instructions.size();
+  std::vector<bool> is_target(count + 1);
+  for (const auto& instruction : instructions) {
+    if (is_jump(instruction.op)) {
+      is_target[instruction.operand] = true;
+    }
+  }
+
+  bool changed = false;
+  std::vector<bool> removed(count);
+  const auto remove = [&](std::size_t i) {
+    removed[i] = true;
+    changed = true;
+  };
+
+  for (std::size_t i = 0; i < count; ++i) {
+    auto& instruction = instructions[i];
+
+    if (is_jump(instruction.op)) {
+      // Jumps to unconditional jumps go to their final targets directly. All
+      // jumps go forward, so the chains end.
+      while (instruction.operand < count &&
+             instructions[instruction.operand].op == op_jmp) {
+        instruction.operand = instructions[instruction.operand].operand;
+        changed = true;
+      }
+
+      // A jump to the next instruction does nothing besides its pops
+      if (instruction.operand == i + 1) {
+        if (instruction.op == op_jmp) {
+          remove(i);
+        } else if (stack_effect(instruction.op) == -1) {
+          instruction.op = op_pop;
+          changed = true;
+        }
+        continue;
+      }
+    }
+
+    // The rest are pairs, whose second instruction must not be a jump target.
+    // Jumps to the first one still run the rewritten pair.
+    if (i + 1 >= count || is_target[i + 1]) {
+      continue;
+    }
+    auto& next = instructions[i + 1];
+    const auto remove_pair = [&]() {
+      remove(i);
+      remove(i + 1);
+      ++i;
+    };
+    const auto replace_pair_by = [&](opcode op) {
+      remove(i);
+      next.op = op;
+      ++i;
+    };
+
+    if (next.op == op_jmp_false || next.op == op_jmp_true) {
+      const bool jumps_on = next.op == op_jmp_true;
+      if (instruction.op == op_not) {
+        replace_pair_by(jumps_on ? op_jmp_false : op_jmp_true);
+      } else if (instruction.op == op_true || instruction.op == op_false) {
+        if ((instruction.op == op_true) == jumps_on) {
+          replace_pair_by(op_jmp);
+        } else {
+          remove_pair();
+        }
+      }
+    } else if (instruction.op == next.op &&
+               (instruction.op == op_negate_f64 || instruction.op == op_not)) {
+      remove_pair();
+    }
+  }
+
+  if (!changed) {
+    return false;
+  }
+
+  // Jumps to a removed instruction go to the next one that remains, whose new
+  // index is the number of remaining instructions before it
+  std::vector<std::size_t> new_index(count + 1);
+  for (std::size_t i = 0; i < count; ++i) {
+    new_index[i + 1] = new_index[i] + (removed[i] ? 0 : 1);
+  }
+
+  std::vector<DecodedInstruction> result;
+  for (std::size_t i = 0; i < count; ++i) {
+    if (!removed[i]) {
+      auto instruction = instructions[i];
+      if (is_jump(instruction.op)) {
+        instruction.operand = new_index[instruction.operand];
+      }
+      result.push_back(instruction);
+    }
+  }
+  instructions = std::move(result);
+  return true;
+}
+
+// Writes the instructions back, and picks the wide operand variant for the
+// jumps whose offset does not fit in a byte
+void encode(const std::vector<DecodedInstruction>& instructions, Bytecode& code)
+{
+  std::vector<bool> is_long(instructions.size());
+  std::vector<std::size_t> start(instructions.size() + 1);
+
+  // Widening a jump only moves the later instructions further away, so this
+  // converges
+  for (bool changed = true; changed;) {
+    changed = false;
+    for (std::size_t i = 0; i < instructions.size(); ++i) {
+      const auto op = is_long[i] ? long_jump_of(instructions[i].op)
+                                 : instructions[i].op;
+      start[i + 1] = start[i] + static_cast<std::size_t>(instruction_size(op));
+    }
+    for (std::size_t i = 0; i < instructions.size(); ++i) {
+      if (is_jump(instructions[i].op) && !is_long[i] &&
+          start[instructions[i].operand] - start[i + 1] > max_short_operand) {
+        is_long[i] = true;
+        changed = true;
+      }
+    }
+  }
+
+  code.clear_instructions();
+  for (std::size_t i = 0; i < instructions.size(); ++i) {
+    const auto& [op, operand, line] = instructions[i];
+    if (is_jump(op)) {
+      const auto jump_by = start[operand] - start[i + 1];
+      if (is_long[i]) {
+        code.write(std::byte{long_jump_of(op)}, line);
+        code.write_long_operand(jump_by, line);
+      } else {
+        code.write(std::byte{op}, line);
+        code.write(static_cast<std::byte>(jump_by), line);
+      }
+      continue;
+    }
+
+    // Writes the opcode as a byte, since the stack height stays the same
+    code.write(std::byte{op}, line);
+    const auto operand_size = instruction_size(op) - 1;
+    if (operand_size == long_operand_size) {
+      code.write_long_operand(operand, line);
+    } else if (operand_size == 1) {
+      code.write(static_cast<std::byte>(operand), line);
+    }
+  }
+}
+
+} // anonymous namespace
+
+void peephole_optimize(Bytecode& code)
+{
+  auto instructions = code.decode();
+  bool changed = false;
+  while (rewrite(instructions)) {
+    changed = true;
+  }
+  if (changed) {
+    encode(instructions, code);
+  }
+}
+
+} // namespace eml
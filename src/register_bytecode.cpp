@@ -0,0 +1,138 @@
+#include <iomanip>
+#include <sstream>
+#include <string_view>
+
+#include "register_bytecode.hpp"
+
+namespace eml {
+
+namespace {
+
+auto register_opcode_name(register_opcode op) -> std::string_view
+{
+  switch (op) {
+  case rop_return:
+    return "return";
+  case rop_move:
+    return "move";
+  case rop_true:
+    return "load<true>";
+  case rop_false:
+    return "load<false>";
+  case rop_unit:
+    return "load<unit>";
+  case rop_negate_f64:
+    return "negate<f64>";
+  case rop_not:
+    return "not";
+  case rop_add_f64:
+    return "add<f64>";
+  case rop_subtract_f64:
+    return "sub<f64>";
+  case rop_multiply_f64:
+    return "mult<f64>";
+  case rop_divide_f64:
+    return "div<f64>";
+  case rop_string_cat:
+    return "string_cat";
+  case rop_equal:
+    return "eq";
+  case rop_not_equal:
+    return "ne";
+  case rop_less_f64:
+    return "lt<f64>";
+  case rop_less_equal_f64:
+    return "le<f64>";
+  case rop_greater_f64:
+    return "gt<f64>";
+  case rop_greater_equal_f64:
+    return "ge<f64>";
+  case rop_get_global:
+    return "get_global";
+  case rop_set_global:
+    return "set_global";
+  case rop_jmp:
+    return "jump";
+  case rop_jmp_false:
+    return "jump_false";
+  case rop_jmp_if_not_equal:
+    return "jump_if_not_equal";
+  case rop_jmp_if_equal:
+    return "jump_if_equal";
+  case rop_jmp_if_not_less_f64:
+    return "jump_if_not_less<f64>";
+  case rop_jmp_if_not_less_equal_f64:
+    return "jump_if_not_less_equal<f64>";
+  case rop_jmp_if_not_greater_f64:
+    return "jump_if_not_greater<f64>";
+  case rop_jmp_if_not_greater_equal_f64:
+    return "jump_if_not_greater_equal<f64>";
+  }
+
+  return ""; // Unreachable
+}
+
+} // anonymous namespace
+
+auto RegisterBytecode::disassemble_instruction(std::size_t index) const
+    -> std::string
+{
+  std::stringstream ss;
+
+  // Constants are printed as k<index>, and temporaries as r<index>
+  const auto print_register = [&](register_index r) {
+    if (r < constants.size()) {
+      ss << 'k' << r;
+    } else {
+      ss << 'r' << r;
+    }
+  };
+
+  constexpr std::size_t index_digits = 4;
+  const auto& instruction = instructions[index];
+  ss << std::setfill('0') << std::setw(index_digits) << index << "    "
+     << register_opcode_name(instruction.op);
+
+  const auto [uses_dest, uses_lhs, uses_rhs] =
+      register_operands(instruction.op);
+  const char* separator = " ";
+  for (const auto& [used, r] : {std::pair{uses_dest, instruction.dest},
+                                std::pair{uses_lhs, instruction.lhs},
+                                std::pair{uses_rhs, instruction.rhs}}) {
+    if (used) {
+      ss << separator;
+      print_register(r);
+      separator = ", ";
+    }
+  }
+
+  if (is_register_jump(instruction.op)) {
+    ss << separator << instruction.target;
+  } else if (is_register_global(instruction.op)) {
+    ss << separator << "slot " << instruction.target;
+  }
+
+  return ss.str();
+}
+
+auto RegisterBytecode::disassemble() const -> std::string
+{
+  std::stringstream ss;
+
+  for (std::size_t i = 0; i < constants.size(); ++i) {
+    const auto& constant = constants[i];
+    ss << 'k' << i << " = "
+       << (constant.is_reference()
+               ? to_string(StringType{}, constant, PrintType::no)
+               : to_string(NumberType{}, constant, PrintType::no))
+       << '\n';
+  }
+
+  for (std::size_t i = 0; i < instructions.size(); ++i) {
+    ss << disassemble_instruction(i) << '\n';
+  }
+
+  return ss.str();
+}
+
+} // namespace eml
@@ -0,0 +1,177 @@
+#ifndef EML_REGISTER_BYTECODE_HPP
+#define EML_REGISTER_BYTECODE_HPP
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <variant>
+#include <vector>
+
+#include "bytecode.hpp"
+
+/**
+ * @file register_bytecode.hpp This file contains the representation of the
+ * code of the register backend
+ */
+
+namespace eml {
+
+/**
+ * @brief The instruction set of the register backend of the Embedded ML vm
+ */
+enum register_opcode : std::uint8_t {
+#define REGISTER_OPCODE_TABLE_ENTRY(op, dest, lhs, rhs) op,
+#include "register_opcode_table.inc"
+#undef REGISTER_OPCODE_TABLE_ENTRY
+};
+
+/// @brief The index of a register
+using register_index = std::uint16_t;
+
+/// @brief The largest number of registers of a chunk of register code
+constexpr std::size_t max_register_count = 0x10000;
+
+/**
+ * @brief A three-address instruction of the register backend
+ *
+ * The operands that an instruction does not use are zero.
+ */
+struct RegisterInstruction {
+  register_opcode op;
+  register_index dest = 0;
+  register_index lhs = 0;
+  register_index rhs = 0;
+  /// The index of the instruction that a jump goes to, or the slot of a global
+  std::uint32_t target = 0;
+};
+
+/**
+ * @brief Returns whether the instruction op uses its dest, lhs and rhs
+ * operands, in that order
+ */
+constexpr auto register_operands(register_opcode op) noexcept
+    -> std::array<bool, 3>
+{
+  switch (op) {
+#define REGISTER_OPCODE_TABLE_ENTRY(op, dest, lhs, rhs)                        \
+  case op:                                                                     \
+    return {dest != 0, lhs != 0, rhs != 0};
+#include "register_opcode_table.inc"
+#undef REGISTER_OPCODE_TABLE_ENTRY
+  }
+
+  return {}; // Unreachable
+}
+
+/**
+ * @brief Returns whether op is a jump, which uses its target operand
+ */
+constexpr auto is_register_jump(register_opcode op) noexcept -> bool
+{
+  return op >= rop_jmp;
+}
+
+/**
+ * @brief Returns whether op reads or writes a global, whose slot is the target
+ * operand
+ */
+constexpr auto is_register_global(register_opcode op) noexcept -> bool
+{
+  return op == rop_get_global || op == rop_set_global;
+}
+
+/**
+ * @brief A chunk of code of the register backend
+ *
+ * The registers of a chunk start with one register for each constant, which
+ * the vm loads before the execution, followed by the temporaries. The
+ * instructions read constants as registers, so constants need no instruction
+ * to load them.
+ */
+struct RegisterBytecode {
+  std::vector<RegisterInstruction> instructions;
+  std::vector<Value> constants;
+  /// The number of registers, including the ones of the constants
+  std::size_t register_count = 0;
+  /// The module whose slots the global instructions of the chunk refer to
+  ModuleLink globals;
+
+  // The chunk pins the objects in its constant pool, so that they outlive
+  // collections for as long as the chunk exists
+  RegisterBytecode() = default;
+
+  ~RegisterBytecode()
+  {
+    for (const auto& constant : constants) {
+      unpin(constant);
+    }
+  }
+
+  RegisterBytecode(const RegisterBytecode& other)
+      : instructions{other.instructions}, constants{other.constants},
+        register_count{other.register_count}, globals{other.globals},
+        constant_index_{other.constant_index_}
+  {
+    for (const auto& constant : constants) {
+      pin(constant);
+    }
+  }
+
+  RegisterBytecode(RegisterBytecode&& other) noexcept
+      : instructions{std::move(other.instructions)},
+        constants{std::move(other.constants)},
+        register_count{other.register_count},
+        globals{std::move(other.globals)},
+        constant_index_{std::move(other.constant_index_)}
+  {
+    other.constants.clear();
+  }
+
+  auto operator=(RegisterBytecode other) noexcept -> RegisterBytecode&
+  {
+    swap(*this, other);
+    return *this;
+  }
+
+  friend void swap(RegisterBytecode& lhs, RegisterBytecode& rhs) noexcept
+  {
+    using std::swap;
+    swap(lhs.instructions, rhs.instructions);
+    swap(lhs.constants, rhs.constants);
+    swap(lhs.register_count, rhs.register_count);
+    swap(lhs.globals, rhs.globals);
+    swap(lhs.constant_index_, rhs.constant_index_);
+  }
+
+  /**
+   * @brief Adds a constant value v to the chunk and returns its index
+   *
+   * A constant that is already in the chunk is not appended again, and its
+   * existing index is returned instead, see ConstantIndex.
+   */
+  [[nodiscard]] auto add_constant(Value v) -> std::size_t
+  {
+    if (const auto index = constant_index_.find(v); index) {
+      return *index;
+    }
+    constants.push_back(v);
+    pin(v);
+    constant_index_.insert(v, constants.size() - 1);
+    return constants.size() - 1;
+  }
+
+  auto disassemble() const -> std::string;
+  auto disassemble_instruction(std::size_t index) const -> std::string;
+
+private:
+  ConstantIndex constant_index_;
+};
+
+/**
+ * @brief The code of a program for either backend of the vm
+ */
+using Program = std::variant<Bytecode, RegisterBytecode>;
+
+} // namespace eml
+
+#endif // EML_REGISTER_BYTECODE_HPP
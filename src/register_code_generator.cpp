@@ -0,0 +1,310 @@
+#include <sstream>
+
+#include "ast.hpp"
+#include "compiler.hpp"
+
+namespace eml {
+
+namespace {
+
+// A register operand of an instruction that is being generated. Temporaries
+// come after the constants, so their indices are only known once the whole
+// chunk is generated.
+struct Operand {
+  bool is_constant = false;
+  std::size_t index = 0;
+};
+
+struct PendingInstruction {
+  register_opcode op;
+  Operand dest;
+  Operand lhs;
+  Operand rhs;
+  std::size_t target = 0;
+};
+
+// The fused compare and branch instructions that jump if a comparison is
+// false, indexed by ComparisonOp
+constexpr register_opcode jumps_unless[] = {
+    rop_jmp_if_not_equal,
+    rop_jmp_if_equal,
+    rop_jmp_if_not_less_f64,
+    rop_jmp_if_not_less_equal_f64,
+    rop_jmp_if_not_greater_f64,
+    rop_jmp_if_not_greater_equal_f64,
+};
+
+// Generates register code. Temporaries are allocated like a stack: an
+// expression frees the temporaries of its operands after using them, and its
+// result goes to the lowest free temporary.
+struct RegisterCodeGenerator : AstConstVisitor {
+  RegisterCodeGenerator(RegisterBytecode& code,
+                        const std::shared_ptr<Module>& module)
+      : code_{code}, module_{module}
+  {
+  }
+
+  // Generates the code of expr, and returns the operand that holds its value
+  auto generate(const Expr& expr) -> Operand
+  {
+    expr.accept(*this);
+    return result_;
+  }
+
+  auto allocate() -> Operand
+  {
+    const Operand temporary{false, next_temporary_++};
+    temporary_count_ = std::max(temporary_count_, next_temporary_);
+    return temporary;
+  }
+
+  auto emit(register_opcode op, Operand dest = {}, Operand lhs = {},
+            Operand rhs = {}) -> std::size_t
+  {
+    pending_.push_back({op, dest, lhs, rhs});
+    return pending_.size() - 1;
+  }
+
+  void load_constant(Value v)
+  {
+    if (v.is_boolean()) {
+      result_ = allocate();
+      emit(v.unsafe_as_boolean() ? rop_true : rop_false, result_);
+    } else if (v.is_unit()) {
+      result_ = allocate();
+      emit(rop_unit, result_);
+    } else {
+      result_ = Operand{true, code_.add_constant(v)};
+    }
+  }
+
+  void operator()(const LiteralExpr& constant) override
+  {
+    load_constant(constant.value());
+  }
+
+  // Emits op on the slot of the global of identifier. Links the chunk to the
+  // module of the slot.
+  auto emit_global(register_opcode op, Symbol identifier, Operand dest = {},
+                   Operand lhs = {}) -> std::size_t
+  {
+    const auto binding = module_->find(identifier);
+    EML_ASSERT(binding.has_value(),
+               "Identifiers passed to the code generator are garanteed to be "
+               "bound");
+    code_.globals.use(module_, *binding);
+    const auto index = emit(op, dest, lhs);
+    pending_[index].target = binding->slot;
+    return index;
+  }
+
+  void operator()(const IdentifierExpr& id) override
+  {
+    result_ = allocate();
+    emit_global(rop_get_global, id.symbol(), result_);
+  }
+
+  void unary_common(const UnaryOpExpr& expr, register_opcode op)
+  {
+    const auto first_free = next_temporary_;
+    const auto operand = generate(expr.operand());
+    next_temporary_ = first_free;
+    result_ = allocate();
+    emit(op, result_, operand);
+  }
+
+  void operator()(const UnaryNegateExpr& expr) override
+  {
+    unary_common(expr, rop_negate_f64);
+  }
+
+  void operator()(const UnaryNotExpr& expr) override
+  {
+    unary_common(expr, rop_not);
+  }
+
+  void binary_common(const BinaryOpExpr& expr, register_opcode op)
+  {
+    const auto first_free = next_temporary_;
+    const auto lhs = generate(expr.lhs());
+    const auto rhs = generate(expr.rhs());
+    next_temporary_ = first_free;
+    result_ = allocate();
+    emit(op, result_, lhs, rhs);
+  }
+
+  void operator()(const PlusOpExpr& expr) override
+  {
+    binary_common(expr, rop_add_f64);
+  }
+  void operator()(const MinusOpExpr& expr) override
+  {
+    binary_common(expr, rop_subtract_f64);
+  }
+  void operator()(const MultOpExpr& expr) override
+  {
+    binary_common(expr, rop_multiply_f64);
+  }
+  void operator()(const DivOpExpr& expr) override
+  {
+    binary_common(expr, rop_divide_f64);
+  }
+
+  void operator()(const AppendOpExpr& expr) override
+  {
+    binary_common(expr, rop_string_cat);
+  }
+
+  void operator()(const EqOpExpr& expr) override
+  {
+    binary_common(expr, rop_equal);
+  }
+  void operator()(const NeqOpExpr& expr) override
+  {
+    binary_common(expr, rop_not_equal);
+  }
+  void operator()(const LessOpExpr& expr) override
+  {
+    binary_common(expr, rop_less_f64);
+  }
+  void operator()(const LeOpExpr& expr) override
+  {
+    binary_common(expr, rop_less_equal_f64);
+  }
+  void operator()(const GreaterOpExpr& expr) override
+  {
+    binary_common(expr, rop_greater_f64);
+  }
+  void operator()(const GeExpr& expr) override
+  {
+    binary_common(expr, rop_greater_equal_f64);
+  }
+
+  // The type checker rejects functions before code generation
+  void operator()(const LambdaExpr& /*expr*/) override
+  {
+    EML_UNREACHABLE();
+  }
+
+  // Generates the code of a branch, whose value goes to dest. The branch
+  // starts allocating from dest, so an expression that needs a temporary puts
+  // its value right there without a move.
+  void generate_branch(const Expr& branch, Operand dest)
+  {
+    next_temporary_ = dest.index;
+    const auto value = generate(branch);
+    if (value.is_constant || value.index != dest.index) {
+      emit(rop_move, dest, value);
+    }
+  }
+
+  void operator()(const IfExpr& expr) override
+  {
+    EML_ASSERT(eml::match(expr.cond().type(), BoolType{}),
+               "Type of condition must be boolean");
+    EML_ASSERT(eml::match(expr.If().type(), expr.Else().type()),
+               "Type of different branches must match");
+
+    const auto first_free = next_temporary_;
+    const auto else_jump = [&]() {
+      if (const auto op = comparison_of(expr.cond()); op) {
+        const auto& comparison = static_cast<const BinaryOpExpr&>(expr.cond());
+        const auto lhs = generate(comparison.lhs());
+        const auto rhs = generate(comparison.rhs());
+        return emit(jumps_unless[static_cast<std::size_t>(*op)], {}, lhs, rhs);
+      }
+      return emit(rop_jmp_false, {}, generate(expr.cond()));
+    }();
+
+    // The condition is no longer needed, so the result can take its place
+    next_temporary_ = first_free;
+    const auto dest = allocate();
+
+    generate_branch(expr.If(), dest);
+    const auto end_jump = emit(rop_jmp);
+    pending_[else_jump].target = pending_.size();
+
+    generate_branch(expr.Else(), dest);
+    pending_[end_jump].target = pending_.size();
+
+    next_temporary_ = dest.index + 1;
+    result_ = dest;
+  }
+
+  // The value of a definition is already folded, and gets stored again when the
+  // chunk runs, so running it restores the global
+  void operator()(const Definition& def) override
+  {
+    const auto first_free = next_temporary_;
+    const auto value = generate(def.to());
+    next_temporary_ = first_free;
+    emit_global(rop_set_global, def.symbol(), {}, value);
+  }
+
+  // Writes the pending instructions to the chunk, with the temporaries placed
+  // after the constants. Returns false if the registers do not fit in the
+  // register operands.
+  auto finish() -> bool
+  {
+    const auto constant_count = code_.constants.size();
+    code_.register_count = constant_count + temporary_count_;
+    if (code_.register_count > max_register_count) {
+      return false;
+    }
+
+    const auto register_of = [constant_count](Operand operand) {
+      const auto index =
+          operand.is_constant ? operand.index : constant_count + operand.index;
+      return static_cast<register_index>(index);
+    };
+
+    for (const auto& pending : pending_) {
+      const auto [uses_dest, uses_lhs, uses_rhs] =
+          register_operands(pending.op);
+      RegisterInstruction instruction{pending.op};
+      if (uses_dest) {
+        instruction.dest = register_of(pending.dest);
+      }
+      if (uses_lhs) {
+        instruction.lhs = register_of(pending.lhs);
+      }
+      if (uses_rhs) {
+        instruction.rhs = register_of(pending.rhs);
+      }
+      instruction.target = static_cast<std::uint32_t>(pending.target);
+      code_.instructions.push_back(instruction);
+    }
+    return true;
+  }
+
+  RegisterBytecode& code_; // Not null
+  const std::shared_ptr<Module>& module_;
+  std::vector<PendingInstruction> pending_;
+  Operand result_;
+  std::size_t next_temporary_ = 0;
+  std::size_t temporary_count_ = 0;
+};
+
+} // anonymous namespace
+
+auto Compiler::generate_register_code(const AstNode& node) const
+    -> RegisterCodeResult
+{
+  RegisterBytecode code;
+  RegisterCodeGenerator code_generator{code, module_};
+  node.accept(code_generator);
+  if (dynamic_cast<const Expr*>(&node) != nullptr) {
+    code_generator.emit(rop_return, {}, code_generator.result_);
+  }
+  if (!code_generator.finish()) {
+    std::stringstream ss;
+    ss << "The expression needs " << code.register_count
+       << " registers, but a chunk of register code has at most "
+       << max_register_count << '\n';
+    return unexpected{std::vector<CompilationError>{
+        CompilationError{std::in_place_type<CodeGenerationError>, ss.str()}}};
+  }
+  return std::tuple(code, node.type());
+}
+
+} // namespace eml
@@ -0,0 +1,647 @@
+#ifndef EML_STATIC_EVAL_HPP
+#define EML_STATIC_EVAL_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string_view>
+#include <type_traits>
+
+#include "scanner.hpp"
+
+/**
+ * @file static_eval.hpp
+ * @brief This file contains a constexpr compiler for the numeric and boolean
+ * subset of EML
+ *
+ * The subset has number and boolean literals, the arithmetic, comparison,
+ * equality, `!` and unary `-` operators, and if expressions. Other
+ * identifiers are number variables that get their values when the program
+ * runs.
+ *
+ * Every function here is constexpr, so a program that is compiled in a
+ * constant expression costs nothing at startup and its syntax and type errors
+ * fail the C++ build:
+ * @code
+ * constexpr auto area = eml::static_compile("if (r < 0) {0} else {3 * r * r}");
+ * static_assert(area(2.).as_number() == 12);
+ * static_assert(eml::static_eval("1 + 2 * 3").as_number() == 7);
+ * @endcode
+ *
+ * static_function() turns a program into C++ code without interpretation
+ * overhead.
+ */
+
+namespace eml {
+
+/**
+ * @brief Error raised when a static program does not compile, or runs with
+ * wrong arguments
+ *
+ * In a constant expression, throwing it is a C++ compile error instead.
+ */
+class StaticEvalError : public std::logic_error {
+public:
+  using std::logic_error::logic_error;
+};
+
+/// @brief The types of the static subset of EML
+enum class StaticType : std::uint8_t { number, boolean };
+
+/// @brief The result of a static program
+struct StaticValue {
+  StaticType type = StaticType::number;
+  double number = 0;
+  bool boolean = false;
+
+  /// @throw StaticEvalError if the value is not a number
+  constexpr auto as_number() const -> double
+  {
+    if (type != StaticType::number) {
+      throw StaticEvalError{"The static program does not return a number"};
+    }
+    return number;
+  }
+
+  /// @throw StaticEvalError if the value is not a boolean
+  constexpr auto as_boolean() const -> bool
+  {
+    if (type != StaticType::boolean) {
+      throw StaticEvalError{"The static program does not return a boolean"};
+    }
+    return boolean;
+  }
+};
+
+/// @brief The operations of the nodes of a static program
+enum class StaticOp : std::uint8_t {
+  number,
+  boolean,
+  variable,
+  negate,
+  logical_not,
+  add,
+  subtract,
+  multiply,
+  divide,
+  equal,
+  not_equal,
+  less,
+  less_equal,
+  greater,
+  greater_equal,
+  branch,
+};
+
+/**
+ * @brief A type checked program of the static subset of EML
+ *
+ * The nodes live in a fixed size array, because constant expressions cannot
+ * allocate, and the operands of a node always come before it.
+ */
+class StaticProgram {
+public:
+  static constexpr std::size_t max_nodes = 128;
+  static constexpr std::size_t max_variables = 8;
+  static constexpr std::size_t max_variable_name_size = 32;
+
+  struct Node {
+    StaticOp op = StaticOp::number;
+    StaticType type = StaticType::number;
+    double number = 0; // The number of a literal
+    // The operands, the variable index of a variable, or the value of a
+    // boolean literal
+    std::array<std::uint8_t, 3> operands = {};
+  };
+
+  /// @brief Gets the type of the result of the program
+  constexpr auto type() const noexcept -> StaticType
+  {
+    return nodes_[root()].type;
+  }
+
+  /// @brief Gets the index of the node of the result of the program
+  constexpr auto root() const noexcept -> std::size_t
+  {
+    return node_count_ - 1;
+  }
+
+  /// @brief Gets the node at index
+  constexpr auto node(std::size_t index) const -> const Node&
+  {
+    return nodes_[index];
+  }
+
+  /// @brief Gets the number of variables, which the program takes in order of
+  /// first appearance
+  constexpr auto variable_count() const noexcept -> std::size_t
+  {
+    return variable_count_;
+  }
+
+  /// @brief Gets the name of the variable at index
+  constexpr auto variable_name(std::size_t index) const -> std::string_view
+  {
+    const auto& name = variables_[index];
+    return {name.chars.data(), name.size};
+  }
+
+  /**
+   * @brief Runs the program with the values of its variables
+   * @throw StaticEvalError if the number of arguments is not variable_count()
+   */
+  template <typename... Args>
+  constexpr auto operator()(Args... args) const -> StaticValue
+  {
+    if (sizeof...(args) != variable_count_) {
+      throw StaticEvalError{
+          "The number of arguments does not match the static program"};
+    }
+    const std::array<double, sizeof...(args)> values = {
+        static_cast<double>(args)...};
+    return evaluate(root(), values.data());
+  }
+
+private:
+  friend class StaticCompiler;
+
+  std::array<Node, max_nodes> nodes_ = {};
+  std::size_t node_count_ = 0;
+  // The names are copied, so that the program does not refer to its source
+  struct VariableName {
+    std::array<char, max_variable_name_size> chars = {};
+    std::size_t size = 0;
+  };
+  std::array<VariableName, max_variables> variables_ = {};
+  std::size_t variable_count_ = 0;
+
+  constexpr auto evaluate(std::size_t index, const double* values) const
+      -> StaticValue
+  {
+    const auto& node = nodes_[index];
+    const auto number = [&](std::size_t i) {
+      return evaluate(node.operands[i], values).number;
+    };
+    const auto make_number = [](double v) {
+      return StaticValue{StaticType::number, v, false};
+    };
+    const auto make_boolean = [](bool b) {
+      return StaticValue{StaticType::boolean, 0, b};
+    };
+
+    switch (node.op) {
+    case StaticOp::number:
+      return make_number(node.number);
+    case StaticOp::boolean:
+      return make_boolean(node.operands[0] != 0);
+    case StaticOp::variable:
+      return make_number(values[node.operands[0]]);
+    case StaticOp::negate:
+      return make_number(-number(0));
+    case StaticOp::logical_not:
+      return make_boolean(!evaluate(node.operands[0], values).boolean);
+    case StaticOp::add:
+      return make_number(number(0) + number(1));
+    case StaticOp::subtract:
+      return make_number(number(0) - number(1));
+    case StaticOp::multiply:
+      return make_number(number(0) * number(1));
+    case StaticOp::divide:
+      return make_number(number(0) / number(1));
+    case StaticOp::equal:
+    case StaticOp::not_equal: {
+      const auto lhs = evaluate(node.operands[0], values);
+      const auto rhs = evaluate(node.operands[1], values);
+      const bool equal = lhs.type == StaticType::number
+                             ? lhs.number == rhs.number
+                             : lhs.boolean == rhs.boolean;
+      return make_boolean(node.op == StaticOp::equal ? equal : !equal);
+    }
+    case StaticOp::less:
+      return make_boolean(number(0) < number(1));
+    case StaticOp::less_equal:
+      return make_boolean(number(0) <= number(1));
+    case StaticOp::greater:
+      return make_boolean(number(0) > number(1));
+    case StaticOp::greater_equal:
+      return make_boolean(number(0) >= number(1));
+    case StaticOp::branch:
+      return evaluate(node.operands[evaluate(node.operands[0], values).boolean
+                                        ? 1
+                                        : 2],
+                      values);
+    }
+    EML_UNREACHABLE();
+  }
+};
+
+/**
+ * @brief The parser and type checker of static programs
+ *
+ * It follows the precedence of the parser of the compiler, see @ref
+ * precedence.
+ */
+class StaticCompiler {
+public:
+  constexpr explicit StaticCompiler(std::string_view source)
+      : current_{source}
+  {
+  }
+
+  constexpr auto compile() -> StaticProgram
+  {
+    parse_precedence(precedence_equality);
+    if (current_->type != token_type::eof) {
+      throw StaticEvalError{"Expect the end of the static program"};
+    }
+    return program_;
+  }
+
+private:
+  enum Precedence : std::uint8_t {
+    precedence_none,
+    precedence_equality,   // == !=
+    precedence_comparison, // < > <= >=
+    precedence_term,       // + -
+    precedence_factor,     // * /
+    precedence_unary,      // ! -
+  };
+
+  Scanner::iterator current_;
+  StaticProgram program_;
+
+  constexpr auto advance() -> Token
+  {
+    const auto token = *current_;
+    ++current_;
+    if (token.type == token_type::error) {
+      throw StaticEvalError{"Invalid token in the static program"};
+    }
+    return token;
+  }
+
+  constexpr void consume(token_type type, const char* message)
+  {
+    if (current_->type != type) {
+      throw StaticEvalError{message};
+    }
+    advance();
+  }
+
+  static constexpr auto infix_precedence(token_type type) noexcept
+      -> Precedence
+  {
+    switch (type) {
+    case token_type::double_equal:
+    case token_type::bang_equal:
+      return precedence_equality;
+    case token_type::less:
+    case token_type::less_equal:
+    case token_type::greator:
+    case token_type::greater_equal:
+      return precedence_comparison;
+    case token_type::plus:
+    case token_type::minus:
+      return precedence_term;
+    case token_type::star:
+    case token_type::slash:
+      return precedence_factor;
+    default:
+      return precedence_none;
+    }
+  }
+
+  constexpr auto add_node(StaticOp op, StaticType type,
+                          std::array<std::uint8_t, 3> operands = {},
+                          double number = 0) -> std::uint8_t
+  {
+    if (program_.node_count_ == StaticProgram::max_nodes) {
+      throw StaticEvalError{"The static program is too long"};
+    }
+    program_.nodes_[program_.node_count_] = {op, type, number, operands};
+    return static_cast<std::uint8_t>(program_.node_count_++);
+  }
+
+  constexpr auto type_of(std::uint8_t node) const noexcept -> StaticType
+  {
+    return program_.nodes_[node].type;
+  }
+
+  constexpr auto expect(std::uint8_t node, StaticType type,
+                        const char* message) const -> std::uint8_t
+  {
+    if (type_of(node) != type) {
+      throw StaticEvalError{message};
+    }
+    return node;
+  }
+
+  constexpr auto parse_precedence(Precedence precedence) -> std::uint8_t
+  {
+    auto lhs = parse_prefix();
+    while (infix_precedence(current_->type) >= precedence &&
+           infix_precedence(current_->type) != precedence_none) {
+      const auto op = advance().type;
+      const auto rhs = parse_precedence(
+          static_cast<Precedence>(infix_precedence(op) + 1));
+      lhs = binary(op, lhs, rhs);
+    }
+    return lhs;
+  }
+
+  constexpr auto parse_prefix() -> std::uint8_t
+  {
+    const auto token = advance();
+    switch (token.type) {
+    case token_type::number_literal:
+      return add_node(StaticOp::number, StaticType::number, {},
+                      parse_number(token.text));
+    case token_type::keyword_true:
+    case token_type::keyword_false:
+      return add_node(
+          StaticOp::boolean, StaticType::boolean,
+          {static_cast<std::uint8_t>(token.type == token_type::keyword_true)});
+    case token_type::identifier:
+      return add_node(StaticOp::variable, StaticType::number,
+                      {variable(token.text)});
+    case token_type::minus: {
+      const auto operand = expect(parse_precedence(precedence_unary),
+                                  StaticType::number,
+                                  "Unary - wants a Number operand");
+      return add_node(StaticOp::negate, StaticType::number, {operand});
+    }
+    case token_type::bang: {
+      const auto operand = expect(parse_precedence(precedence_unary),
+                                  StaticType::boolean,
+                                  "Unary ! wants a Bool operand");
+      return add_node(StaticOp::logical_not, StaticType::boolean, {operand});
+    }
+    case token_type::left_paren: {
+      const auto expr = parse_precedence(precedence_equality);
+      consume(token_type::right_paren,
+              "Expect `)` at the end of the expression");
+      return expr;
+    }
+    case token_type::left_brace: {
+      const auto expr = parse_precedence(precedence_equality);
+      consume(token_type::right_brace, "A block must end with '}'");
+      return expr;
+    }
+    case token_type::keyword_if:
+      return parse_branch();
+    default:
+      throw StaticEvalError{
+          "The static subset of EML does not support this expression"};
+    }
+  }
+
+  constexpr auto parse_branch() -> std::uint8_t
+  {
+    consume(token_type::left_paren,
+            "condition of an if expression must in a group");
+    const auto cond =
+        expect(parse_precedence(precedence_equality), StaticType::boolean,
+               "The condition of an if expression must be a Bool");
+    consume(token_type::right_paren,
+            "Expect `)` at the end of the expression");
+    const auto then_branch = parse_precedence(precedence_equality);
+    consume(token_type::keyword_else, "if expression must have an else branch");
+    const auto else_branch = parse_precedence(precedence_equality);
+    if (type_of(then_branch) != type_of(else_branch)) {
+      throw StaticEvalError{
+          "The branches of an if expression must have the same type"};
+    }
+    return add_node(StaticOp::branch, type_of(then_branch),
+                    {cond, then_branch, else_branch});
+  }
+
+  constexpr auto binary(token_type op, std::uint8_t lhs, std::uint8_t rhs)
+      -> std::uint8_t
+  {
+    if (op == token_type::double_equal || op == token_type::bang_equal) {
+      if (type_of(lhs) != type_of(rhs)) {
+        throw StaticEvalError{"Both sides of an equality must have same type"};
+      }
+      return add_node(op == token_type::double_equal ? StaticOp::equal
+                                                     : StaticOp::not_equal,
+                      StaticType::boolean, {lhs, rhs});
+    }
+
+    expect(lhs, StaticType::number, "Binary operators want Number operands");
+    expect(rhs, StaticType::number, "Binary operators want Number operands");
+    switch (op) {
+    case token_type::plus:
+      return add_node(StaticOp::add, StaticType::number, {lhs, rhs});
+    case token_type::minus:
+      return add_node(StaticOp::subtract, StaticType::number, {lhs, rhs});
+    case token_type::star:
+      return add_node(StaticOp::multiply, StaticType::number, {lhs, rhs});
+    case token_type::slash:
+      return add_node(StaticOp::divide, StaticType::number, {lhs, rhs});
+    case token_type::less:
+      return add_node(StaticOp::less, StaticType::boolean, {lhs, rhs});
+    case token_type::less_equal:
+      return add_node(StaticOp::less_equal, StaticType::boolean, {lhs, rhs});
+    case token_type::greator:
+      return add_node(StaticOp::greater, StaticType::boolean, {lhs, rhs});
+    case token_type::greater_equal:
+      return add_node(StaticOp::greater_equal, StaticType::boolean,
+                      {lhs, rhs});
+    default:
+      EML_UNREACHABLE();
+    }
+  }
+
+  // Returns the index of the variable, which gets added on first appearance
+  constexpr auto variable(std::string_view name) -> std::uint8_t
+  {
+    for (std::size_t i = 0; i < program_.variable_count_; ++i) {
+      if (program_.variable_name(i) == name) {
+        return static_cast<std::uint8_t>(i);
+      }
+    }
+    if (program_.variable_count_ == StaticProgram::max_variables) {
+      throw StaticEvalError{"The static program has too many variables"};
+    }
+    if (name.size() > StaticProgram::max_variable_name_size) {
+      throw StaticEvalError{
+          "A variable name of the static program is too long"};
+    }
+    auto& variable = program_.variables_[program_.variable_count_];
+    for (std::size_t i = 0; i < name.size(); ++i) {
+      variable.chars[i] = name[i];
+    }
+    variable.size = name.size();
+    return static_cast<std::uint8_t>(program_.variable_count_++);
+  }
+
+  // Parses the literal as mantissa * 10^exponent with an exact integer
+  // mantissa. A mantissa up to 2^53 and the powers of ten up to 10^22 are exact
+  // in a double, so the single multiplication or division rounds like strtod.
+  // Other literals would need more precision, and are errors.
+  static constexpr auto parse_number(std::string_view text) -> double
+  {
+    constexpr std::uint64_t max_exact = std::uint64_t{1} << 53;
+    constexpr int max_exact_power = 22;
+    const auto too_precise = [] {
+      return StaticEvalError{
+          "A number literal of the static program has too many significant "
+          "digits"};
+    };
+
+    std::uint64_t mantissa = 0;
+    int exponent = 0;
+    int trailing_zeros = 0;
+    bool fraction = false;
+    for (const auto c : text) {
+      if (c == '.') {
+        fraction = true;
+        continue;
+      }
+      // Zeros only go into the mantissa when a nonzero digit follows them
+      if (c == '0') {
+        ++trailing_zeros;
+      } else {
+        for (; trailing_zeros > 0; --trailing_zeros) {
+          if (mantissa > max_exact / 10) {
+            throw too_precise();
+          }
+          mantissa *= 10;
+        }
+        mantissa = mantissa * 10 + static_cast<std::uint64_t>(c - '0');
+        if (mantissa > max_exact) {
+          throw too_precise();
+        }
+      }
+      if (fraction) {
+        --exponent;
+      }
+    }
+    exponent += trailing_zeros;
+    if (mantissa == 0) {
+      return 0;
+    }
+
+    // Moves the part of a large exponent that the mantissa can take exactly
+    for (; exponent > max_exact_power && mantissa <= max_exact / 10;
+         --exponent) {
+      mantissa *= 10;
+    }
+    if (exponent > max_exact_power || exponent < -max_exact_power) {
+      throw too_precise();
+    }
+
+    double power = 1;
+    for (int i = 0; i < (exponent < 0 ? -exponent : exponent); ++i) {
+      power *= 10;
+    }
+    const auto value = static_cast<double>(mantissa);
+    return exponent < 0 ? value / power : value * power;
+  }
+};
+
+namespace detail {
+
+// Evaluates the node of the program at index, where every node becomes its own
+// instantiation so that the compiler inlines the whole program
+template <const StaticProgram& program, std::size_t index>
+constexpr auto evaluate_static_node(const double* values)
+{
+  constexpr auto node = program.node(index);
+  using first = std::integral_constant<std::size_t, node.operands[0]>;
+  using second = std::integral_constant<std::size_t, node.operands[1]>;
+  using third = std::integral_constant<std::size_t, node.operands[2]>;
+  const auto operand = [values](auto i) {
+    return evaluate_static_node<program, decltype(i)::value>(values);
+  };
+
+  if constexpr (node.op == StaticOp::number) {
+    return node.number;
+  } else if constexpr (node.op == StaticOp::boolean) {
+    return node.operands[0] != 0;
+  } else if constexpr (node.op == StaticOp::variable) {
+    return values[node.operands[0]];
+  } else if constexpr (node.op == StaticOp::negate) {
+    return -operand(first{});
+  } else if constexpr (node.op == StaticOp::logical_not) {
+    return !operand(first{});
+  } else if constexpr (node.op == StaticOp::add) {
+    return operand(first{}) + operand(second{});
+  } else if constexpr (node.op == StaticOp::subtract) {
+    return operand(first{}) - operand(second{});
+  } else if constexpr (node.op == StaticOp::multiply) {
+    return operand(first{}) * operand(second{});
+  } else if constexpr (node.op == StaticOp::divide) {
+    return operand(first{}) / operand(second{});
+  } else if constexpr (node.op == StaticOp::equal) {
+    return operand(first{}) == operand(second{});
+  } else if constexpr (node.op == StaticOp::not_equal) {
+    return operand(first{}) != operand(second{});
+  } else if constexpr (node.op == StaticOp::less) {
+    return operand(first{}) < operand(second{});
+  } else if constexpr (node.op == StaticOp::less_equal) {
+    return operand(first{}) <= operand(second{});
+  } else if constexpr (node.op == StaticOp::greater) {
+    return operand(first{}) > operand(second{});
+  } else if constexpr (node.op == StaticOp::greater_equal) {
+    return operand(first{}) >= operand(second{});
+  } else {
+    static_assert(node.op == StaticOp::branch);
+    return operand(first{}) ? operand(second{}) : operand(third{});
+  }
+}
+
+} // namespace detail
+
+/**
+ * @brief Compiles the source of a static program
+ *
+ * The program copies what it needs from source, so source may be a temporary.
+ *
+ * @throw StaticEvalError if the source has a syntax or type error, or a number
+ * literal that a double cannot hold exactly before a single rounding
+ */
+constexpr auto static_compile(std::string_view source) -> StaticProgram
+{
+  return StaticCompiler{source}.compile();
+}
+
+/**
+ * @brief Evaluates the source of a static program without variables
+ * @throw StaticEvalError if the source has a syntax or type error, or has
+ * variables
+ */
+constexpr auto static_eval(std::string_view source) -> StaticValue
+{
+  return static_compile(source)();
+}
+
+/**
+ * @brief Gets a function object that runs the program with its variables as
+ * arguments, and returns a `double` or a `bool`
+ *
+ * Unlike StaticProgram::operator(), it has no interpretation overhead, since
+ * the program is a template argument that the function is generated from. The
+ * program needs static storage duration:
+ * @code
+ * static constexpr auto program = eml::static_compile("1 + 2 * x");
+ * constexpr auto f = eml::static_function<program>();
+ * const double y = f(x);
+ * @endcode
+ */
+template <const StaticProgram& program> constexpr auto static_function()
+{
+  return [](auto... args) {
+    static_assert(sizeof...(args) == program.variable_count(),
+                  "The number of arguments does not match the static program");
+    const std::array<double, sizeof...(args)> values = {
+        static_cast<double>(args)...};
+    return detail::evaluate_static_node<program, program.root()>(
+        values.data());
+  };
+}
+
+} // namespace eml
+
+#endif // EML_STATIC_EVAL_HPP
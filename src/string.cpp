@@ -1,21 +1,288 @@
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <new>
+#include <vector>
+
 #include "string.hpp"
 
 namespace eml {
 
+namespace {
+
+// Copies the text of s to out, and returns the end of the copied text
+auto copy_text(const Obj& s, std::byte* out) -> std::byte*
+{
+  for_each_leaf(s, [&out](const Obj& leaf) {
+    out = std::uninitialized_copy(leaf.data(), leaf.data() + leaf.size(), out);
+  });
+  return out;
+}
+
+// Whether the text of s is at data, and if so, moves data pass it
+auto match_text(const Obj& s, const std::byte*& data) -> bool
+{
+  bool match = true;
+  for_each_leaf(s, [&](const Obj& leaf) {
+    match = match && std::memcmp(data, leaf.data(), leaf.size()) == 0;
+    data += leaf.size();
+  });
+  return match;
+}
+
+// Whether the size bytes at data are in the text of s from offset on
+auto match_text_at(const Obj& s, std::size_t offset, const std::byte* data,
+                   std::size_t size) noexcept -> bool
+{
+  if (!is_rope(s)) {
+    return std::memcmp(s.data() + offset, data, size) == 0;
+  }
+
+  const auto& rope = as_rope(s);
+  if (rope.right == nullptr) {
+    return match_text_at(*rope.left, offset, data, size);
+  }
+  const auto left_length = string_length(*rope.left);
+  if (offset >= left_length) {
+    return match_text_at(*rope.right, offset - left_length, data, size);
+  }
+  const auto left_size = std::min(size, left_length - offset);
+  return match_text_at(*rope.left, offset, data, left_size) &&
+         (left_size == size ||
+          match_text_at(*rope.right, 0, data + left_size, size - left_size));
+}
+
+// Whether the texts of two strings of the same length are the same
+auto same_text(const Obj& lhs, const Obj& rhs) noexcept -> bool
+{
+  bool match = true;
+  std::size_t offset = 0;
+  for_each_leaf(lhs, [&](const Obj& leaf) {
+    match = match && match_text_at(rhs, offset, leaf.data(), leaf.size());
+    offset += leaf.size();
+  });
+  return match;
+}
+
+// Whether two strings may have the same text, which only comparing the texts
+// can tell
+auto may_equal(const Obj& lhs, const Obj& rhs) noexcept -> bool
+{
+  return !(lhs.is_interned() && rhs.is_interned()) &&
+         lhs.hash() == rhs.hash() && string_length(lhs) == string_length(rhs);
+}
+
+// The depth of a string for balancing, where a flattened rope is a leaf
+auto rope_depth(const Obj& s) noexcept -> std::uint32_t
+{
+  return is_rope(s) && as_rope(s).right != nullptr ? as_rope(s).depth : 0;
+}
+
+auto string_hash_power(const Obj& s) noexcept -> std::uint32_t
+{
+  return is_rope(s) ? as_rope(s).power : hash_power(s.size());
+}
+
+// Makes the strings of a concatenation. The strings that are not young get
+// pinned until the concatenation is done, since they are only reachable
+// through the strings that get made after them
+class RopeBuilder {
+public:
+  RopeBuilder(GarbageCollector& gc, Generation generation) noexcept
+      : gc_{gc}, generation_{generation}
+  {
+  }
+
+  ~RopeBuilder()
+  {
+    for (const auto& s : pinned_) {
+      s->unpin();
+    }
+  }
+
+  RopeBuilder(const RopeBuilder&) = delete;
+  auto operator=(const RopeBuilder&) -> RopeBuilder& = delete;
+  RopeBuilder(RopeBuilder&&) = delete;
+  auto operator=(RopeBuilder&&) -> RopeBuilder& = delete;
+
+  // Copies the texts of a and b into a flat string
+  auto flat(GcPointer a, GcPointer b) -> GcPointer
+  {
+    const auto length = string_length(*a) + string_length(*b);
+    GcPointer result = gc_.get().allocate(length, generation_);
+    copy_text(*b, copy_text(*a, result->data()));
+    result->set_hash(hash_concat(a->hash(), b->hash(), string_hash_power(*b)));
+    return keep(result);
+  }
+
+  // Concatenates a and b into a flat string if the result is short, or into
+  // a rope of balanced depth otherwise
+  auto join(GcPointer a, GcPointer b) -> GcPointer
+  {
+    if (string_length(*a) + string_length(*b) < min_rope_length) {
+      return flat(a, b);
+    }
+
+    const auto a_depth = rope_depth(*a);
+    const auto b_depth = rope_depth(*b);
+    if (a_depth > b_depth + 1) {
+      const auto& rope = as_rope(*a);
+      return balance(GcPointer{rope.left}, join(GcPointer{rope.right}, b));
+    }
+    if (b_depth > a_depth + 1) {
+      const auto& rope = as_rope(*b);
+      return balance(join(a, GcPointer{rope.left}), GcPointer{rope.right});
+    }
+    return node(a, b);
+  }
+
+private:
+  std::reference_wrapper<GarbageCollector> gc_;
+  Generation generation_;
+  std::vector<GcPointer> pinned_;
+
+  auto keep(GcPointer s) -> GcPointer
+  {
+    if (!s->is_young()) {
+      s->pin();
+      pinned_.push_back(s);
+    }
+    return s;
+  }
+
+  auto node(GcPointer left, GcPointer right) -> GcPointer
+  {
+    const auto length = string_length(*left) + string_length(*right);
+    const auto depth = std::max(rope_depth(*left), rope_depth(*right)) + 1;
+    const auto power = string_hash_power(*left) * string_hash_power(*right);
+
+    GcPointer result = gc_.get().allocate(sizeof(Rope), generation_,
+                                          ObjKind::pair);
+    new (result->data()) Rope{left.get(), right.get(), length, depth, power};
+    result->set_hash(
+        hash_concat(left->hash(), right->hash(), string_hash_power(*right)));
+    gc_.get().write_barrier(result);
+    return keep(result);
+  }
+
+  // Makes a node of two strings, whose depths differ by at most two, with
+  // the rotations of an AVL tree if they differ by two
+  auto balance(GcPointer left, GcPointer right) -> GcPointer
+  {
+    const auto left_depth = rope_depth(*left);
+    const auto right_depth = rope_depth(*right);
+    if (right_depth > left_depth + 1) {
+      const auto& rope = as_rope(*right);
+      if (rope_depth(*rope.left) <= rope_depth(*rope.right)) {
+        return node(node(left, GcPointer{rope.left}), GcPointer{rope.right});
+      }
+      const auto& inner = as_rope(*rope.left);
+      return node(node(left, GcPointer{inner.left}),
+                  node(GcPointer{inner.right}, GcPointer{rope.right}));
+    }
+    if (left_depth > right_depth + 1) {
+      const auto& rope = as_rope(*left);
+      if (rope_depth(*rope.right) <= rope_depth(*rope.left)) {
+        return node(GcPointer{rope.left}, node(GcPointer{rope.right}, right));
+      }
+      const auto& inner = as_rope(*rope.right);
+      return node(node(GcPointer{rope.left}, GcPointer{inner.left}),
+                  node(GcPointer{inner.right}, right));
+    }
+    return node(left, right);
+  }
+};
+
+} // anonymous namespace
+
 auto make_string(std::string_view s, GarbageCollector& gc) -> GcPointer
 {
+  const auto* data = bit_cast<const std::byte*>(s.data());
+  const auto hash = hash_bytes(data, s.size());
+  if (Obj* interned = gc.find_interned(hash, s.size(), [&](const auto* other) {
+        return std::memcmp(other, data, s.size()) == 0;
+      })) {
+    // The result may get pinned, so it must not be young
+    return gc.tenure(GcPointer{interned});
+  }
+
   GcPointer result = gc.allocate(s.size());
   std::uninitialized_copy(s.begin(), s.end(),
                           bit_cast<unsigned char*>(result->data()));
+  result->set_hash(hash);
+  gc.intern(result);
+  return result;
+}
+
+auto string_cat(GcPointer a, GcPointer b, GarbageCollector& gc,
+                Generation generation) -> GcPointer
+{
+  const auto length = string_length(*a) + string_length(*b);
+  if (length > gc.max_interned_cat_size()) {
+    return RopeBuilder{gc, generation}.join(a, b);
+  }
+
+  const auto hash = hash_concat(a->hash(), b->hash(), string_hash_power(*b));
+  if (Obj* interned = gc.find_interned(hash, length, [&](const auto* other) {
+        return match_text(*a, other) && match_text(*b, other);
+      })) {
+    return generation == Generation::old ? gc.tenure(GcPointer{interned})
+                                         : GcPointer{interned};
+  }
+
+  const auto result = RopeBuilder{gc, generation}.flat(a, b);
+  gc.intern(result);
+  return result;
+}
+
+auto string_equal(const Obj& lhs, const Obj& rhs) noexcept -> bool
+{
+  return &lhs == &rhs || (may_equal(lhs, rhs) && same_text(lhs, rhs));
+}
+
+auto string_equal(GcPointer lhs, GcPointer rhs, GarbageCollector& gc) noexcept
+    -> bool
+{
+  if (lhs == rhs) {
+    return true;
+  }
+  if (!may_equal(*lhs, *rhs)) {
+    return false;
+  }
+
+  try {
+    [[maybe_unused]] const auto lhs_flat = flatten(lhs, gc);
+    [[maybe_unused]] const auto rhs_flat = flatten(rhs, gc);
+  } catch (const std::bad_alloc&) {
+    // The ropes that are left compare leaf by leaf
+  }
+  return same_text(*lhs, *rhs);
+}
+
+auto flatten(GcPointer s, GarbageCollector& gc) -> GcPointer
+{
+  if (!is_rope(*s)) {
+    return s;
+  }
+  auto& rope = as_rope(*s);
+  if (rope.right == nullptr) {
+    return GcPointer{rope.left};
+  }
+
+  GcPointer result = gc.allocate(rope.length);
+  copy_text(*s, result->data());
+  result->set_hash(s->hash());
+
+  rope.left = result.get();
+  rope.right = nullptr;
+  gc.write_barrier(s);
   return result;
 }
 
-auto string_cat(GcPointer a, GcPointer b, GarbageCollector& gc) -> GcPointer
+auto to_std_string(const Obj& s) -> std::string
 {
-  GcPointer result = gc.allocate(a->size() + b->size());
-  std::uninitialized_copy(a->data(), a->data() + a->size(), result->data());
-  std::uninitialized_copy(b->data(), b->data() + b->size(),
-                          result->data() + a->size());
+  std::string result(string_length(s), '\0');
+  copy_text(s, bit_cast<std::byte*>(result.data()));
   return result;
 }
 
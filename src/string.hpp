@@ -4,27 +4,145 @@
 /**
  * @file string.hpp
  * @brief String object related operations in Embedded ML
+ *
+ * A string object is either flat, an object of the bytes kind that holds the
+ * text, or a rope, an object of the pair kind that holds a Rope.
  */
 
 #include <cstddef>
 #include <cstdint>
 #include <limits>
 #include <memory>
+#include <string>
+#include <string_view>
 
 #include "common.hpp"
 #include "memory.hpp"
 
 namespace eml {
 
+/**
+ * @brief The data of a rope, the lazy concatenation of two strings
+ *
+ * Every node of a rope has its hash set, which a concatenation combines from
+ * the hashes of its operands. The depths of the children of a node differ by
+ * at most one when they are made, like the heights of an AVL tree.
+ */
+struct Rope {
+  Obj* left;
+  Obj* right;          ///< @brief Null once flattened, see flatten
+  std::size_t length;  ///< @brief Number of bytes of the text
+  std::uint32_t depth; ///< @brief One more than the depth of the deeper child
+  std::uint32_t power; ///< @brief The hash_power of length
+};
+
+/// @brief Concatenation results shorter than this are copied into flat strings
+constexpr std::size_t min_rope_length = 128;
+
+/// @brief Whether s is a rope
+[[nodiscard]] inline auto is_rope(const Obj& s) noexcept -> bool
+{
+  return s.kind() == ObjKind::pair;
+}
+
+/// @brief Returns the rope data of s
+/// @pre s is a rope
+[[nodiscard]] inline auto as_rope(const Obj& s) noexcept -> const Rope&
+{
+  EML_ASSERT(is_rope(s), "Must be a rope");
+  return *reinterpret_cast<const Rope*>(s.data());
+}
+
+/// @overload
+[[nodiscard]] inline auto as_rope(Obj& s) noexcept -> Rope&
+{
+  EML_ASSERT(is_rope(s), "Must be a rope");
+  return *reinterpret_cast<Rope*>(s.data());
+}
+
+/// @brief Returns the number of bytes of the text of a string
+[[nodiscard]] inline auto string_length(const Obj& s) noexcept -> std::size_t
+{
+  return is_rope(s) ? as_rope(s).length : s.size();
+}
+
+/**
+ * @brief Calls f with each flat string of s in order, whose texts make up the
+ * text of s
+ */
+template <typename F> void for_each_leaf(const Obj& s, F&& f)
+{
+  if (is_rope(s)) {
+    const auto& rope = as_rope(s);
+    for_each_leaf(*rope.left, f);
+    if (rope.right != nullptr) {
+      for_each_leaf(*rope.right, f);
+    }
+  } else {
+    f(s);
+  }
+}
+
+/**
+ * @brief Returns the interned string object of s, which get created if it does
+ * not exist yet
+ */
 [[nodiscard]] auto make_string(std::string_view s, GarbageCollector& gc)
     -> GcPointer;
 
 /**
  * @brief Concatenates to string object into on string
+ *
+ * Results up to GcConfig::max_interned_cat_size bytes are interned, so they
+ * can be an existing object. Other results of at least min_rope_length bytes
+ * are ropes, which refer to the operands instead of copying them. Joining two
+ * ropes only remakes the nodes along the edge of the deeper one, so building
+ * a string of n pieces by appending or prepending takes O(n log n).
+ *
+ * @arg generation The generation that the result get allocated in
+ * @warning The operands must stay reachable from the roots, since the
+ * allocations may run a collection
  */
-[[nodiscard]] auto string_cat(GcPointer a, GcPointer b, GarbageCollector& gc)
+[[nodiscard]] auto string_cat(GcPointer a, GcPointer b, GarbageCollector& gc,
+                              Generation generation = Generation::old)
     -> GcPointer;
 
+/**
+ * @brief Whether two strings have the same text
+ *
+ * Two different interned strings never have the same text, so comparing them
+ * is O(1). Otherwise the hashes and lengths get compared before the texts.
+ */
+[[nodiscard]] auto string_equal(const Obj& lhs, const Obj& rhs) noexcept
+    -> bool;
+
+/**
+ * @brief Whether two strings have the same text, flattening the ropes whose
+ * texts get compared
+ *
+ * Later comparisons of the flattened ropes use their flat text. A flattening
+ * that runs out of memory only leaves the rope as it is.
+ *
+ * @warning The operands must stay reachable from the roots, since the
+ * allocations may run a collection
+ */
+[[nodiscard]] auto string_equal(GcPointer lhs, GcPointer rhs,
+                                GarbageCollector& gc) noexcept -> bool;
+
+/**
+ * @brief Returns a flat string of the text of s
+ *
+ * A rope keeps the result in place of its children on the first call, so the
+ * later ones are O(1) and its children can be collected.
+ *
+ * @warning s must stay reachable from the roots, since the allocation may run
+ * a collection
+ */
+[[nodiscard]] auto flatten(GcPointer s, GarbageCollector& gc) -> GcPointer;
+
+/// @brief Returns the text of a string
+[[nodiscard]] auto to_std_string(const Obj& s) -> std::string;
+
 } // namespace eml
 
 #endif // EML_STRING_HPP
@@ -0,0 +1,89 @@
+#include "symbol.hpp"
+#include "common.hpp"
+
+#include <deque>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+
+namespace eml {
+
+namespace {
+
+/*
+ * Owns the names of all the symbols, indexed by their ids. The map is keyed by
+ * views of the names it owns, so looking up a name does not allocate.
+ *
+ * The table is shared by the whole process, so compilers on different threads
+ * intern into it under its lock. Names never move, so the views that name
+ * returns stay valid after the lock is released.
+ */
+class SymbolTable {
+public:
+  static auto instance() -> SymbolTable&
+  {
+    static SymbolTable table;
+    return table;
+  }
+
+  auto intern(std::string_view name) -> Symbol::Id
+  {
+    if (const auto id = find(name); id) {
+      return *id;
+    }
+
+    const std::unique_lock lock{mutex_};
+    // Another thread may have interned the name since the lookup
+    if (const auto pos = ids_.find(name); pos != ids_.end()) {
+      return pos->second;
+    }
+    const auto id = static_cast<Symbol::Id>(names_.size());
+    ids_.emplace(names_.emplace_back(name), id);
+    return id;
+  }
+
+  auto find(std::string_view name) const -> std::optional<Symbol::Id>
+  {
+    const std::shared_lock lock{mutex_};
+    const auto pos = ids_.find(name);
+    if (pos == ids_.end()) {
+      return {};
+    }
+    return pos->second;
+  }
+
+  auto name(Symbol::Id id) const -> std::string_view
+  {
+    const std::shared_lock lock{mutex_};
+    EML_ASSERT(id < names_.size(), "Not the id of a symbol");
+    return names_[id];
+  }
+
+private:
+  mutable std::shared_mutex mutex_;
+  std::deque<std::string> names_; // Never moves its elements
+  std::unordered_map<std::string_view, Symbol::Id> ids_;
+};
+
+} // anonymous namespace
+
+Symbol::Symbol(std::string_view name)
+    : id_{SymbolTable::instance().intern(name)}
+{
+}
+
+auto Symbol::find(std::string_view name) -> std::optional<Symbol>
+{
+  if (const auto id = SymbolTable::instance().find(name); id) {
+    return Symbol{*id};
+  }
+  return {};
+}
+
+auto Symbol::name() const -> std::string_view
+{
+  return SymbolTable::instance().name(id_);
+}
+
+} // namespace eml
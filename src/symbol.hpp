@@ -0,0 +1,63 @@
+#ifndef EML_SYMBOL_HPP
+#define EML_SYMBOL_HPP
+
+/**
+ * @file symbol.hpp
+ * @brief This file contains the interned identifiers of EML
+ */
+
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+namespace eml {
+
+/**
+ * @brief An identifier, which is a handle to its name in the symbol table
+ *
+ * Identifiers of the same name are the same symbol, so comparing symbols is
+ * comparing their ids. The symbol table is shared by the whole process and
+ * safe to use from several threads.
+ */
+class Symbol {
+public:
+  using Id = std::uint32_t;
+
+  /// @brief Interns name if it is not in the symbol table yet
+  explicit Symbol(std::string_view name);
+
+  /**
+   * @brief Gets the symbol of name if it is in the symbol table, without
+   * interning it
+   */
+  [[nodiscard]] static auto find(std::string_view name)
+      -> std::optional<Symbol>;
+
+  /// @brief Gets the id of the symbol in the symbol table
+  [[nodiscard]] constexpr auto id() const noexcept -> Id
+  {
+    return id_;
+  }
+
+  /// @brief Gets the name of the symbol, which lives as long as the program
+  [[nodiscard]] auto name() const -> std::string_view;
+
+  friend constexpr auto operator==(Symbol lhs, Symbol rhs) noexcept -> bool
+  {
+    return lhs.id_ == rhs.id_;
+  }
+
+  friend constexpr auto operator!=(Symbol lhs, Symbol rhs) noexcept -> bool
+  {
+    return lhs.id_ != rhs.id_;
+  }
+
+private:
+  constexpr explicit Symbol(Id id) noexcept : id_{id} {}
+
+  Id id_;
+};
+
+} // namespace eml
+
+#endif // EML_SYMBOL_HPP
@@ -1,8 +1,76 @@
 #include "type.hpp"
 #include "common.hpp"
 
+#include <array>
+#include <deque>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+
 namespace eml {
 
+/**
+ * @brief Owns the structures of all the types, indexed by their ids
+ *
+ * The primitive types are at their fixed ids. A compound type refers to the
+ * types it consists of by their ids, so it gets interned in constant time, and
+ * equal parts of different types are shared. The structures stay at the same
+ * address when the table grows.
+ *
+ * The table is shared by the whole process, so compound types get interned
+ * and looked up under its lock. The primitive types never change, so they are
+ * looked up without it.
+ */
+class TypeTable {
+public:
+  static auto instance() -> TypeTable&
+  {
+    static TypeTable table;
+    return table;
+  }
+
+  auto intern(const FunctionType& t) -> Type
+  {
+    const auto key = (std::uint64_t{t.argument.id()} << 32u) | t.result.id();
+    const std::unique_lock lock{mutex_};
+    const auto [pos, inserted] = functions_.try_emplace(
+        key, static_cast<Type::Id>(primitives_.size() + compounds_.size()));
+    if (inserted) {
+      compounds_.emplace_back(t);
+    }
+    return Type{pos->second};
+  }
+
+  auto structure(Type::Id id) const -> const TypeStructure&
+  {
+    if (id < primitives_.size()) {
+      return primitives_[id];
+    }
+    const std::shared_lock lock{mutex_};
+    EML_ASSERT(id - primitives_.size() < compounds_.size(),
+               "Not the id of a type");
+    return compounds_[id - primitives_.size()];
+  }
+
+private:
+  // At the ids of Type
+  const std::array<TypeStructure, Type::error_id + 1> primitives_{
+      NumberType{}, BoolType{}, UnitType{}, StringType{}, ErrorType{}};
+
+  mutable std::shared_mutex mutex_;
+  std::deque<TypeStructure> compounds_; // Never moves its elements
+  std::unordered_map<std::uint64_t, Type::Id> functions_;
+};
+
+Type::Type(const FunctionType& t) : id_{TypeTable::instance().intern(t).id()}
+{
+}
+
+auto type_structure(Type::Id id) -> const TypeStructure&
+{
+  return TypeTable::instance().structure(id);
+}
+
 namespace {
 
 struct TypePrinter {
@@ -30,13 +98,25 @@ struct TypePrinter {
   {
     os_ << "Error";
   }
+
+  // The arrow is right associative, so only functions as arguments need
+  // parentheses
+  void operator()(const FunctionType& t)
+  {
+    if (std::holds_alternative<FunctionType>(t.argument.structure())) {
+      os_ << '(' << t.argument << ')';
+    } else {
+      os_ << t.argument;
+    }
+    os_ << " -> " << t.result;
+  }
 };
 
 } // anonymous namespace
 
 std::ostream& operator<<(std::ostream& os, const Type& type)
 {
-  std::visit(TypePrinter{os}, type);
+  std::visit(TypePrinter{os}, type.structure());
   return os;
 }
 
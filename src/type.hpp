@@ -7,6 +7,7 @@
  * system
  */
 
+#include <cstdint>
 #include <iostream>
 #include <memory>
 #include <variant>
@@ -22,17 +23,92 @@ struct ErrorType {};
 
 // clang-format on
 
-using Type =
-    std::variant<NumberType, BoolType, UnitType, StringType, ErrorType>;
+struct FunctionType;
+
+/// @brief The structure of a type, see Type::structure
+using TypeStructure = std::variant<NumberType, BoolType, UnitType, StringType,
+                                   ErrorType, FunctionType>;
+
+/**
+ * @brief A type of EML, which is a handle to its structure in the type table
+ *
+ * Every structurally equal type has the same handle, so types are cheap to
+ * copy, and comparing them is comparing their ids. The primitive types have
+ * fixed ids, and compound types get interned in the type table when they get
+ * constructed. The type table is shared by the whole process and safe to use
+ * from several threads.
+ */
+class Type {
+public:
+  using Id = std::uint32_t;
+
+  constexpr Type(NumberType /*t*/) noexcept : id_{number_id} {}
+  constexpr Type(BoolType /*t*/) noexcept : id_{bool_id} {}
+  constexpr Type(UnitType /*t*/) noexcept : id_{unit_id} {}
+  constexpr Type(StringType /*t*/) noexcept : id_{string_id} {}
+  constexpr Type(ErrorType /*t*/) noexcept : id_{error_id} {}
+
+  /// @brief Interns the function type t if it is not in the type table yet
+  Type(const FunctionType& t);
+
+  /// @brief Gets the id of the type in the type table
+  [[nodiscard]] constexpr auto id() const noexcept -> Id
+  {
+    return id_;
+  }
+
+  /**
+   * @brief Gets the structure of the type, which can be visited with
+   * std::visit
+   */
+  [[nodiscard]] auto structure() const -> const TypeStructure&;
+
+  friend constexpr auto operator==(Type lhs, Type rhs) noexcept -> bool
+  {
+    return lhs.id_ == rhs.id_;
+  }
+
+  friend constexpr auto operator!=(Type lhs, Type rhs) noexcept -> bool
+  {
+    return lhs.id_ != rhs.id_;
+  }
+
+private:
+  enum : Id { number_id, bool_id, unit_id, string_id, error_id };
+  friend class TypeTable;
+
+  constexpr explicit Type(Id id) noexcept : id_{id} {}
+
+  Id id_;
+};
+
+/**
+ * @brief The type of a function from argument to result
+ *
+ * Functions of many arguments are curried, so `Number -> Number -> Bool` is a
+ * function type whose result is another function type.
+ */
+struct FunctionType {
+  Type argument;
+  Type result;
+};
+
+/// @brief Gets the structure of the type with id
+auto type_structure(Type::Id id) -> const TypeStructure&;
+
+inline auto Type::structure() const -> const TypeStructure&
+{
+  return type_structure(id_);
+}
 
 std::ostream& operator<<(std::ostream& os, const Type& type);
 
 /**
  * @brief Return true if the lhs type match the rhs type
  */
-inline auto match(const Type& lhs, const Type& rhs)
+constexpr auto match(Type lhs, Type rhs) noexcept -> bool
 {
-  return lhs.index() == rhs.index();
+  return lhs == rhs;
 }
 
 } // namespace eml
@@ -20,13 +20,124 @@ struct Func2Type {
 };
 
 namespace {
+
+const Func1Type negate_type{NumberType{}, NumberType{}};
+const Func1Type not_type{BoolType{}, BoolType{}};
+const Func2Type arithmetic_type{NumberType{}, NumberType{}, NumberType{}};
+const Func2Type append_type{StringType{}, StringType{}, StringType{}};
+const Func2Type comparison_type{NumberType{}, NumberType{}, BoolType{}};
+
 struct TypeChecker : AstVisitor {
   Compiler& compiler;
+  Arena& arena;
   bool has_error = false;
   bool panic_mode = false;
   std::vector<CompilationError> errors;
 
-  explicit TypeChecker(Compiler& c) : compiler(c) {}
+  void error(const std::string& message)
+  {
+    if (panic_mode) {
+      return;
+    }
+    has_error = true;
+    panic_mode = true;
+
+    errors.emplace_back(std::in_place_type<TypeError>, message);
+  }
+
+  auto unary_type(std::string_view op, const Func1Type& allowed_type,
+                  const Type& operand) -> Type
+  {
+    if (match(operand, allowed_type.arg_type)) {
+      return allowed_type.result_type;
+    }
+
+    if (!panic_mode) {
+      std::stringstream ss;
+      const auto align = 8;
+      ss << "Unmatched types around of unary operator " << op << '\n';
+      ss << std::left << "Requires " << op << " " << std::setw(align)
+         << allowed_type.arg_type << '\n';
+      ss << std::left << "Has      " << op << " " << std::setw(align)
+         << operand << '\n';
+      error(ss.str());
+    }
+    return ErrorType{};
+  }
+
+  auto binary_type(std::string_view op, const Func2Type& allowed_type,
+                   const Type& lhs, const Type& rhs) -> Type
+  {
+    if (eml::match(lhs, allowed_type.arg1_type) &&
+        eml::match(rhs, allowed_type.arg2_type)) {
+      return allowed_type.result_type;
+    }
+
+    if (!panic_mode) {
+      const auto align = 8;
+      std::stringstream ss;
+      ss << "Unmatched types around binary operator " << op << '\n';
+      ss << std::left << "Requires " << std::setw(align)
+         << allowed_type.arg1_type << std::setw(3) << op << std::setw(align)
+         << allowed_type.arg2_type << '\n';
+      ss << "Has      " << std::setw(align) << lhs << std::setw(3) << op
+         << std::setw(align) << rhs << '\n';
+      error(ss.str());
+    }
+    return ErrorType{};
+  }
+
+  auto equality_type(std::string_view op, const Type& lhs, const Type& rhs)
+      -> Type
+  {
+    if (eml::match(lhs, rhs)) {
+      return BoolType{};
+    }
+
+    if (!panic_mode) {
+      std::stringstream ss;
+      ss << "Unmatched types around comparison operator " << op << '\n';
+      ss << "Requires "
+         << "T " << op << " T\n";
+      ss << "where T: EqualityComparable\n";
+      ss << "Has " << lhs << " " << op << " " << rhs << '\n';
+      error(ss.str());
+    }
+    return ErrorType{};
+  }
+
+  auto if_type(const Type& cond, const Type& If, const Type& Else) -> Type
+  {
+    if (!eml::match(cond, BoolType{})) {
+      if (!panic_mode) {
+        std::stringstream ss;
+        ss << "I want a " << BoolType{} << " in condition of if expression\n";
+        ss << "Got " << cond << '\n';
+        error(ss.str());
+      }
+      return ErrorType{};
+    }
+
+    if (!eml::match(If, Else)) {
+      std::stringstream ss;
+      ss << "Type mismatch in branching!\n";
+      ss << "If branch: " << If << '\n';
+      ss << "Else branch: " << Else << '\n';
+      error(ss.str());
+      return ErrorType{};
+    }
+
+    return If;
+  }
+
+  void undefined_identifier(std::string_view name)
+  {
+    std::stringstream ss;
+    ss << "Undefined identifier: " << name << '\n';
+    error(ss.str());
+  }
+
+  TypeChecker(Compiler& c, Arena& a) : compiler(c), arena(a) {}
 
   void operator()([[maybe_unused]] LiteralExpr& constant) override
   {
@@ -37,15 +148,13 @@ struct TypeChecker : AstVisitor {
 
   void operator()(IdentifierExpr& id) override
   {
-    const auto query_result = compiler.get_global(id.name());
+    const auto query_result = compiler.get_global(id.symbol());
     if (query_result) {
       id.set_type(query_result->first);
       id.set_value(query_result->second);
     } else {
       id.set_type(ErrorType{});
-      std::stringstream ss;
-      ss << "Undefined identifier: " << id.name() << '\n';
-      error(ss.str());
+      undefined_identifier(id.name());
     }
   }
 
@@ -53,42 +162,17 @@ struct TypeChecker : AstVisitor {
                     const Func1Type& allowed_type)
   {
     expr.operand().accept(*this);
-    if (match(expr.operand().type(), allowed_type.arg_type)) {
-      expr.set_type(allowed_type.result_type);
-    } else {
-      expr.set_type(ErrorType{});
-      if (!panic_mode) {
-        std::stringstream ss;
-        const auto align = 8;
-        ss << "Unmatched types around of unary operator " << op << '\n';
-        ss << std::left << "Requires " << op << " " << std::setw(align)
-           << allowed_type.arg_type << '\n';
-        ss << std::left << "Has      " << op << " " << std::setw(align)
-           << expr.operand().type() << '\n';
-        error(ss.str());
-      }
-    }
+    expr.set_type(unary_type(op, allowed_type, expr.operand().type()));
   }
 
   void operator()(UnaryNegateExpr& expr) override
   {
-    unary_common(expr, "-", Func1Type{NumberType{}, NumberType{}});
+    unary_common(expr, "-", negate_type);
   }
 
   void operator()(UnaryNotExpr& expr) override
   {
-    unary_common(expr, "!", Func1Type{BoolType{}, BoolType{}});
-  }
-
-  void error(const std::string& message)
-  {
-    if (panic_mode) {
-      return;
-    }
-    has_error = true;
-    panic_mode = true;
-
-    errors.emplace_back(std::in_place_type<TypeError>, message);
+    unary_common(expr, "!", not_type);
   }
 
   void binary_common(BinaryOpExpr& expr, std::string_view op,
@@ -96,71 +180,36 @@ struct TypeChecker : AstVisitor {
   {
     expr.lhs().accept(*this);
     expr.rhs().accept(*this);
-    if (eml::match(expr.lhs().type(), allowed_type.arg1_type) &&
-        eml::match(expr.rhs().type(), allowed_type.arg2_type)) {
-      expr.set_type(allowed_type.result_type);
-    } else {
-      expr.set_type(ErrorType{});
-      if (!panic_mode) {
-        const auto align = 8;
-        std::stringstream ss;
-        ss << "Unmatched types around binary operator " << op << '\n';
-        ss << std::left << "Requires " << std::setw(align)
-           << allowed_type.arg1_type << std::setw(3) << op << std::setw(align)
-           << allowed_type.arg2_type << '\n';
-        ss << "Has      " << std::setw(align) << expr.lhs().type()
-           << std::setw(3) << op << std::setw(align) << expr.rhs().type()
-           << '\n';
-        error(ss.str());
-      }
-    }
+    expr.set_type(
+        binary_type(op, allowed_type, expr.lhs().type(), expr.rhs().type()));
   }
 
   void equality_common(BinaryOpExpr& expr, std::string_view op)
   {
     expr.lhs().accept(*this);
     expr.rhs().accept(*this);
-    if (eml::match(expr.lhs().type(), expr.rhs().type())) {
-      expr.set_type(BoolType{});
-    } else {
-      expr.set_type(ErrorType{});
-      if (!panic_mode) {
-        std::stringstream ss;
-        ss << "Unmatched types around comparison operator " << op << '\n';
-        ss << "Requires "
-           << "T " << op << " T\n";
-        ss << "where T: EqualityComparable\n";
-        ss << "Has " << expr.lhs().type() << " " << op << " "
-           << expr.rhs().type() << '\n';
-        error(ss.str());
-      }
-    }
+    expr.set_type(equality_type(op, expr.lhs().type(), expr.rhs().type()));
   }
 
   void operator()(PlusOpExpr& expr) override
   {
-    binary_common(expr, "+",
-                  Func2Type{NumberType{}, NumberType{}, NumberType{}});
+    binary_common(expr, "+", arithmetic_type);
   }
   void operator()(MinusOpExpr& expr) override
   {
-    binary_common(expr, "-",
-                  Func2Type{NumberType{}, NumberType{}, NumberType{}});
+    binary_common(expr, "-", arithmetic_type);
   }
   void operator()(MultOpExpr& expr) override
   {
-    binary_common(expr, "*",
-                  Func2Type{NumberType{}, NumberType{}, NumberType{}});
+    binary_common(expr, "*", arithmetic_type);
   }
   void operator()(DivOpExpr& expr) override
   {
-    binary_common(expr, "/",
-                  Func2Type{NumberType{}, NumberType{}, NumberType{}});
+    binary_common(expr, "/", arithmetic_type);
   }
   void operator()(AppendOpExpr& expr) override
   {
-    binary_common(expr, "++",
-                  Func2Type{StringType{}, StringType{}, StringType{}});
+    binary_common(expr, "++", append_type);
   }
   void operator()(EqOpExpr& expr) override
   {
@@ -172,48 +221,28 @@ struct TypeChecker : AstVisitor {
   }
   void operator()(LessOpExpr& expr) override
   {
-    binary_common(expr, "<", Func2Type{NumberType{}, NumberType{}, BoolType{}});
+    binary_common(expr, "<", comparison_type);
   }
   void operator()(LeOpExpr& expr) override
   {
-    binary_common(expr,
-                  "<=", Func2Type{NumberType{}, NumberType{}, BoolType{}});
+    binary_common(expr, "<=", comparison_type);
   }
   void operator()(GreaterOpExpr& expr) override
   {
-    binary_common(expr, ">", Func2Type{NumberType{}, NumberType{}, BoolType{}});
+    binary_common(expr, ">", comparison_type);
   }
   void operator()(GeExpr& expr) override
   {
-    binary_common(expr,
-                  ">=", Func2Type{NumberType{}, NumberType{}, BoolType{}});
+    binary_common(expr, ">=", comparison_type);
   }
 
   void operator()(IfExpr& expr) override
   {
-
     expr.cond().accept(*this);
     expr.If().accept(*this);
     expr.Else().accept(*this);
-
-    if (!eml::match(expr.cond().type(), BoolType{})) {
-      expr.set_type(ErrorType{});
-      if (!panic_mode) {
-        std::stringstream ss;
-        ss << "I want a " << BoolType{} << " in condition of if expression\n";
-        ss << "Got " << expr.cond().type() << '\n';
-        error(ss.str());
-      }
-    } else if (!eml::match(expr.If().type(), expr.Else().type())) {
-      expr.set_type(ErrorType{});
-      std::stringstream ss;
-      ss << "Type mismatch in branching!\n";
-      ss << "If branch: " << expr.If().type() << '\n';
-      ss << "Else branch: " << expr.Else().type() << '\n';
-      error(ss.str());
-    } else {
-      expr.set_type(expr.If().type());
-    }
+    expr.set_type(
+        if_type(expr.cond().type(), expr.If().type(), expr.Else().type()));
   }
 
   void operator()(LambdaExpr& expr) override
@@ -237,26 +266,29 @@ struct TypeChecker : AstVisitor {
       def.set_binding_type(def.to().type());
     }
 
-    // TODO(Lesley Lai): implement constant folding
+    // The value of a global must be known at compile time
+    if (!has_error) {
+      compiler.optimize(def.to_ptr(), arena);
+    }
     const auto v = eml::polymorphic_cast<const LiteralExpr*>(&def.to());
 
     if (v == nullptr) {
       error("Constant folding is unimplemented yet");
     } else {
-      compiler.add_global(std::string{def.identifier()}, *def.binding_type(),
-                          v->value());
+      compiler.add_global(def.symbol(), *def.binding_type(), v->value());
     }
   }
 
 }; // namespace
+
 } // anonymous namespace
 
-Compiler::TypeCheckResult Compiler::type_check(std::unique_ptr<AstNode>& ptr)
+Compiler::TypeCheckResult Compiler::type_check(Ast& ast)
 {
-  TypeChecker type_checker{*this};
-  ptr->accept(type_checker);
+  TypeChecker type_checker{*this, ast.arena()};
+  ast->accept(type_checker);
   if (!type_checker.has_error) {
-    return std::move(ptr);
+    return std::move(ast);
   } else {
     return unexpected{std::move(type_checker.errors)};
   }
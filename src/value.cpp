@@ -43,10 +43,16 @@ struct TypeValuePrinter {
     EML_UNREACHABLE();
   }
 
+  // Functions are not implemented yet
+  [[noreturn]] auto operator()(const FunctionType&) -> std::string
+  {
+    EML_UNREACHABLE();
+  }
+
   auto operator()(const StringType&) -> std::string
   {
     const auto ref = v.unsafe_as_reference();
-    std::string s{bit_cast<const char*>(ref->data()), ref->size()};
+    std::string s = to_std_string(*ref);
     s = "\"" + s + "\"";
     if (print_type == PrintType::yes) {
       s += ": String";
@@ -59,7 +65,7 @@ auto to_string(const Type& t, const Value& v, PrintType print_type)
     -> std::string
 {
   TypeValuePrinter printer{v, print_type};
-  return std::visit(printer, t);
+  return std::visit(printer, t.structure());
 }
 
 } // namespace eml
@@ -7,6 +7,8 @@
  */
 
 #include <iomanip>
+#include <cmath>
+#include <cstdint>
 #include <iostream>
 #include <limits>
 #include <optional>
@@ -14,6 +16,7 @@
 
 #include "common.hpp"
 #include "memory.hpp"
+#include "string.hpp"
 #include "type.hpp"
 
 namespace eml {
@@ -22,6 +25,144 @@ struct Value;
 auto to_string(const Type& t, const Value& v,
                PrintType print_type = PrintType::yes) -> std::string;
 
+#ifdef EML_NAN_BOXING
+
+/**
+ * @brief A NaN-boxed value of the EML VM
+ *
+ * All values are packed into 64 bits. A double is stored as itself. Every other
+ * kind of value lives inside the payload of a quiet NaN that no arithmetic
+ * operation produces:
+ *
+ * - unit and booleans are small tags in the low bits
+ * - references set the sign bit and keep the object address in the low 48
+ *   bits, which is enough for the user-space address of all 64-bit platforms
+ *   EML runs on
+ *
+ * NaNs passed to the constructor are canonicalized, so that a NaN with an
+ * unusual payload is never mistaken for a boxed value.
+ */
+struct Value {
+  static_assert(std::numeric_limits<double>::is_iec559,
+                "Embedded ML require IEEE 754 floating point number is in use");
+  static_assert(sizeof(void*) == sizeof(std::uint64_t),
+                "NaN boxing requires 64-bit pointers");
+
+  friend std::ostream& operator<<(std::ostream& os, const Value& value)
+  {
+    os << to_string(NumberType{}, value, PrintType::no);
+    return os;
+  }
+
+  Value() noexcept : bits_{unit_bits} {}
+  explicit Value(double v) noexcept
+      : bits_{std::isnan(v) ? canonical_nan_bits : bit_cast<std::uint64_t>(v)}
+  {
+  }
+  explicit Value(bool b) noexcept : bits_{b ? true_bits : false_bits} {}
+  explicit Value(GcPointer o) noexcept
+      : bits_{sign_bit | quiet_nan | reinterpret_cast<std::uintptr_t>(o.get())}
+  {
+  }
+
+  /**
+   * @brief Returns whether the value is a unit value
+   */
+  auto is_unit() const noexcept -> bool
+  {
+    return bits_ == unit_bits;
+  }
+
+  /**
+   * @brief Returns whether the value is a double
+   */
+  auto is_number() const noexcept -> bool
+  {
+    return (bits_ & quiet_nan) != quiet_nan;
+  }
+
+  /**
+   * @brief Returns the value as a number
+   * @warning The result is undefined if the value is actually not a double
+   */
+  auto unsafe_as_number() const noexcept -> double
+  {
+    return bit_cast<double>(bits_);
+  }
+
+  /**
+   * @brief Returns whether the value is a bool
+   */
+  auto is_boolean() const noexcept -> bool
+  {
+    return (bits_ | 1) == true_bits;
+  }
+
+  /**
+   * @brief Returns the value as a boolean
+   * @warning The result is undefined if the value is actually not a boolean
+   */
+  auto unsafe_as_boolean() const noexcept -> bool
+  {
+    return bits_ == true_bits;
+  }
+
+  /**
+   * @brief Returns whether the value is a reference
+   */
+  auto is_reference() const noexcept -> bool
+  {
+    return (bits_ & (sign_bit | quiet_nan)) == (sign_bit | quiet_nan);
+  }
+
+  /**
+   * @brief Extracts the underlying reference from the Value
+   * @warning The result is undefined if the value is actually not a reference
+   */
+  auto unsafe_as_reference() const noexcept -> GcPointer
+  {
+    return GcPointer{reinterpret_cast<Obj*>(bits_ & ~(sign_bit | quiet_nan))};
+  }
+
+  friend auto operator==(const Value& lhs, const Value& rhs) -> bool
+  {
+    if (lhs.is_number()) {
+      EML_ASSERT(rhs.is_number(),
+                 "equality test should only happen on the same type");
+      return lhs.unsafe_as_number() == rhs.unsafe_as_number();
+    }
+    if (lhs.is_reference()) {
+      EML_ASSERT(rhs.is_reference(),
+                 "equality test should only happen on the same type");
+      return string_equal(*lhs.unsafe_as_reference(),
+                          *rhs.unsafe_as_reference());
+    }
+    // Units and booleans are equal if their bits are equal
+    return lhs.bits_ == rhs.bits_;
+  }
+
+private:
+  static constexpr std::uint64_t sign_bit = 0x8000000000000000;
+  static constexpr std::uint64_t quiet_nan = 0x7ffc000000000000;
+  static constexpr std::uint64_t canonical_nan_bits = 0x7ff8000000000000;
+
+  static constexpr std::uint64_t unit_bits = quiet_nan | 1;
+  static constexpr std::uint64_t false_bits = quiet_nan | 2;
+  static constexpr std::uint64_t true_bits = quiet_nan | 3;
+
+  std::uint64_t bits_;
+};
+
+static_assert(sizeof(Value) == sizeof(std::uint64_t),
+              "A NaN-boxed value should fit in 8 bytes");
+
+inline auto operator!=(const Value& lhs, const Value& rhs)
+{
+  return !(lhs == rhs);
+}
+
+#else
+
 struct Value {
   static_assert(std::numeric_limits<double>::is_iec559,
                 "Embedded ML require IEEE 754 floating point number is in use");
@@ -140,7 +281,8 @@ constexpr auto operator==(const Value& lhs, const Value& rhs)
   case Value::type::Number:
     return lhs.unsafe_as_number() == rhs.unsafe_as_number();
   case Value::type::Reference:
-    return lhs.unsafe_as_reference() == rhs.unsafe_as_reference();
+    return string_equal(*lhs.unsafe_as_reference(),
+                        *rhs.unsafe_as_reference());
   case Value::type::Unit:
     return true;
   }
@@ -153,6 +295,35 @@ constexpr auto operator!=(const Value& lhs, const Value& rhs)
   return !(lhs == rhs);
 }
 
+#endif // EML_NAN_BOXING
+
+/// @brief Pins the object that v refers to, if v is a reference
+inline void pin(const Value& v) noexcept
+{
+  if (v.is_reference()) {
+    v.unsafe_as_reference()->pin();
+  }
+}
+
+/// @brief Unpins the object that v refers to, if v is a reference
+inline void unpin(const Value& v) noexcept
+{
+  if (v.is_reference()) {
+    v.unsafe_as_reference()->unpin();
+  }
+}
+
+/// @brief Marks the object that v refers to as reachable, if v is a
+/// reference. Updates v if the object moves.
+inline void mark(GarbageCollector& gc, Value& v)
+{
+  if (v.is_reference()) {
+    auto obj = v.unsafe_as_reference();
+    gc.mark(obj);
+    v = Value{obj};
+  }
+}
+
 } // namespace eml
 
 #endif // EML_VALUE_HPP
@@ -1,10 +1,14 @@
+#include <algorithm>
+#include <exception>
 #include <iomanip>
 #include <iostream>
 #include <sstream>
 #include <string_view>
+#include <variant>
 
 #include "common.hpp"
 #include "eml.hpp"
+#include "module.hpp"
 #include "parser.hpp"
 #include "string.hpp"
 
@@ -14,26 +18,58 @@ namespace eml {
 
 namespace {
 
+// Whether two values are equal. The ropes whose texts get compared keep their
+// flat texts, so comparing them again is as fast as comparing flat strings
+auto values_equal(Value lhs, Value rhs, GarbageCollector& gc) -> bool
+{
+  if (lhs.is_reference()) {
+    return string_equal(lhs.unsafe_as_reference(), rhs.unsafe_as_reference(),
+                        gc);
+  }
+  return lhs == rhs;
+}
+
+} // anonymous namespace
+
 // Push value to the stack
-void push(std::vector<Value>& stack, Value value)
+// Warning: Calling push on a full stack is undefined. The stack is sized for
+// the chunk up front.
+void VM::push(Value value)
 {
-  stack.push_back(value);
+  EML_ASSERT(stack_top_ != stack_.get() + stack_size_, "Push to a full stack");
+  *stack_top_ = value;
+  ++stack_top_;
 }
 
 // Returns the value to the last
 // Warning: Calling pop on a vm with empty stack is undefined.
-auto pop(std::vector<Value>& stack) -> Value
+auto VM::pop() -> Value
 {
-  Value v = stack.back();
-  stack.pop_back();
-  return v;
+  EML_ASSERT(stack_top_ != stack_.get(), "Pop from an empty stack");
+  --stack_top_;
+  return *stack_top_;
+}
+
+// Returns the value distance below the last without popping it
+// Warning: Calling peek on a vm without enough values on stack is undefined.
+auto VM::peek(std::ptrdiff_t distance) const -> Value
+{
+  EML_ASSERT(stack_top_ - stack_.get() > distance, "Peek pass the stack");
+  return *(stack_top_ - 1 - distance);
+}
+
+void VM::mark_roots(GarbageCollector& gc)
+{
+  for (auto* slot = stack_.get(); slot != stack_top_; ++slot) {
+    mark(gc, *slot);
+  }
 }
 
 // Helper for binary operations
-template <typename F> void binary_operation(std::vector<Value>& stack, F op)
+template <typename F> void VM::binary_operation(F op)
 {
-  Value right = pop(stack);
-  Value left = pop(stack);
+  Value right = pop();
+  Value left = pop();
 
   EML_ASSERT(left.is_number(),
              "The left operands of a binary operation must be a number.");
@@ -41,142 +77,739 @@ template <typename F> void binary_operation(std::vector<Value>& stack, F op)
   EML_ASSERT(right.is_number(),
              "The left operands of a binary operation must be a number.");
 
-  push(stack, Value{op(left.unsafe_as_number(), right.unsafe_as_number())});
+  push(Value{op(left.unsafe_as_number(), right.unsafe_as_number())});
 }
 
-template <typename F> void equality_operation(std::vector<Value>& stack, F op)
+// Helper for binary operations whose right operand is the constant right. The
+// result replaces the left operand on the top of the stack.
+template <typename F> void VM::constant_operation(F op, Value right)
 {
-  Value right = pop(stack);
-  Value left = pop(stack);
+  EML_ASSERT(stack_top_ != stack_.get(), "Operate on an empty stack");
+  Value& left = *(stack_top_ - 1);
+
+  EML_ASSERT(left.is_number(),
+             "The left operands of a binary operation must be a number.");
 
-  push(stack, Value{op(left, right)});
+  left = Value{op(left.unsafe_as_number(), right.unsafe_as_number())};
+}
+
+void VM::equality_operation(bool negate)
+{
+  push(Value{pop_equality() != negate});
 }
 
 // Helper for comparison operations
-template <typename F> void comparison_operation(std::vector<Value>& stack, F op)
+template <typename F> void VM::comparison_operation(F op)
+{
+  push(Value{pop_comparison(op)});
+}
+
+// Pops two values, and returns whether they are equal. The operands stay on
+// the stack until they are compared, since comparing strings may allocate
+auto VM::pop_equality() -> bool
+{
+  const auto equal = values_equal(peek(1), peek(), garbage_collector_);
+  pop();
+  pop();
+  return equal;
+}
+
+// Pops two numbers, and returns the result of the comparison op on them
+template <typename F> auto VM::pop_comparison(F op) -> bool
 {
-  Value right = pop(stack);
-  Value left = pop(stack);
+  Value right = pop();
+  Value left = pop();
 
-  push(stack, Value{op(left.unsafe_as_number(), right.unsafe_as_number())});
+  return op(left.unsafe_as_number(), right.unsafe_as_number());
 }
 
-} // anonymous namespace
+// The vm dispatches with either computed goto (a GNU extension supported by
+// GCC and Clang) or a portable switch. With computed goto, every instruction
+// handler ends with its own indirect jump, which gives the branch predictor a
+// separate history for each opcode instead of a single shared one.
+#ifdef EML_THREADED_DISPATCH
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+
+#define EML_VM_CASE(op) label_##op:
+#define EML_VM_DISPATCH()                                                      \
+  do {                                                                         \
+    if (ip == end) {                                                           \
+      goto interpret_end;                                                      \
+    }                                                                          \
+    trace(ip);                                                                 \
+    goto* dispatch_table[ip->op];                                              \
+  } while (0)
+#else
+#define EML_VM_CASE(op) case op:
+#define EML_VM_DISPATCH() continue
+#endif
+
+// Moves the instruction pointer pass the current instruction and executes the
+// next one. Not wrapped in `do {} while (0)`, since a `continue` inside would
+// not reach the loop of the switch dispatch.
+#define EML_VM_NEXT()                                                          \
+  {                                                                            \
+    ++ip;                                                                      \
+    EML_VM_DISPATCH();                                                         \
+  }
+
+// Returns the prepared form of code, and prepares it on the first call
+auto VM::prepared(const Bytecode& code)
+    -> std::shared_ptr<const PreparedBytecode>
+{
+  auto result = std::atomic_load(&code.prepared_);
+  if (result == nullptr) {
+    result = std::make_shared<const PreparedBytecode>(code);
+    std::atomic_store(&code.prepared_, result);
+  }
+  return result;
+}
+
+// Returns the native code of code, or nullopt if the jit does not support it,
+// and translates it on the first call
+auto VM::translated(const Bytecode& code)
+    -> std::shared_ptr<const std::optional<NativeCode>>
+{
+  auto result = std::atomic_load(&code.native_);
+  if (result == nullptr) {
+    result = std::make_shared<const std::optional<NativeCode>>(
+        jit_compile(code));
+    std::atomic_store(&code.native_, result);
+  }
+  return result;
+}
 
 auto VM::interpret(const Bytecode& code) -> std::optional<Value>
 {
-  size_t offset = 0;
+  if (execution_mode_ == ExecutionMode::jit) {
+    if (const auto native = translated(code); native->has_value()) {
+      return interpret(**native);
+    }
+  }
+  return interpret(*prepared(code));
+}
+
+auto VM::interpret(const NativeCode& code) -> std::optional<Value>
+{
+  const auto max_stack_depth = code.max_stack_depth();
+  if (max_stack_depth > stack_capacity_) {
+    throw StackOverflowError{"EML: Stack overflow"};
+  }
+  if (max_stack_depth > stack_size_) {
+    stack_ = std::make_unique<Value[]>(max_stack_depth);
+    stack_size_ = max_stack_depth;
+  }
+  jit_slots_.resize(std::max(jit_slots_.size(), max_stack_depth));
+
+  // The whole stack holds the references of native code, and the slots that
+  // hold no reference must not look like stale ones to the garbage collector
+  std::fill(stack_.get(), stack_.get() + max_stack_depth, Value{});
+  stack_top_ = stack_.get() + max_stack_depth;
+
+  std::exception_ptr error;
+  JitFrame frame{jit_slots_.data(), stack_.get(), &garbage_collector_.get(),
+                 &error, code.globals().slots()};
+  const auto succeed = code.run(frame);
+  stack_top_ = stack_.get();
+  if (!succeed) {
+    std::rethrow_exception(error);
+  }
+
+  if (code.result_depth() == 0) {
+    return {};
+  }
+  const auto top = code.result_depth() - 1;
+  switch (code.result_kind()) {
+  case JitValueKind::number:
+    return Value{jit_slots_[top]};
+  case JitValueKind::boolean:
+    return Value{jit_slots_[top] != 0};
+  case JitValueKind::unit:
+    return Value{};
+  case JitValueKind::reference:
+    // The result outlives the run, so it must not stay in the nursery
+    return Value{garbage_collector_.get().tenure(
+        stack_[top].unsafe_as_reference())};
+  }
+  return {}; // Unreachable
+}
+
+auto VM::interpret(const PreparedBytecode& code) -> std::optional<Value>
+{
   Value result{};
 
-  for (auto ip = code.instructions.begin(); ip != code.instructions.end();
-       ++ip) {
+  const auto max_stack_depth = code.max_stack_depth();
+  if (max_stack_depth > stack_capacity_) {
+    throw StackOverflowError{"EML: Stack overflow"};
+  }
+  if (max_stack_depth > stack_size_) {
+    stack_ = std::make_unique<Value[]>(max_stack_depth);
+    stack_size_ = max_stack_depth;
+  }
+  stack_top_ = stack_.get();
+
+  const auto* const begin = code.instructions().data();
+  const auto* const end = begin + code.instructions().size();
+  const auto* ip = begin;
+
+  // The slots of the module stay in place during the run, since only the
+  // compiler adds slots
+  Value* const globals = code.bytecode().globals.slots();
+
+  [[maybe_unused]] auto trace = [&](const PreparedInstruction* current_ip) {
     if constexpr (eml::build_options.debug_vm_trace_execution) {
       std::cout << "Stack: [";
 
-      for (auto i = stack_.begin(); i < stack_.end(); ++i) {
+      for (auto i = stack_.get(); i < stack_top_; ++i) {
         // std::cout << to_string(*i, PrintType::no);
-        if (i != stack_.end() - 1) {
+        if (i != stack_top_ - 1) {
           std::cout << ", ";
         }
       }
 
       std::cout << "]\n";
-      std::cout << code.disassemble_instruction(ip, offset) << '\n';
+      // Finds the bytes of the instruction, which is slow but only happens
+      // when tracing
+      const auto& bytecode = code.bytecode();
+      auto bytecode_ip = bytecode.instructions().begin();
+      for (auto* i = begin; i != current_ip; ++i) {
+        bytecode_ip += instruction_size(static_cast<opcode>(*bytecode_ip));
+      }
+      const auto offset = static_cast<std::size_t>(
+          bytecode_ip - bytecode.instructions().begin());
+      std::cout << bytecode.disassemble_instruction(bytecode_ip, offset)
+                << '\n';
     }
+  };
 
-    const auto instruction = *ip;
-    switch (static_cast<opcode>(instruction)) {
-    case op_return:
-      std::fputs("EML: Do not know how to handle return yet\n", stderr);
-      std::exit(-1);
-    case op_push_f64: {
-      ++ip;
-      Value constant = code.read_constant(ip);
-      push(stack_, constant);
-    } break;
-    case op_pop:
-      result = pop(stack_);
-      break;
-    case op_unit:
-      push(stack_, Value{});
-      break;
-    case op_true: {
-      push(stack_, Value{true});
-    } break;
-    case op_false: {
-      push(stack_, Value{false});
-    } break;
-    case op_negate_f64: {
-      [[maybe_unused]] const Value v = stack_.back();
-      EML_ASSERT(v.is_number(), "Operand of unary - must be a number.");
-      push(stack_, Value{-pop(stack_).unsafe_as_number()});
-    } break;
-    case op_not: {
-      [[maybe_unused]] const Value v = stack_.back();
-      EML_ASSERT(v.is_boolean(), "Operand of unary ! must be a boolean.");
-      push(stack_, Value{!pop(stack_).unsafe_as_boolean()});
-    } break;
-    case op_add_f64:
-      binary_operation(stack_, std::plus<double>{});
-      break;
-    case op_subtract_f64:
-      binary_operation(stack_, std::minus<double>{});
-      break;
-    case op_multiply_f64:
-      binary_operation(stack_, std::multiplies<double>{});
-      break;
-    case op_divide_f64:
-      binary_operation(stack_, std::divides<double>{});
-      break;
-    case op_string_cat: {
-      Value right = pop(stack_);
-      Value left = pop(stack_);
-      push(stack_,
-           Value{string_cat(left.unsafe_as_reference(),
-                            right.unsafe_as_reference(), garbage_collector_)});
-    } break;
-    case op_equal:
-      equality_operation(stack_, std::equal_to<Value>{});
-      break;
-    case op_not_equal:
-      equality_operation(stack_, std::not_equal_to<Value>{});
-      break;
-    case op_less_f64:
-      comparison_operation(stack_, std::less<double>{});
-      break;
-    case op_less_equal_f64:
-      comparison_operation(stack_, std::less_equal<double>{});
-      break;
-    case op_greater_f64:
-      comparison_operation(stack_, std::greater<double>{});
-      break;
-    case op_greater_equal_f64:
-      comparison_operation(stack_, std::greater_equal<double>{});
-      break;
-    case op_jmp: {
-      ++ip;
-      const auto jump_by = static_cast<int>(*ip);
-      ip += jump_by;
-    } break;
-
-    case op_jmp_false: {
-      ++ip;
-      if (!pop(stack_).unsafe_as_boolean()) {
-        const auto jump_by = static_cast<int>(*ip);
-        ip += jump_by;
-      }
+  // Moves the instruction pointer to the target of the current jump if it is
+  // taken, or to the next instruction otherwise
+  const auto branch = [&ip, begin](bool taken) {
+    ip = taken ? begin + ip->target : ip + 1;
+  };
+
+#ifdef EML_THREADED_DISPATCH
+  static void* const dispatch_table[] = {
+#define OPCODE_TABLE_ENTRY(op, stack_effect, operand_size) &&label_##op,
+#include "opcode_table.inc"
+#undef OPCODE_TABLE_ENTRY
+  };
+
+  EML_VM_DISPATCH();
+#else
+  while (ip != end) {
+    trace(ip);
+
+    switch (ip->op) {
+#endif
+  EML_VM_CASE(op_return)
+  {
+    std::fputs("EML: Do not know how to handle return yet\n", stderr);
+    std::exit(-1);
+  }
+  // Preparing turns the wide operand variants into the single byte ones, so
+  // they share the handlers
+  EML_VM_CASE(op_push_f64)
+  EML_VM_CASE(op_push_f64_long)
+  {
+    push(ip->constant);
+    EML_VM_NEXT();
+  }
+  EML_VM_CASE(op_pop)
+  {
+    result = pop();
+    EML_VM_NEXT();
+  }
+  EML_VM_CASE(op_unit)
+  {
+    push(Value{});
+    EML_VM_NEXT();
+  }
+  EML_VM_CASE(op_true)
+  {
+    push(Value{true});
+    EML_VM_NEXT();
+  }
+  EML_VM_CASE(op_false)
+  {
+    push(Value{false});
+    EML_VM_NEXT();
+  }
+  EML_VM_CASE(op_negate_f64)
+  {
+    EML_ASSERT(peek().is_number(), "Operand of unary - must be a number.");
+    push(Value{-pop().unsafe_as_number()});
+    EML_VM_NEXT();
+  }
+  EML_VM_CASE(op_not)
+  {
+    EML_ASSERT(peek().is_boolean(), "Operand of unary ! must be a boolean.");
+    push(Value{!pop().unsafe_as_boolean()});
+    EML_VM_NEXT();
+  }
+  EML_VM_CASE(op_add_f64)
+  {
+    binary_operation(std::plus<double>{});
+    EML_VM_NEXT();
+  }
+  EML_VM_CASE(op_subtract_f64)
+  {
+    binary_operation(std::minus<double>{});
+    EML_VM_NEXT();
+  }
+  EML_VM_CASE(op_multiply_f64)
+  {
+    binary_operation(std::multiplies<double>{});
+    EML_VM_NEXT();
+  }
+  EML_VM_CASE(op_divide_f64)
+  {
+    binary_operation(std::divides<double>{});
+    EML_VM_NEXT();
+  }
+  EML_VM_CASE(op_string_cat)
+  {
+    // Every reference is on the stack here, so young objects can move
+    garbage_collector_.get().safepoint();
+
+    // The operands stay on the stack until the result is allocated, since
+    // the allocation may run a collection
+    const auto result_string = string_cat(
+        peek(1).unsafe_as_reference(), peek().unsafe_as_reference(),
+        garbage_collector_, Generation::young);
+    pop();
+    pop();
+    push(Value{result_string});
+    EML_VM_NEXT();
+  }
+  EML_VM_CASE(op_equal)
+  {
+    equality_operation(false);
+    EML_VM_NEXT();
+  }
+  EML_VM_CASE(op_not_equal)
+  {
+    equality_operation(true);
+    EML_VM_NEXT();
+  }
+  EML_VM_CASE(op_less_f64)
+  {
+    comparison_operation(std::less<double>{});
+    EML_VM_NEXT();
+  }
+  EML_VM_CASE(op_less_equal_f64)
+  {
+    comparison_operation(std::less_equal<double>{});
+    EML_VM_NEXT();
+  }
+  EML_VM_CASE(op_greater_f64)
+  {
+    comparison_operation(std::greater<double>{});
+    EML_VM_NEXT();
+  }
+  EML_VM_CASE(op_greater_equal_f64)
+  {
+    comparison_operation(std::greater_equal<double>{});
+    EML_VM_NEXT();
+  }
+  EML_VM_CASE(op_jmp)
+  EML_VM_CASE(op_jmp_long)
+  {
+    branch(true);
+    EML_VM_DISPATCH();
+  }
+  EML_VM_CASE(op_jmp_false)
+  EML_VM_CASE(op_jmp_false_long)
+  {
+    branch(!pop().unsafe_as_boolean());
+    EML_VM_DISPATCH();
+  }
+  EML_VM_CASE(op_jmp_true)
+  EML_VM_CASE(op_jmp_true_long)
+  {
+    branch(pop().unsafe_as_boolean());
+    EML_VM_DISPATCH();
+  }
+  EML_VM_CASE(op_jmp_if_not_equal)
+  EML_VM_CASE(op_jmp_if_not_equal_long)
+  {
+    branch(!pop_equality());
+    EML_VM_DISPATCH();
+  }
+  EML_VM_CASE(op_jmp_if_equal)
+  EML_VM_CASE(op_jmp_if_equal_long)
+  {
+    branch(pop_equality());
+    EML_VM_DISPATCH();
+  }
+  EML_VM_CASE(op_jmp_if_not_less_f64)
+  EML_VM_CASE(op_jmp_if_not_less_f64_long)
+  {
+    branch(!pop_comparison(std::less<double>{}));
+    EML_VM_DISPATCH();
+  }
+  EML_VM_CASE(op_jmp_if_not_less_equal_f64)
+  EML_VM_CASE(op_jmp_if_not_less_equal_f64_long)
+  {
+    branch(!pop_comparison(std::less_equal<double>{}));
+    EML_VM_DISPATCH();
+  }
+  EML_VM_CASE(op_jmp_if_not_greater_f64)
+  EML_VM_CASE(op_jmp_if_not_greater_f64_long)
+  {
+    branch(!pop_comparison(std::greater<double>{}));
+    EML_VM_DISPATCH();
+  }
+  EML_VM_CASE(op_jmp_if_not_greater_equal_f64)
+  EML_VM_CASE(op_jmp_if_not_greater_equal_f64_long)
+  {
+    branch(!pop_comparison(std::greater_equal<double>{}));
+    EML_VM_DISPATCH();
+  }
+  EML_VM_CASE(op_add_f64_k)
+  {
+    constant_operation(std::plus<double>{}, ip->constant);
+    EML_VM_NEXT();
+  }
+  EML_VM_CASE(op_subtract_f64_k)
+  {
+    constant_operation(std::minus<double>{}, ip->constant);
+    EML_VM_NEXT();
+  }
+  EML_VM_CASE(op_multiply_f64_k)
+  {
+    constant_operation(std::multiplies<double>{}, ip->constant);
+    EML_VM_NEXT();
+  }
+  EML_VM_CASE(op_divide_f64_k)
+  {
+    constant_operation(std::divides<double>{}, ip->constant);
+    EML_VM_NEXT();
+  }
+  EML_VM_CASE(op_less_f64_k)
+  {
+    constant_operation(std::less<double>{}, ip->constant);
+    EML_VM_NEXT();
+  }
+  EML_VM_CASE(op_less_equal_f64_k)
+  {
+    constant_operation(std::less_equal<double>{}, ip->constant);
+    EML_VM_NEXT();
+  }
+  EML_VM_CASE(op_greater_f64_k)
+  {
+    constant_operation(std::greater<double>{}, ip->constant);
+    EML_VM_NEXT();
+  }
+  EML_VM_CASE(op_greater_equal_f64_k)
+  {
+    constant_operation(std::greater_equal<double>{}, ip->constant);
+    EML_VM_NEXT();
+  }
+  EML_VM_CASE(op_get_global)
+  EML_VM_CASE(op_get_global_long)
+  {
+    EML_ASSERT(globals != nullptr, "The chunk is not linked to a module");
+    push(globals[ip->slot]);
+    EML_VM_NEXT();
+  }
+  EML_VM_CASE(op_set_global)
+  EML_VM_CASE(op_set_global_long)
+  {
+    EML_ASSERT(globals != nullptr, "The chunk is not linked to a module");
+    // The global outlives the run, so it must not stay in the nursery
+    Value value = pop();
+    if (value.is_reference()) {
+      auto& gc = garbage_collector_.get();
+      value = Value{gc.tenure(value.unsafe_as_reference())};
+    }
+    globals[ip->slot] = value;
+    EML_VM_NEXT();
+  }
+#ifdef EML_THREADED_DISPATCH
+interpret_end:
+#else
     }
+  }
+#endif
+
+  if (stack_top_ == stack_.get()) {
+    return {};
+  }
+
+  // The result outlives the run, so it must not stay in the nursery
+  result = pop();
+  if (result.is_reference()) {
+    auto& gc = garbage_collector_.get();
+    result = Value{gc.tenure(result.unsafe_as_reference())};
+  }
+  return result;
+}
+
+auto VM::interpret(const RegisterBytecode& code) -> std::optional<Value>
+{
+  std::optional<Value> result;
+
+  const auto constant_count = code.constants.size();
+  if (code.register_count - constant_count > stack_capacity_) {
+    throw StackOverflowError{"EML: Stack overflow"};
+  }
+  if (code.register_count > stack_size_) {
+    stack_ = std::make_unique<Value[]>(code.register_count);
+    stack_size_ = code.register_count;
+  }
+
+  // The temporaries are cleared so that the garbage collector does not see
+  // the stale references of earlier runs
+  Value* const registers = stack_.get();
+  std::copy(code.constants.begin(), code.constants.end(), registers);
+  std::fill(registers + constant_count, registers + code.register_count,
+            Value{});
+  stack_top_ = registers + code.register_count;
+
+  const auto* const begin = code.instructions.data();
+  const auto* const end = begin + code.instructions.size();
+  const auto* ip = begin;
+
+  Value* const globals = code.globals.slots();
 
-    break;
+  [[maybe_unused]] auto trace = [&](const RegisterInstruction* current_ip) {
+    if constexpr (eml::build_options.debug_vm_trace_execution) {
+      std::cout << code.disassemble_instruction(
+                       static_cast<std::size_t>(current_ip - begin))
+                << '\n';
     }
+  };
+
+  const auto branch = [&ip, begin](bool taken) {
+    ip = taken ? begin + ip->target : ip + 1;
+  };
+
+  // dest = lhs op rhs, for the arithmetics and comparisons of numbers
+  const auto arithmetic = [&ip, registers](auto op) {
+    const Value left = registers[ip->lhs];
+    const Value right = registers[ip->rhs];
+
+    EML_ASSERT(left.is_number(),
+               "The left operands of a binary operation must be a number.");
+    EML_ASSERT(right.is_number(),
+               "The right operands of a binary operation must be a number.");
+
+    registers[ip->dest] =
+        Value{op(left.unsafe_as_number(), right.unsafe_as_number())};
+  };
 
-    ++offset;
+  const auto compare = [&ip, registers](auto op) {
+    return op(registers[ip->lhs].unsafe_as_number(),
+              registers[ip->rhs].unsafe_as_number());
+  };
+
+  const auto equal = [this, &ip, registers]() {
+    return values_equal(registers[ip->lhs], registers[ip->rhs],
+                        garbage_collector_);
+  };
+
+#ifdef EML_THREADED_DISPATCH
+  static void* const dispatch_table[] = {
+#define REGISTER_OPCODE_TABLE_ENTRY(op, dest, lhs, rhs) &&label_##op,
+#include "register_opcode_table.inc"
+#undef REGISTER_OPCODE_TABLE_ENTRY
+  };
+
+  EML_VM_DISPATCH();
+#else
+  while (ip != end) {
+    trace(ip);
+
+    switch (ip->op) {
+#endif
+  EML_VM_CASE(rop_return)
+  {
+    result = registers[ip->lhs];
+    goto interpret_end;
+  }
+  EML_VM_CASE(rop_move)
+  {
+    registers[ip->dest] = registers[ip->lhs];
+    EML_VM_NEXT();
+  }
+  EML_VM_CASE(rop_true)
+  {
+    registers[ip->dest] = Value{true};
+    EML_VM_NEXT();
+  }
+  EML_VM_CASE(rop_false)
+  {
+    registers[ip->dest] = Value{false};
+    EML_VM_NEXT();
+  }
+  EML_VM_CASE(rop_unit)
+  {
+    registers[ip->dest] = Value{};
+    EML_VM_NEXT();
+  }
+  EML_VM_CASE(rop_negate_f64)
+  {
+    EML_ASSERT(registers[ip->lhs].is_number(),
+               "Operand of unary - must be a number.");
+    registers[ip->dest] = Value{-registers[ip->lhs].unsafe_as_number()};
+    EML_VM_NEXT();
+  }
+  EML_VM_CASE(rop_not)
+  {
+    EML_ASSERT(registers[ip->lhs].is_boolean(),
+               "Operand of unary ! must be a boolean.");
+    registers[ip->dest] = Value{!registers[ip->lhs].unsafe_as_boolean()};
+    EML_VM_NEXT();
+  }
+  EML_VM_CASE(rop_add_f64)
+  {
+    arithmetic(std::plus<double>{});
+    EML_VM_NEXT();
   }
+  EML_VM_CASE(rop_subtract_f64)
+  {
+    arithmetic(std::minus<double>{});
+    EML_VM_NEXT();
+  }
+  EML_VM_CASE(rop_multiply_f64)
+  {
+    arithmetic(std::multiplies<double>{});
+    EML_VM_NEXT();
+  }
+  EML_VM_CASE(rop_divide_f64)
+  {
+    arithmetic(std::divides<double>{});
+    EML_VM_NEXT();
+  }
+  EML_VM_CASE(rop_string_cat)
+  {
+    // Every reference is in a register here, so young objects can move
+    garbage_collector_.get().safepoint();
 
-  if (stack_.empty()) {
-    return {};
+    registers[ip->dest] = Value{string_cat(
+        registers[ip->lhs].unsafe_as_reference(),
+        registers[ip->rhs].unsafe_as_reference(), garbage_collector_,
+        Generation::young)};
+    EML_VM_NEXT();
+  }
+  EML_VM_CASE(rop_equal)
+  {
+    registers[ip->dest] = Value{equal()};
+    EML_VM_NEXT();
+  }
+  EML_VM_CASE(rop_not_equal)
+  {
+    registers[ip->dest] = Value{!equal()};
+    EML_VM_NEXT();
+  }
+  EML_VM_CASE(rop_less_f64)
+  {
+    arithmetic(std::less<double>{});
+    EML_VM_NEXT();
+  }
+  EML_VM_CASE(rop_less_equal_f64)
+  {
+    arithmetic(std::less_equal<double>{});
+    EML_VM_NEXT();
+  }
+  EML_VM_CASE(rop_greater_f64)
+  {
+    arithmetic(std::greater<double>{});
+    EML_VM_NEXT();
+  }
+  EML_VM_CASE(rop_greater_equal_f64)
+  {
+    arithmetic(std::greater_equal<double>{});
+    EML_VM_NEXT();
   }
-  return pop(stack_);
+  EML_VM_CASE(rop_get_global)
+  {
+    EML_ASSERT(globals != nullptr, "The chunk is not linked to a module");
+    registers[ip->dest] = globals[ip->target];
+    EML_VM_NEXT();
+  }
+  EML_VM_CASE(rop_set_global)
+  {
+    EML_ASSERT(globals != nullptr, "The chunk is not linked to a module");
+    // The global outlives the run, so it must not stay in the nursery
+    Value value = registers[ip->lhs];
+    if (value.is_reference()) {
+      auto& gc = garbage_collector_.get();
+      value = Value{gc.tenure(value.unsafe_as_reference())};
+    }
+    globals[ip->target] = value;
+    EML_VM_NEXT();
+  }
+  EML_VM_CASE(rop_jmp)
+  {
+    branch(true);
+    EML_VM_DISPATCH();
+  }
+  EML_VM_CASE(rop_jmp_false)
+  {
+    branch(!registers[ip->lhs].unsafe_as_boolean());
+    EML_VM_DISPATCH();
+  }
+  EML_VM_CASE(rop_jmp_if_not_equal)
+  {
+    branch(!equal());
+    EML_VM_DISPATCH();
+  }
+  EML_VM_CASE(rop_jmp_if_equal)
+  {
+    branch(equal());
+    EML_VM_DISPATCH();
+  }
+  EML_VM_CASE(rop_jmp_if_not_less_f64)
+  {
+    branch(!compare(std::less<double>{}));
+    EML_VM_DISPATCH();
+  }
+  EML_VM_CASE(rop_jmp_if_not_less_equal_f64)
+  {
+    branch(!compare(std::less_equal<double>{}));
+    EML_VM_DISPATCH();
+  }
+  EML_VM_CASE(rop_jmp_if_not_greater_f64)
+  {
+    branch(!compare(std::greater<double>{}));
+    EML_VM_DISPATCH();
+  }
+  EML_VM_CASE(rop_jmp_if_not_greater_equal_f64)
+  {
+    branch(!compare(std::greater_equal<double>{}));
+    EML_VM_DISPATCH();
+  }
+#ifndef EML_THREADED_DISPATCH
+    }
+  }
+#endif
+interpret_end:
+
+  // The registers stop being roots once the run ends, and the result outlives
+  // the run, so it must not stay in the nursery
+  if (result && result->is_reference()) {
+    auto& gc = garbage_collector_.get();
+    result = Value{gc.tenure(result->unsafe_as_reference())};
+  }
+  stack_top_ = stack_.get();
+  return result;
 }
 
+auto VM::interpret(const Program& program) -> std::optional<Value>
+{
+  return std::visit([this](const auto& code) { return interpret(code); },
+                    program);
+}
+
+#undef EML_VM_NEXT
+#undef EML_VM_DISPATCH
+#undef EML_VM_CASE
+
+#ifdef EML_THREADED_DISPATCH
+#pragma GCC diagnostic pop
+#endif
+
 } // namespace eml
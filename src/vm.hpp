@@ -1,30 +1,174 @@
 #ifndef EML_VM_HPP
 #define EML_VM_HPP
 
+#include <memory>
+#include <stdexcept>
 #include <vector>
 
 #include "ast.hpp"
 #include "bytecode.hpp"
+#include "jit.hpp"
 #include "memory.hpp"
+#include "register_bytecode.hpp"
 
 namespace eml {
 
-class VM {
+/**
+ * @brief How the vm executes bytecode
+ */
+enum class ExecutionMode {
+  interpret, ///< @brief Interprets the instructions one by one
+  /// @brief Translates the bytecode into native code on its first run and runs
+  /// it, see jit_compile. Falls back to the interpreter for the code that the
+  /// jit does not support.
+  jit,
+};
+
+/**
+ * @brief Runtime configurations that decides how the eml vm should behave
+ */
+struct VMConfig {
+  /// @brief The maximum number of values the operand stack can hold
+  std::size_t stack_capacity = 256;
+  ExecutionMode execution_mode = ExecutionMode::interpret;
+};
+
+/**
+ * @brief Error raised when a running chunk pushes more values than the stack
+ * capacity of the vm
+ */
+class StackOverflowError : public std::runtime_error {
 public:
-  explicit VM(GarbageCollector& gc) noexcept : garbage_collector_{gc}
+  using std::runtime_error::runtime_error;
+};
+
+/**
+ * @brief The virtual machine that runs chunks of bytecode
+ *
+ * The values on the operand stack are roots of the garbage collector.
+ */
+class VM : private GcRootProvider {
+public:
+  /**
+   * @brief Constructs a vm object
+   * @arg gc The garbage collector that the vm allocates objects from
+   * @arg config Runtime configuration of the vm. If unprovided, have sensible
+   * defaults
+   */
+  explicit VM(GarbageCollector& gc, VMConfig config = {})
+      : stack_capacity_{config.stack_capacity},
+        execution_mode_{config.execution_mode}, garbage_collector_{gc}
+  {
+    garbage_collector_.get().add_root_provider(*this);
+  }
+
+  ~VM() override
   {
-    constexpr size_t initial_stack_size = 256;
-    stack_.reserve(initial_stack_size);
+    garbage_collector_.get().remove_root_provider(*this);
   }
 
+  VM(const VM&) = delete;
+  auto operator=(const VM&) -> VM& = delete;
+  VM(VM&&) = delete;
+  auto operator=(VM&&) -> VM& = delete;
+
   /**
    * @brief Interpret the current code in the vm
+   *
+   * The stack is sized by the maximum stack depth that preparing the chunk
+   * finds, so the check against the stack capacity happens once before the
+   * execution. The code gets prepared on its first run, see
+   * PreparedBytecode, or translated into native code in the jit execution
+   * mode, and later runs reuse the result until the chunk changes. Chunks that
+   * the jit does not support get translated only once, and then interpreted.
+   *
+   * @throw StackOverflowError if the code needs more stack slots than the
+   * stack capacity of the vm
+   * @throw StaleCodeError if a global that the code uses got redefined with
+   * another type since the code got compiled
+   * @warning The result is not a root of the garbage collector, callers that
+   * keep an object result across allocations need to pin it. It is never a
+   * young object, so it can be pinned.
    */
   [[nodiscard]] auto interpret(const Bytecode& code) -> std::optional<Value>;
 
+  /**
+   * @brief Interpret prepared code in the vm
+   *
+   * Same as interpreting the bytecode that got prepared, without decoding it
+   * again. Chunks that run many times should be prepared once and run through
+   * this overload.
+   *
+   * @throw StackOverflowError if the code needs more stack slots than the
+   * stack capacity of the vm
+   * @warning The result is not a root of the garbage collector, see the
+   * overload for Bytecode.
+   */
+  [[nodiscard]] auto interpret(const PreparedBytecode& code)
+      -> std::optional<Value>;
+
+  /**
+   * @brief Runs native code in the vm
+   *
+   * Same as interpreting the bytecode that got translated. Chunks that run
+   * many times should be translated once and run through this overload.
+   *
+   * @throw StackOverflowError if the code needs more stack slots than the
+   * stack capacity of the vm
+   * @warning The result is not a root of the garbage collector, see the
+   * overload for Bytecode.
+   */
+  [[nodiscard]] auto interpret(const NativeCode& code) -> std::optional<Value>;
+
+  /**
+   * @brief Interpret code of the register backend in the vm
+   *
+   * The registers live on the stack of the vm. The temporaries count against
+   * the stack capacity, the registers of the constants do not.
+   *
+   * @return The value of the return instruction, or nullopt if the code ends
+   * without one
+   * @throw StackOverflowError if the code needs more temporaries than the stack
+   * capacity of the vm
+   * @throw StaleCodeError if a global that the code uses got redefined with
+   * another type since the code got compiled
+   * @warning The result is not a root of the garbage collector, see the
+   * overload for Bytecode.
+   */
+  [[nodiscard]] auto interpret(const RegisterBytecode& code)
+      -> std::optional<Value>;
+
+  /**
+   * @brief Interpret a program of either backend in the vm
+   */
+  [[nodiscard]] auto interpret(const Program& program) -> std::optional<Value>;
+
 private:
-  std::vector<Value> stack_{}; // Stack of the vm
+  std::size_t stack_capacity_;     // Maximum number of values on the stack
+  ExecutionMode execution_mode_;
+  std::unique_ptr<Value[]> stack_; // Stack of the vm
+  std::size_t stack_size_ = 0;     // Number of allocated slots of the stack
+  Value* stack_top_ = nullptr;     // One pass the top value of the stack
+  std::vector<double> jit_slots_;  // Slots of native code, see JitFrame
   std::reference_wrapper<GarbageCollector> garbage_collector_;
+
+  void mark_roots(GarbageCollector& gc) override;
+
+  static auto prepared(const Bytecode& code)
+      -> std::shared_ptr<const PreparedBytecode>;
+  static auto translated(const Bytecode& code)
+      -> std::shared_ptr<const std::optional<NativeCode>>;
+
+  void push(Value value);
+  auto pop() -> Value;
+  [[nodiscard]] auto peek(std::ptrdiff_t distance = 0) const -> Value;
+
+  template <typename F> void binary_operation(F op);
+  template <typename F> void constant_operation(F op, Value right);
+  void equality_operation(bool negate);
+  template <typename F> void comparison_operation(F op);
+  auto pop_equality() -> bool;
+  template <typename F> auto pop_comparison(F op) -> bool;
 };
 
 } // namespace eml
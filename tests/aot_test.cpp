@@ -0,0 +1,85 @@
+#include <catch2/catch.hpp>
+
+#include <fstream>
+#include <functional>
+#include <sstream>
+
+#include "eml.hpp"
+
+// Generated by CMake from the sources in tests/aot
+#include "aot/corpus.hpp"
+
+namespace {
+
+auto printed(double v) -> std::string
+{
+  return eml::to_string(eml::NumberType{}, eml::Value{v}, eml::PrintType::no);
+}
+
+auto printed(bool v) -> std::string
+{
+  return eml::to_string(eml::BoolType{}, eml::Value{v}, eml::PrintType::no);
+}
+
+auto printed(eml::GcPointer v) -> std::string
+{
+  return eml::to_string(eml::StringType{}, eml::Value{v}, eml::PrintType::no);
+}
+
+struct AotCase {
+  const char* name;
+  std::function<std::string(eml::GarbageCollector&)> run;
+};
+
+template <typename Function>
+auto aot_case(const char* name, Function function) -> AotCase
+{
+  return {name, [function](eml::GarbageCollector& gc) {
+            return printed(function(gc));
+          }};
+}
+
+// Returns the value that the vm evaluates the source file to as a string
+auto interpreted(const std::string& name) -> std::string
+{
+  std::ifstream file{std::string{EML_AOT_CORPUS_DIR} + '/' + name + ".eml"};
+  std::stringstream source;
+  source << file.rdbuf();
+
+  eml::GarbageCollector gc{};
+  eml::Compiler compiler{
+      gc, eml::CompilerConfig{eml::SameScopeShadowing::warning,
+                              eml::OptimizationLevel::none}};
+  eml::VM vm{gc};
+
+  const auto result = compiler.compile(source.str());
+  REQUIRE(result.has_value());
+  const auto& [code, type] = *result;
+  const auto value = vm.interpret(code);
+  REQUIRE(value.has_value());
+  return eml::to_string(type, *value, eml::PrintType::no);
+}
+
+} // anonymous namespace
+
+TEST_CASE("Generated C++ code", "[eml.aot]")
+{
+  const AotCase cases[] = {
+#define AOT_CORPUS_ENTRY(name)                                                 \
+  aot_case(#name, name), aot_case(#name, name##_o0),
+      EML_AOT_CORPUS(AOT_CORPUS_ENTRY)
+#undef AOT_CORPUS_ENTRY
+  };
+
+  GIVEN("The functions that eml --emit-cpp generates from the sources")
+  {
+    THEN("They evaluate to the same values as the vm")
+    {
+      for (const auto& c : cases) {
+        CAPTURE(c.name);
+        eml::GarbageCollector gc{};
+        REQUIRE(c.run(gc) == interpreted(c.name));
+      }
+    }
+  }
+}
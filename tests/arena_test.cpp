@@ -0,0 +1,121 @@
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include <catch2/catch.hpp>
+
+#include "arena.hpp"
+
+#include "debug.hpp"
+#include "eml.hpp"
+
+namespace {
+
+// Records the order in which the objects get destroyed
+struct Tracked {
+  Tracked(std::vector<int>& log, int id) : log_{log}, id_{id} {}
+  ~Tracked()
+  {
+    log_.push_back(id_);
+  }
+
+  Tracked(const Tracked&) = delete;
+  auto operator=(const Tracked&) -> Tracked& = delete;
+  Tracked(Tracked&&) = delete;
+  auto operator=(Tracked&&) -> Tracked& = delete;
+
+  std::vector<int>& log_;
+  int id_;
+};
+
+struct alignas(16) Aligned {
+  char c = 0;
+};
+
+} // anonymous namespace
+
+TEST_CASE("Arena", "[memory]")
+{
+  GIVEN("Objects in an arena")
+  {
+    std::vector<int> log;
+    {
+      eml::Arena arena;
+      for (int i = 0; i < 3; ++i) {
+        arena.make<Tracked>(log, i);
+      }
+      REQUIRE(log.empty());
+    }
+
+    THEN("Destroying the arena destroys them in reverse order")
+    {
+      REQUIRE(log == std::vector{2, 1, 0});
+    }
+  }
+
+  GIVEN("An arena that moves")
+  {
+    std::vector<int> log;
+    eml::Arena arena;
+    auto* object = arena.make<Tracked>(log, 42);
+    eml::Arena moved{std::move(arena)};
+
+    THEN("The objects stay at the same address and get destroyed once")
+    {
+      REQUIRE(object->id_ == 42);
+      moved = eml::Arena{};
+      REQUIRE(log == std::vector{42});
+    }
+  }
+
+  GIVEN("More objects than the first chunk holds")
+  {
+    eml::Arena arena;
+    std::vector<Aligned*> objects;
+    for (int i = 0; i < 10000; ++i) {
+      objects.push_back(arena.make<Aligned>());
+      arena.make<char>('a');
+    }
+
+    THEN("Every object is aligned, and the arena grows")
+    {
+      const auto misaligned =
+          std::count_if(objects.begin(), objects.end(), [](const auto* o) {
+            return reinterpret_cast<std::uintptr_t>(o) % 16 != 0;
+          });
+      REQUIRE(misaligned == 0);
+      REQUIRE(arena.capacity() >= 10000 * (sizeof(Aligned) + 1));
+    }
+
+    THEN("An object larger than the chunks gets its own chunk")
+    {
+      struct Large {
+        char bytes[100000];
+      };
+      const auto before = arena.capacity();
+      REQUIRE(arena.make<Large>() != nullptr);
+      REQUIRE(arena.capacity() - before >= sizeof(Large));
+    }
+  }
+
+  GIVEN("A parsed source with string literals")
+  {
+    eml::GarbageCollector gc{};
+    const auto empty = gc.bytes_allocated();
+
+    THEN("The nodes keep the strings alive until the AST gets destroyed")
+    {
+      {
+        const auto ast =
+            eml::parse(R"(if ("abc" == "def") {"ghi"} else {"jkl"})", gc);
+        REQUIRE(ast.has_value());
+        gc.collect();
+        REQUIRE(gc.bytes_allocated() > empty);
+        REQUIRE(eml::to_string(**ast, eml::AstPrintOption::flat) ==
+                R"((if (== "abc" "def") "ghi" "jkl"))");
+      }
+      gc.collect();
+      REQUIRE(gc.bytes_allocated() == empty);
+    }
+  }
+}
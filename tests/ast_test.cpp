@@ -14,7 +14,9 @@ TEST_CASE("AST visiting and printing")
     {
       THEN("Should print (- 10)")
       {
-        eml::UnaryNegateExpr expr{eml::LiteralExpr::create(eml::Value{10.})};
+        eml::Arena arena;
+        eml::UnaryNegateExpr expr{
+            eml::LiteralExpr::create(arena, eml::Value{10.})};
 
         REQUIRE(eml::to_string(expr) == "(- 10)");
       }
@@ -23,14 +25,19 @@ TEST_CASE("AST visiting and printing")
 
   GIVEN("A binary arithmatic expression 3 * (4 + 5) / (-3 - 1)")
   {
+    eml::Arena arena;
     const eml::Expr_ptr expr = eml::DivOpExpr::create(
+        arena,
         eml::MultOpExpr::create(
-            eml::LiteralExpr::create(eml::Value{3.}),
-            eml::PlusOpExpr::create(eml::LiteralExpr::create(eml::Value{4.}),
-                                    eml::LiteralExpr::create(eml::Value{5.}))),
-        eml::MinusOpExpr::create(eml::UnaryNegateExpr::create(
-                                     eml::LiteralExpr::create(eml::Value{3.})),
-                                 eml::LiteralExpr::create(eml::Value{1.})));
+            arena, eml::LiteralExpr::create(arena, eml::Value{3.}),
+            eml::PlusOpExpr::create(
+                arena, eml::LiteralExpr::create(arena, eml::Value{4.}),
+                eml::LiteralExpr::create(arena, eml::Value{5.}))),
+        eml::MinusOpExpr::create(
+            arena,
+            eml::UnaryNegateExpr::create(
+                arena, eml::LiteralExpr::create(arena, eml::Value{3.})),
+            eml::LiteralExpr::create(arena, eml::Value{1.})));
     WHEN("Invoke the Ast Printer")
     {
       const auto str = eml::to_string(*expr);
@@ -51,13 +58,11 @@ TEST_CASE("AST visiting and printing")
         eml::Bytecode expected;
         push_number(expected, 3.);
         push_number(expected, 4.);
-        push_number(expected, 5.);
-        write_instruction(expected, eml::op_add_f64);
+        write_constant_operation(expected, eml::op_add_f64_k, 5.);
         write_instruction(expected, eml::op_multiply_f64);
         push_number(expected, 3.);
         write_instruction(expected, eml::op_negate_f64);
-        push_number(expected, 1.);
-        write_instruction(expected, eml::op_subtract_f64);
+        write_constant_operation(expected, eml::op_subtract_f64_k, 1.);
         write_instruction(expected, eml::op_divide_f64);
 
         REQUIRE(c.disassemble() == expected.disassemble());
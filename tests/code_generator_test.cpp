@@ -0,0 +1,592 @@
+#include <limits>
+
+#include <catch2/catch.hpp>
+
+#include "eml.hpp"
+#include "string.hpp"
+
+namespace {
+
+// Compiles source without optimizing it, so that the code of every
+// subexpression get generated. The chunk refers to objects of gc, so gc must
+// outlive it.
+auto compile(eml::GarbageCollector& gc, std::string_view source)
+    -> eml::Bytecode
+{
+  eml::Compiler compiler{gc};
+
+  auto result =
+      eml::parse(source, gc)
+          .and_then([&](auto ast) { return compiler.type_check(ast); })
+          .map([&](const auto& ast) { return compiler.generate_code(*ast); });
+  REQUIRE(result.has_value());
+  return std::get<0>(*result);
+}
+
+auto compile_registers(eml::GarbageCollector& gc, std::string_view source)
+    -> eml::RegisterBytecode
+{
+  eml::Compiler compiler{gc};
+
+  auto result =
+      eml::parse(source, gc)
+          .and_then([&](auto ast) { return compiler.type_check(ast); })
+          .and_then([&](const auto& ast) {
+            return compiler.generate_register_code(*ast);
+          });
+  REQUIRE(result.has_value());
+  return std::get<0>(*result);
+}
+
+auto run(eml::GarbageCollector& gc, const eml::Bytecode& code) -> double
+{
+  eml::VM vm{gc};
+
+  const auto result = vm.interpret(code);
+  REQUIRE(result.has_value());
+  REQUIRE(result->is_number());
+  return result->unsafe_as_number();
+}
+
+// Returns the source "1 + 2 + ... + n"
+auto sum_source(int n) -> std::string
+{
+  std::string source = "1";
+  for (int i = 2; i <= n; ++i) {
+    source += " + " + std::to_string(i);
+  }
+  return source;
+}
+
+// Returns the source of the sum of the numbers from first to last, which nests
+// its parentheses only logarithmically deep
+auto balanced_sum(std::size_t first, std::size_t last) -> std::string
+{
+  if (first == last) {
+    return std::to_string(first);
+  }
+  const auto middle = first + (last - first) / 2;
+  return '(' + balanced_sum(first, middle) + ") + (" +
+         balanced_sum(middle + 1, last) + ')';
+}
+
+} // anonymous namespace
+
+TEST_CASE("Maximum stack depth of generated code", "[code_generator]")
+{
+  eml::GarbageCollector gc{};
+
+  GIVEN("A left nested arithmetic expression 1 + 2 + 3 + 4")
+  {
+    THEN("Needs one stack slot, since the constants are operands")
+    {
+      REQUIRE(compile(gc, "1 + 2 + 3 + 4").max_stack_depth == 1);
+    }
+  }
+
+  GIVEN("A right nested arithmetic expression 1 + (2 + (3 + 4))")
+  {
+    THEN("Needs three stack slots")
+    {
+      REQUIRE(compile(gc, "1 + (2 + (3 + 4))").max_stack_depth == 3);
+    }
+  }
+
+  GIVEN("A branch if (1 < 2) {3} else {4 * (5 + 6)}")
+  {
+    THEN("Needs the stack slots of its deepest branch")
+    {
+      REQUIRE(
+          compile(gc, "if (1 < 2) {3} else {4 * (5 + 6)}").max_stack_depth ==
+          2);
+    }
+  }
+
+  GIVEN("A chain of else if")
+  {
+    THEN("The branches do not add up")
+    {
+      REQUIRE(compile(gc, "if (1 < 2) {3} else if (4 < 5) {6} else {7}")
+                  .max_stack_depth == 2);
+    }
+  }
+}
+
+TEST_CASE("Wide operands of generated code", "[code_generator]")
+{
+  eml::GarbageCollector gc{};
+
+  GIVEN("A small program")
+  {
+    const auto code = compile(gc, "if (1 < 2) {3} else {4}");
+    THEN("Only uses the single byte operand instructions")
+    {
+      const auto& instructions = code.instructions();
+      REQUIRE(std::find(instructions.begin(), instructions.end(),
+                        std::byte{eml::op_push_f64_long}) ==
+              instructions.end());
+      REQUIRE(code.instructions().size() == 12);
+    }
+  }
+
+  GIVEN("An expression with 300 distinct constants")
+  {
+    const auto code = compile(gc, sum_source(300));
+    THEN("Constants after the 256th are pushed by push_long")
+    {
+      REQUIRE(code.constants().size() == 300);
+      REQUIRE(run(gc, code) == 300. * 301. / 2.);
+    }
+  }
+
+  GIVEN("An expression that uses the same constant 300 times")
+  {
+    std::string source = "1";
+    for (int i = 1; i < 300; ++i) {
+      source += " + 1";
+    }
+    const auto code = compile(gc, source);
+    THEN("The constant takes one slot of the constant pool")
+    {
+      REQUIRE(code.constants().size() == 1);
+      REQUIRE(run(gc, code) == 300);
+    }
+  }
+
+  GIVEN("A branch that is longer than 255 bytes")
+  {
+    const auto source = "if (1 < 2) {" + sum_source(150) + "} else {" +
+                        sum_source(200) + "}";
+    THEN("The jumps over it are widened")
+    {
+      REQUIRE(run(gc, compile(gc, source)) == 150. * 151. / 2.);
+    }
+  }
+
+  GIVEN("A false condition before a long branch")
+  {
+    const auto source = "if (2 < 1) {" + sum_source(150) + "} else {" +
+                        sum_source(200) + "}";
+    THEN("Jumps to the else branch")
+    {
+      REQUIRE(run(gc, compile(gc, source)) == 200. * 201. / 2.);
+    }
+  }
+
+  GIVEN("A then branch that only fits a short jump before the other jump is "
+        "widened")
+  {
+    // The then branch is 252 bytes long
+    const auto source = "if (2 < 1) {" + sum_source(126) + "} else {" +
+                        sum_source(150) + "}";
+    THEN("Both jumps are widened")
+    {
+      const auto code = compile(gc, source);
+      REQUIRE(code.instructions()[4] ==
+              std::byte{eml::op_jmp_if_not_less_f64_long});
+      REQUIRE(run(gc, code) == 150. * 151. / 2.);
+    }
+  }
+}
+
+TEST_CASE("Branches on comparisons", "[code_generator]")
+{
+  eml::GarbageCollector gc{};
+
+  GIVEN("An if expression whose condition is a comparison")
+  {
+    const auto code = compile(gc, "if (1 < 2) {3} else {4}");
+
+    THEN("Compares and branches with one fused instruction")
+    {
+      REQUIRE(code.instructions()[4] == std::byte{eml::op_jmp_if_not_less_f64});
+      REQUIRE(std::count(code.instructions().begin(), code.instructions().end(),
+                         std::byte{eml::op_less_f64}) == 0);
+    }
+  }
+
+  GIVEN("Every comparison operator")
+  {
+    THEN("The fused branches take the same branch as the comparisons")
+    {
+      for (const auto* op : {"==", "!=", "<", "<=", ">", ">="}) {
+        for (const auto* operands : {"1 ? 2", "2 ? 2", "3 ? 2"}) {
+          std::string condition = operands;
+          condition.replace(condition.find('?'), 1, op);
+
+          const auto branch =
+              run(gc, compile(gc, "if (" + condition + ") {1} else {0}"));
+          const auto value = run(
+              gc, compile(gc, "if ((" + condition + ") == true) {1} else {0}"));
+          REQUIRE(branch == value);
+        }
+      }
+    }
+  }
+
+  GIVEN("A comparison before a long branch")
+  {
+    const auto source = "if (2 < 1) {" + sum_source(150) + "} else {" +
+                        sum_source(200) + "}";
+    THEN("The fused branch is widened")
+    {
+      REQUIRE(compile(gc, source).instructions()[4] ==
+              std::byte{eml::op_jmp_if_not_less_f64_long});
+      REQUIRE(run(gc, compile(gc, source)) == 200. * 201. / 2.);
+    }
+  }
+}
+
+TEST_CASE("Constant operands", "[code_generator]")
+{
+  eml::GarbageCollector gc{};
+
+  GIVEN("An arithmetic expression with constant right operands")
+  {
+    const auto code = compile(gc, "2 * 1.5 + 3");
+
+    THEN("Reads the constants as operands instead of pushing them")
+    {
+      const std::vector expected{
+          std::byte{eml::op_push_f64},      std::byte{0},
+          std::byte{eml::op_multiply_f64_k}, std::byte{1},
+          std::byte{eml::op_add_f64_k},      std::byte{2}};
+      REQUIRE(code.instructions() == expected);
+      REQUIRE(code.max_stack_depth == 1);
+      REQUIRE(run(gc, code) == 6);
+    }
+  }
+
+  GIVEN("A constant left operand")
+  {
+    const auto code = compile(gc, "10 - (2 / 4)");
+
+    THEN("Only the right operand of the inner operation is a constant")
+    {
+      REQUIRE(code.instructions()[4] == std::byte{eml::op_divide_f64_k});
+      REQUIRE(code.instructions()[6] == std::byte{eml::op_subtract_f64});
+      REQUIRE(run(gc, code) == 9.5);
+    }
+  }
+
+  GIVEN("Comparisons with a constant right operand")
+  {
+    THEN("Give the same results as the comparisons of two values")
+    {
+      for (const auto* op : {"<", "<=", ">", ">="}) {
+        for (const auto* operands : {"1 ? 2", "2 ? 2", "3 ? 2"}) {
+          std::string comparison = operands;
+          comparison.replace(comparison.find('?'), 1, op);
+
+          const auto constant = run(
+              gc,
+              compile(gc, "if ((" + comparison + ") == true) {1} else {0}"));
+          // The right operand of the comparison is not a constant
+          const auto value = run(
+              gc, compile(gc, "if ((" + comparison +
+                                  " + 0) == true) {1} else {0}"));
+          REQUIRE(constant == value);
+        }
+      }
+    }
+  }
+}
+
+TEST_CASE("Constant pool", "[code_generator]")
+{
+  eml::GarbageCollector gc{};
+  eml::Bytecode code;
+
+  GIVEN("Numbers with equal values but different bits")
+  {
+    const auto zero = code.add_constant(eml::Value{0.});
+    const auto negative_zero = code.add_constant(eml::Value{-0.});
+
+    THEN("They take different slots")
+    {
+      REQUIRE(zero != negative_zero);
+      REQUIRE(code.add_constant(eml::Value{-0.}) == negative_zero);
+    }
+  }
+
+  GIVEN("A NaN that is added twice")
+  {
+    const auto nan = std::numeric_limits<double>::quiet_NaN();
+    const auto first = code.add_constant(eml::Value{nan});
+
+    THEN("It takes one slot, although it is not equal to itself")
+    {
+      REQUIRE(code.add_constant(eml::Value{nan}) == first);
+      REQUIRE(code.constants().size() == 1);
+    }
+  }
+
+  GIVEN("Strings of the same text")
+  {
+    const auto first = code.add_constant(
+        eml::Value{eml::make_string("hello", gc)});
+    const auto second = code.add_constant(
+        eml::Value{eml::make_string("hello", gc)});
+
+    THEN("They take one slot")
+    {
+      REQUIRE(first == second);
+      REQUIRE(code.add_constant(eml::Value{eml::make_string("world", gc)}) !=
+              first);
+    }
+  }
+}
+
+TEST_CASE("Register code", "[code_generator]")
+{
+  eml::GarbageCollector gc{};
+
+  GIVEN("(1 + 2) * (3 + 4)")
+  {
+    const auto code = compile_registers(gc, "(1 + 2) * (3 + 4)");
+
+    THEN("Reads the constants from their registers, and reuses temporaries")
+    {
+      REQUIRE(code.constants.size() == 4);
+      REQUIRE(code.register_count == 6);
+      REQUIRE(code.disassemble() == "k0 = 1\n"
+                                    "k1 = 2\n"
+                                    "k2 = 3\n"
+                                    "k3 = 4\n"
+                                    "0000    add<f64> r4, k0, k1\n"
+                                    "0001    add<f64> r5, k2, k3\n"
+                                    "0002    mult<f64> r4, r4, r5\n"
+                                    "0003    return r4\n");
+    }
+  }
+
+  GIVEN("An if expression whose condition is a comparison")
+  {
+    const auto code =
+        compile_registers(gc, "if (1 < 2) {3} else {4 * (5 + 6)}");
+
+    THEN("Branches with a fused instruction, and computes the else branch in "
+         "the register of the result")
+    {
+      REQUIRE(code.disassemble() ==
+              "k0 = 1\n"
+              "k1 = 2\n"
+              "k2 = 3\n"
+              "k3 = 4\n"
+              "k4 = 5\n"
+              "k5 = 6\n"
+              "0000    jump_if_not_less<f64> k0, k1, 3\n"
+              "0001    move r6, k2\n"
+              "0002    jump 5\n"
+              "0003    add<f64> r6, k4, k5\n"
+              "0004    mult<f64> r6, k3, r6\n"
+              "0005    return r6\n");
+    }
+  }
+
+  GIVEN("A balanced sum of more distinct constants than there are registers")
+  {
+    const auto source = balanced_sum(1, eml::max_register_count + 1);
+    eml::Compiler compiler{
+        gc, eml::CompilerConfig{eml::SameScopeShadowing::warning,
+                                eml::OptimizationLevel::none,
+                                eml::Backend::registers}};
+    const auto result = compiler.compile_program(source);
+
+    THEN("Fails to compile with a code generation error")
+    {
+      REQUIRE(!result.has_value());
+      REQUIRE(result.error().size() == 1);
+      REQUIRE(std::holds_alternative<eml::CodeGenerationError>(
+          result.error()[0]));
+    }
+  }
+}
+
+TEST_CASE("Global slots", "[code_generator]")
+{
+  eml::GarbageCollector gc{};
+  eml::CompilerConfig config;
+  config.shadowing_policy = eml::SameScopeShadowing::allow;
+  eml::Compiler compiler{gc, config};
+  eml::VM vm{gc};
+
+  const auto compile = [&](std::string_view source) {
+    auto result = compiler.compile(source);
+    REQUIRE(result.has_value());
+    return std::get<0>(std::move(*result));
+  };
+
+  const auto run = [&](const eml::Bytecode& code) {
+    const auto result = vm.interpret(code);
+    REQUIRE(result.has_value());
+    return *result;
+  };
+
+  GIVEN("A chunk that uses a global")
+  {
+    REQUIRE(compiler.compile("let speed = 2").has_value());
+    const auto code = compile("speed * 10");
+
+    THEN("Reads the global from its slot instead of embedding its value")
+    {
+      REQUIRE(code.globals.module.get() == &compiler.module());
+      REQUIRE(code.constants().size() == 1);
+      REQUIRE(static_cast<eml::opcode>(code.instructions()[0]) ==
+              eml::op_get_global);
+      REQUIRE(run(code) == eml::Value{20.});
+    }
+
+    THEN("Sees a redefinition of the global with the same type")
+    {
+      REQUIRE(compiler.compile("let speed = 3").has_value());
+      REQUIRE(run(code) == eml::Value{30.});
+    }
+
+    THEN("Sees a new value set to the slot of the global")
+    {
+      const auto binding = compiler.module().find(eml::Symbol{"speed"});
+      REQUIRE(binding.has_value());
+      compiler.module().set_value(binding->slot, eml::Value{5.});
+      REQUIRE(run(code) == eml::Value{50.});
+      REQUIRE(compiler.get_global("speed")->second == eml::Value{5.});
+    }
+
+    THEN("Is stale once the global gets redefined with another type")
+    {
+      const auto slot = compiler.module().find(eml::Symbol{"speed"})->slot;
+      REQUIRE(compiler.compile("let speed = true").has_value());
+      REQUIRE(compiler.module().find(eml::Symbol{"speed"})->slot == slot);
+      REQUIRE_THROWS_AS(vm.interpret(code), eml::StaleCodeError);
+      REQUIRE(run(compile("if (speed) {1} else {0}")) == eml::Value{1.});
+    }
+
+    THEN("Running a definition stores its value to the slot again")
+    {
+      const auto definition = compile("let speed = 7");
+      REQUIRE(compiler.compile("let speed = 8").has_value());
+      REQUIRE(!vm.interpret(definition).has_value());
+      REQUIRE(run(code) == eml::Value{70.});
+    }
+  }
+
+  GIVEN("A chunk that outlives its compiler")
+  {
+    auto chunk = [&] {
+      eml::Compiler other{gc};
+      REQUIRE(other.compile("let other_name = \"Ann\"").has_value());
+      auto result = other.compile("other_name == \"Ann\"");
+      REQUIRE(result.has_value());
+      return std::get<0>(std::move(*result));
+    }();
+
+    THEN("Keeps the module of its globals alive")
+    {
+      gc.collect();
+      REQUIRE(run(chunk) == eml::Value{true});
+    }
+  }
+
+  GIVEN("More globals than slots that fit in a byte")
+  {
+    constexpr int count = 300;
+    for (int i = 0; i < count; ++i) {
+      const auto source =
+          "let slot_test_" + std::to_string(i) + " = " + std::to_string(i);
+      REQUIRE(compiler.compile(source).has_value());
+    }
+
+    THEN("The last ones are read with a wide operand")
+    {
+      const auto code = compile("slot_test_299 + slot_test_1");
+      REQUIRE(static_cast<eml::opcode>(code.instructions()[0]) ==
+              eml::op_get_global_long);
+      REQUIRE(static_cast<eml::opcode>(code.instructions()[4]) ==
+              eml::op_get_global);
+      REQUIRE(run(code) == eml::Value{300.});
+    }
+  }
+
+  GIVEN("Register code that uses a global")
+  {
+    eml::Compiler registers{
+        gc, eml::CompilerConfig{eml::SameScopeShadowing::allow,
+                                eml::OptimizationLevel::full,
+                                eml::Backend::registers}};
+    REQUIRE(registers.compile_program("let speed = 2").has_value());
+    const auto result = registers.compile_program("speed * 10");
+    REQUIRE(result.has_value());
+    const auto& code = std::get<eml::RegisterBytecode>(std::get<0>(*result));
+
+    THEN("Reads the global from its slot like stack bytecode")
+    {
+      REQUIRE(code.disassemble() == "k0 = 10\n"
+                                    "0000    get_global r1, slot 0\n"
+                                    "0001    mult<f64> r1, r1, k0\n"
+                                    "0002    return r1\n");
+      REQUIRE(vm.interpret(code)->unsafe_as_number() == Approx(20));
+    }
+
+    THEN("Sees a redefinition of the global")
+    {
+      const auto definition = registers.compile_program("let speed = 3");
+      REQUIRE(definition.has_value());
+      REQUIRE(registers.compile_program("let speed = 4").has_value());
+      REQUIRE(vm.interpret(code)->unsafe_as_number() == Approx(40));
+      REQUIRE(!vm.interpret(std::get<0>(*definition)).has_value());
+      REQUIRE(vm.interpret(code)->unsafe_as_number() == Approx(30));
+    }
+
+    THEN("Is stale once the global gets redefined with another type")
+    {
+      REQUIRE(registers.compile_program("let speed = \"fast\"").has_value());
+      REQUIRE_THROWS_AS(vm.interpret(code), eml::StaleCodeError);
+    }
+  }
+
+  GIVEN("C++ code that uses a global")
+  {
+    REQUIRE(compiler.compile("let speed = 2").has_value());
+    const auto result = compiler.compile_to_cpp("speed * 10", "speed_test");
+
+    THEN("Is an error, since the C++ function has no module to read it from")
+    {
+      REQUIRE(!result.has_value());
+      REQUIRE(result.error().size() == 1);
+      REQUIRE(std::holds_alternative<eml::CodeGenerationError>(
+          result.error()[0]));
+    }
+  }
+}
+
+TEST_CASE("C++ function names", "[code_generator]")
+{
+  eml::GarbageCollector gc{};
+  eml::Compiler compiler{gc};
+
+  GIVEN("A valid C++ identifier")
+  {
+    THEN("Names the generated function")
+    {
+      const auto result = compiler.compile_to_cpp("1 + 2", "add_test_2");
+      REQUIRE(result.has_value());
+      REQUIRE(result->find("inline auto add_test_2(") != std::string::npos);
+    }
+  }
+
+  GIVEN("Names that the generated C++ cannot use")
+  {
+    THEN("Are code generation errors")
+    {
+      for (const auto* name :
+           {"", "main", "int", "and", "eml", "2add", "add-test", "a b",
+            "add__test", "_Add"}) {
+        const auto result = compiler.compile_to_cpp("1 + 2", name);
+        REQUIRE(!result.has_value());
+        REQUIRE(result.error().size() == 1);
+        REQUIRE(std::holds_alternative<eml::CodeGenerationError>(
+            result.error()[0]));
+      }
+    }
+  }
+}
@@ -25,7 +25,7 @@ void verify_eml(const std::string_view source,
 
   if (!source.empty()) {
     eml::parse(source, gc)
-        .and_then([&](std::unique_ptr<eml::AstNode>&& ast) {
+        .and_then([&](eml::Ast&& ast) {
           if (for_documentation == ForDocumentation::no) {
             ss << "Parse into:\n" << eml::to_string(*ast) << "\n\n";
           }
@@ -0,0 +1,250 @@
+#include <catch2/catch.hpp>
+
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+#include "eml.hpp"
+
+#include "vm_test_util.hpp"
+
+namespace {
+
+// Returns the sources of the corpus in tests/aot, which the tests of the C++
+// backend also compare with the vm
+auto corpus() -> std::vector<std::string>
+{
+  std::vector<std::string> sources;
+  for (const auto& entry :
+       std::filesystem::directory_iterator{EML_AOT_CORPUS_DIR}) {
+    if (entry.path().extension() == ".eml") {
+      std::ifstream file{entry.path()};
+      std::stringstream source;
+      source << file.rdbuf();
+      sources.push_back(source.str());
+    }
+  }
+  return sources;
+}
+
+constexpr eml::OptimizationLevel optimization_levels[] = {
+    eml::OptimizationLevel::none, eml::OptimizationLevel::peephole,
+    eml::OptimizationLevel::full};
+
+// Returns the value that code evaluates to in vm as a string
+auto evaluate(eml::VM& vm, const eml::Bytecode& code, const eml::Type& type)
+    -> std::string
+{
+  const auto result = vm.interpret(code);
+  return result ? eml::to_string(type, *result) : "nothing";
+}
+
+// Returns "1 + (2 + (... + (n + tail)))"
+auto nested_sum(int n, const std::string& tail) -> std::string
+{
+  std::string source = tail;
+  for (int i = n; i >= 1; --i) {
+    source = std::to_string(i) + " + (" + source + ")";
+  }
+  return source;
+}
+
+} // anonymous namespace
+
+TEST_CASE("Native code", "[eml.jit]")
+{
+  GIVEN("The sources of the corpus")
+  {
+    const auto sources = corpus();
+    REQUIRE(!sources.empty());
+
+    THEN("The native code evaluates to the same values as the interpreter")
+    {
+      for (const auto level : optimization_levels) {
+        for (const auto& source : sources) {
+          CAPTURE(source, static_cast<int>(level));
+
+          eml::GarbageCollector gc{};
+          eml::Compiler compiler{
+              gc, eml::CompilerConfig{eml::SameScopeShadowing::warning, level}};
+          eml::VM interpreter{gc};
+          eml::VM jit{gc, eml::VMConfig{256, eml::ExecutionMode::jit}};
+
+          const auto result = compiler.compile(source);
+          REQUIRE(result.has_value());
+          const auto& [code, type] = *result;
+          if constexpr (eml::build_options.jit) {
+            REQUIRE(eml::jit_compile(code).has_value());
+          }
+          REQUIRE(evaluate(jit, code, type) ==
+                  evaluate(interpreter, code, type));
+        }
+      }
+    }
+  }
+
+  GIVEN("More values on the stack than the jit keeps in registers")
+  {
+    eml::GarbageCollector gc{};
+    eml::Compiler compiler{
+        gc, eml::CompilerConfig{eml::SameScopeShadowing::warning,
+                                eml::OptimizationLevel::none}};
+    eml::VM jit{gc, eml::VMConfig{256, eml::ExecutionMode::jit}};
+
+    THEN("The slots in memory hold their values across string operations")
+    {
+      const auto source =
+          nested_sum(20, R"(if ("a" ++ "b" == "ab") {1} else {2})");
+      const auto result = compiler.compile(source);
+      REQUIRE(result.has_value());
+      REQUIRE(jit.interpret(std::get<0>(*result))->unsafe_as_number() ==
+              Approx(211));
+    }
+  }
+
+  GIVEN("Globals of every type")
+  {
+    eml::GarbageCollector gc{};
+    eml::Compiler compiler{
+        gc, eml::CompilerConfig{eml::SameScopeShadowing::allow,
+                                eml::OptimizationLevel::none}};
+    eml::VM interpreter{gc};
+    eml::VM jit{gc, eml::VMConfig{256, eml::ExecutionMode::jit}};
+
+    for (const auto* definition :
+         {"let n = 2", "let b = true", "let u = ()", R"(let s = "ab")"}) {
+      const auto result = compiler.compile(definition);
+      REQUIRE(result.has_value());
+      REQUIRE(!jit.interpret(std::get<0>(*result)).has_value());
+    }
+
+    const auto compile = [&](const std::string& source) {
+      auto result = compiler.compile(source);
+      REQUIRE(result.has_value());
+      if constexpr (eml::build_options.jit) {
+        REQUIRE(eml::jit_compile(std::get<0>(*result)).has_value());
+      }
+      return std::move(*result);
+    };
+
+    THEN("The native code reads them from the slots of the module")
+    {
+      for (const auto* source :
+           {"n * 10", "if (b) {n} else {0}", "u == ()", R"(s ++ "c")",
+            R"(if (s == "ab") {n + n} else {n})"}) {
+        CAPTURE(source);
+        const auto [code, type] = compile(source);
+        REQUIRE(evaluate(jit, code, type) ==
+                evaluate(interpreter, code, type));
+      }
+    }
+
+    THEN("The values in registers survive reading a global")
+    {
+      const auto [code, type] = compile(nested_sum(20, "n"));
+      REQUIRE(jit.interpret(code)->unsafe_as_number() == Approx(212));
+    }
+
+    THEN("The native code of a definition writes the slot of the global")
+    {
+      const auto [definition, definition_type] = compile("let n = 5");
+      REQUIRE(compiler.compile("let n = 3").has_value());
+      const auto [code, type] = compile("n * 10");
+      REQUIRE(jit.interpret(code)->unsafe_as_number() == Approx(30));
+      REQUIRE(!jit.interpret(definition).has_value());
+      REQUIRE(jit.interpret(code)->unsafe_as_number() == Approx(50));
+    }
+
+    THEN("The native code is stale once a global changes its type")
+    {
+      const auto [code, type] = compile("n * 10");
+      REQUIRE(compiler.compile("let n = false").has_value());
+      REQUIRE_THROWS_AS(jit.interpret(code), eml::StaleCodeError);
+    }
+  }
+
+  GIVEN("A chunk that pushes three values")
+  {
+    eml::Bytecode code;
+    push_number(code, 1.);
+    push_number(code, 2.);
+    push_number(code, 3.);
+    write_instruction(code, eml::op_add_f64);
+    write_instruction(code, eml::op_add_f64);
+
+    eml::GarbageCollector gc{};
+
+    THEN("Raises a stack overflow error with a stack capacity of 2")
+    {
+      eml::VM jit{gc, eml::VMConfig{2, eml::ExecutionMode::jit}};
+      REQUIRE_THROWS_AS(jit.interpret(code), eml::StackOverflowError);
+    }
+
+    THEN("Evaluate to 6 with a stack capacity of 3")
+    {
+      eml::VM jit{gc, eml::VMConfig{3, eml::ExecutionMode::jit}};
+      REQUIRE(jit.interpret(code)->unsafe_as_number() == Approx(6));
+    }
+  }
+
+  GIVEN("A chunk that changes after it ran in the jit execution mode")
+  {
+    eml::GarbageCollector gc{};
+    eml::VM jit{gc, eml::VMConfig{256, eml::ExecutionMode::jit}};
+    eml::Bytecode code;
+    push_number(code, 1.);
+    for (int i = 0; i < 3; ++i) {
+      REQUIRE(jit.interpret(code)->unsafe_as_number() == Approx(1));
+    }
+
+    write_constant_operation(code, eml::op_add_f64_k, 2.);
+
+    THEN("The vm runs the new code instead of the code it translated before")
+    {
+      REQUIRE(jit.interpret(code)->unsafe_as_number() == Approx(3));
+    }
+  }
+
+  GIVEN("A chunk with a return instruction")
+  {
+    eml::Bytecode code;
+    write_instruction(code, eml::op_return);
+
+    THEN("The jit does not translate it")
+    {
+      REQUIRE(!eml::jit_compile(code).has_value());
+    }
+  }
+
+  GIVEN("A vm with a tiny nursery that concatenates strings in native code")
+  {
+    eml::GarbageCollector gc{eml::GcConfig{0, 512}};
+    eml::Compiler compiler{
+        gc, eml::CompilerConfig{eml::SameScopeShadowing::warning,
+                                eml::OptimizationLevel::none}};
+    eml::VM jit{gc, eml::VMConfig{256, eml::ExecutionMode::jit}};
+
+    std::string source = R"("a")";
+    std::string expected = "a";
+    for (int i = 0; i < 20; ++i) {
+      const auto text = std::string(40, static_cast<char>('b' + i % 25));
+      source += " ++ (\"" + text + "\" ++ \"" + text + "\")";
+      expected += text + text;
+    }
+
+    THEN("Collections keep the strings that the native code refers to")
+    {
+      const auto code = std::get<0>(*compiler.compile(source));
+      const auto native = eml::jit_compile(code);
+      if constexpr (eml::build_options.jit) {
+        REQUIRE(native.has_value());
+      }
+      for (int i = 0; i < 3; ++i) {
+        const auto result = jit.interpret(code);
+        REQUIRE(result.has_value());
+        REQUIRE(eml::to_string(eml::StringType{}, *result,
+                               eml::PrintType::no) == '"' + expected + '"');
+      }
+    }
+  }
+}
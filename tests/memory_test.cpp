@@ -1,3 +1,298 @@
+#include <algorithm>
+#include <cstring>
+#include <type_traits>
+
 #include <catch2/catch.hpp>
 
 #include "memory.hpp"
+
+#include "eml.hpp"
+#include "string.hpp"
+
+namespace {
+
+// Holds references to objects outside of the vm
+struct TestRoots : eml::GcRootProvider {
+  std::vector<eml::GcPointer> objects;
+
+  void mark_roots(eml::GarbageCollector& gc) override
+  {
+    for (auto& obj : objects) {
+      gc.mark(obj);
+    }
+  }
+};
+
+} // anonymous namespace
+
+TEST_CASE("Pool allocator", "[memory]")
+{
+  eml::PoolAllocator pool;
+
+  GIVEN("Blocks of different sizes")
+  {
+    constexpr std::size_t sizes[] = {1, 24, 32, 33, 100, 512, 513, 4096};
+    std::vector<void*> blocks;
+    for (const auto size : sizes) {
+      void* block = pool.allocate(size);
+      std::memset(block, 0xab, size);
+      blocks.push_back(block);
+    }
+
+    THEN("They are distinct and aligned")
+    {
+      for (std::size_t i = 0; i < blocks.size(); ++i) {
+        REQUIRE(reinterpret_cast<std::uintptr_t>(blocks[i]) %
+                    alignof(std::max_align_t) ==
+                0);
+        for (std::size_t j = i + 1; j < blocks.size(); ++j) {
+          REQUIRE(blocks[i] != blocks[j]);
+        }
+      }
+    }
+
+    for (std::size_t i = 0; i < blocks.size(); ++i) {
+      pool.deallocate(blocks[i], sizes[i]);
+    }
+  }
+
+  GIVEN("A freed block")
+  {
+    void* block = pool.allocate(40);
+    pool.deallocate(block, 40);
+
+    THEN("The next allocation of the same size class reuses it")
+    {
+      void* reused = pool.allocate(64);
+      REQUIRE(reused == block);
+      pool.deallocate(reused, 64);
+    }
+  }
+
+  GIVEN("More blocks than a slab holds")
+  {
+    constexpr std::size_t count =
+        2 * eml::PoolAllocator::slab_size / eml::PoolAllocator::min_block_size;
+    std::vector<void*> blocks;
+    for (std::size_t i = 0; i < count; ++i) {
+      blocks.push_back(pool.allocate(eml::PoolAllocator::min_block_size));
+    }
+
+    THEN("All of them are distinct")
+    {
+      std::sort(blocks.begin(), blocks.end());
+      REQUIRE(std::adjacent_find(blocks.begin(), blocks.end()) ==
+              blocks.end());
+    }
+
+    for (void* block : blocks) {
+      pool.deallocate(block, eml::PoolAllocator::min_block_size);
+    }
+  }
+}
+
+// Root providers refer to the collector they registered with, which therefore
+// cannot move
+static_assert(!std::is_move_constructible_v<eml::GarbageCollector>);
+static_assert(!std::is_move_assignable_v<eml::GarbageCollector>);
+
+TEST_CASE("Garbage collection", "[memory]")
+{
+  GIVEN("Objects that are unreachable")
+  {
+    eml::GarbageCollector gc{};
+    for (int i = 0; i < 10; ++i) {
+      [[maybe_unused]] const auto obj = gc.allocate(16);
+    }
+    REQUIRE(gc.bytes_allocated() >= 10 * 16);
+
+    THEN("A collection frees all of them")
+    {
+      gc.collect();
+      REQUIRE(gc.bytes_allocated() == 0);
+    }
+  }
+
+  GIVEN("An object that is marked by a root provider")
+  {
+    eml::GarbageCollector gc{};
+    TestRoots roots;
+    gc.add_root_provider(roots);
+
+    roots.objects.push_back(eml::make_string("alive", gc));
+    [[maybe_unused]] const auto garbage = eml::make_string("garbage", gc);
+    gc.collect();
+
+    THEN("Only the reachable object survives")
+    {
+      const auto live_bytes = gc.bytes_allocated();
+      roots.objects.clear();
+      gc.collect();
+      REQUIRE(live_bytes > 0);
+      REQUIRE(gc.bytes_allocated() == 0);
+    }
+
+    gc.remove_root_provider(roots);
+  }
+
+  GIVEN("A pinned object")
+  {
+    eml::GarbageCollector gc{};
+    const auto obj = eml::make_string("pinned", gc);
+    obj->pin();
+    gc.collect();
+
+    THEN("It survives collections until it get unpinned")
+    {
+      REQUIRE(gc.bytes_allocated() > 0);
+      REQUIRE(std::memcmp(obj->data(), "pinned", 6) == 0);
+
+      obj->unpin();
+      gc.collect();
+      REQUIRE(gc.bytes_allocated() == 0);
+    }
+  }
+
+  GIVEN("A garbage collector with a small threshold")
+  {
+    constexpr std::size_t threshold = 1024;
+    eml::GarbageCollector gc{eml::GcConfig{threshold}};
+
+    THEN("Allocating garbage does not grow the heap pass the threshold")
+    {
+      for (int i = 0; i < 1000; ++i) {
+        [[maybe_unused]] const auto obj = gc.allocate(64);
+        REQUIRE(gc.bytes_allocated() <= threshold);
+      }
+    }
+  }
+}
+
+TEST_CASE("Garbage collection while running programs", "[memory]")
+{
+  // Collects on every allocation
+  eml::GarbageCollector gc{eml::GcConfig{0}};
+  eml::Compiler compiler{gc};
+  eml::VM vm{gc};
+
+  auto run = [&](std::string_view source) -> std::string {
+    auto compile_result = compiler.compile(source);
+    REQUIRE(compile_result.has_value());
+    const auto& [bytecode, type] = *compile_result;
+    const auto result = vm.interpret(bytecode);
+    REQUIRE(result.has_value());
+    return eml::to_string(type, *result, eml::PrintType::no);
+  };
+
+  GIVEN("String literals and intermediate strings")
+  {
+    THEN("They are kept alive while they are in use")
+    {
+      REQUIRE(run(R"("a" ++ "b" ++ ("c" ++ "d") ++ "e")") == "\"abcde\"");
+    }
+  }
+
+  GIVEN("A global string definition")
+  {
+    REQUIRE(compiler.compile(R"(let s = "hello")").has_value());
+
+    THEN("It survives collections of later programs")
+    {
+      REQUIRE(run(R"("x" ++ "y")") == "\"xy\"");
+      REQUIRE(run(R"(s ++ " world")") == "\"hello world\"");
+    }
+  }
+
+  GIVEN("A program that runs many times")
+  {
+    const auto code = std::get<0>(*compiler.compile(R"("a" ++ "b")"));
+    for (int i = 0; i < 100; ++i) {
+      [[maybe_unused]] const auto result = vm.interpret(code);
+    }
+
+    THEN("The heap does not grow with the number of runs")
+    {
+      gc.collect();
+      const auto live_bytes = gc.bytes_allocated();
+      for (int i = 0; i < 100; ++i) {
+        [[maybe_unused]] const auto result = vm.interpret(code);
+      }
+      gc.collect();
+      REQUIRE(gc.bytes_allocated() == live_bytes);
+    }
+  }
+}
+
+TEST_CASE("Generational collection", "[memory]")
+{
+  constexpr auto young = eml::Generation::young;
+
+  GIVEN("A young object that a root provider refers to")
+  {
+    eml::GarbageCollector gc{};
+    TestRoots roots;
+    gc.add_root_provider(roots);
+
+    const auto obj = gc.allocate(5, young);
+    std::memcpy(obj->data(), "young", 5);
+    roots.objects.push_back(obj);
+    [[maybe_unused]] const auto garbage = gc.allocate(64, young);
+
+    THEN("A minor collection moves it out of the nursery, and drops the rest")
+    {
+      gc.collect_young();
+      const auto moved = roots.objects.front();
+      REQUIRE(moved.get() != obj.get());
+      REQUIRE(std::memcmp(moved->data(), "young", 5) == 0);
+      REQUIRE(gc.bytes_allocated() == eml::Obj::allocation_size(5));
+    }
+
+    gc.remove_root_provider(roots);
+  }
+
+  GIVEN("A full nursery")
+  {
+    eml::GarbageCollector gc{eml::GcConfig{1024, 256}};
+    for (int i = 0; i < 10; ++i) {
+      [[maybe_unused]] const auto obj = gc.allocate(32, young);
+    }
+    const auto bytes_before_safepoint = gc.bytes_allocated();
+
+    THEN("Allocations go to the old space until the next safepoint")
+    {
+      REQUIRE(bytes_before_safepoint > 256);
+      gc.safepoint();
+      REQUIRE(gc.bytes_allocated() < bytes_before_safepoint);
+    }
+  }
+
+  GIVEN("A vm with a tiny nursery")
+  {
+    eml::GarbageCollector gc{eml::GcConfig{0, 128}};
+    eml::Compiler compiler{gc};
+    eml::VM vm{gc};
+
+    std::string source = R"("a")";
+    std::string expected = "a";
+    for (int i = 0; i < 50; ++i) {
+      const auto letter = std::string(1, static_cast<char>('b' + i % 25));
+      source += " ++ \"" + letter + "\"";
+      expected += letter;
+    }
+
+    THEN("Many minor collections keep the intermediate strings")
+    {
+      const auto code = std::get<0>(*compiler.compile(source));
+      const auto result = vm.interpret(code);
+      REQUIRE(result.has_value());
+      REQUIRE(eml::to_string(eml::StringType{}, *result, eml::PrintType::no) ==
+              '"' + expected + '"');
+
+      AND_THEN("The result is not young")
+      {
+        REQUIRE(gc.tenure(result->unsafe_as_reference()) ==
+                result->unsafe_as_reference());
+      }
+    }
+  }
+}
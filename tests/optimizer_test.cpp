@@ -0,0 +1,320 @@
+#include <catch2/catch.hpp>
+
+#include "eml.hpp"
+#include "string.hpp"
+
+#include "vm_test_util.hpp"
+
+TEST_CASE("Constant folding", "[optimizer]")
+{
+  eml::GarbageCollector gc{};
+  eml::Compiler compiler{gc};
+
+  const auto compile = [&](std::string_view source) {
+    auto result = compiler.compile(source);
+    REQUIRE(result.has_value());
+    return std::get<0>(std::move(*result));
+  };
+
+  GIVEN("An arithmetic expression of literals")
+  {
+    const auto code = compile("(1 + 2) * 4 - -2 / 2");
+
+    THEN("Compiles to a push of its value")
+    {
+      eml::Bytecode expected;
+      push_number(expected, 13.);
+      REQUIRE(code.instructions() == expected.instructions());
+      REQUIRE(code.constants().size() == 1);
+      REQUIRE(code.constants()[0] == eml::Value{13.});
+    }
+  }
+
+  GIVEN("Comparisons and logical not of literals")
+  {
+    THEN("Compiles to a push of a boolean")
+    {
+      REQUIRE(compile("!(1 < 2)").instructions() ==
+              std::vector{std::byte{eml::op_false}});
+      REQUIRE(compile("(1 + 1) == 2").instructions() ==
+              std::vector{std::byte{eml::op_true}});
+      REQUIRE(compile(R"("ab" != ("a" ++ "b"))").instructions() ==
+              std::vector{std::byte{eml::op_false}});
+    }
+  }
+
+  GIVEN("A concatenation of string literals")
+  {
+    const auto code = compile(R"("hello" ++ " " ++ "world")");
+
+    THEN("Compiles to a push of the concatenated string")
+    {
+      REQUIRE(code.instructions().size() == 2);
+      REQUIRE(code.constants().size() == 1);
+      REQUIRE(eml::to_std_string(*code.constants()[0].unsafe_as_reference()) ==
+              "hello world");
+    }
+  }
+
+  GIVEN("An if expression with a constant condition")
+  {
+    const auto code = compile("if (2 > 1) {3 + 4} else {5}");
+
+    THEN("Only the branch that gets taken remains")
+    {
+      eml::Bytecode expected;
+      push_number(expected, 7.);
+      REQUIRE(code.instructions() == expected.instructions());
+    }
+  }
+
+  GIVEN("Global definitions")
+  {
+    REQUIRE(compiler.compile("let x = 2").has_value());
+    REQUIRE(compiler.compile("let y = x * 10 + 1").has_value());
+
+    THEN("The definitions fold after the substitution")
+    {
+      REQUIRE(compiler.get_global("y")->second == eml::Value{21.});
+    }
+
+    THEN("Expressions of them read the globals instead of folding")
+    {
+      const auto code = compile("y - x * (1 + 1)");
+      eml::Bytecode expected;
+      write_global(expected, eml::op_get_global, 1);
+      write_global(expected, eml::op_get_global, 0);
+      write_constant_operation(expected, eml::op_multiply_f64_k, 2.);
+      write_instruction(expected, eml::op_subtract_f64);
+      REQUIRE(code.instructions() == expected.instructions());
+    }
+
+    THEN("An expression that does not fold keeps its own node")
+    {
+      eml::Bytecode expected;
+      write_global(expected, eml::op_get_global, 0);
+      write_constant_operation(expected, eml::op_less_f64_k, 2.);
+      write_instruction(expected, eml::op_not);
+      REQUIRE(compile("!(x < 1 + 1)").instructions() ==
+              expected.instructions());
+
+      const auto code = compile("x * (1 + 1) + -(2 * 3)");
+      REQUIRE(eml::VM{gc}.interpret(code) == eml::Value{-2.});
+    }
+  }
+}
+
+TEST_CASE("Inlined globals", "[optimizer]")
+{
+  eml::GarbageCollector gc{};
+  eml::CompilerConfig config;
+  config.shadowing_policy = eml::SameScopeShadowing::allow;
+  config.inline_globals = true;
+  eml::Compiler compiler{gc, config};
+  eml::VM vm{gc};
+
+  REQUIRE(compiler.compile("let x = 2").has_value());
+  REQUIRE(compiler.compile("let y = x * 10 + 1").has_value());
+
+  GIVEN("An expression of globals")
+  {
+    const auto result = compiler.compile("y - x * (1 + 1)");
+    REQUIRE(result.has_value());
+    const auto& code = std::get<0>(*result);
+
+    THEN("Compiles to a push of its value")
+    {
+      eml::Bytecode expected;
+      push_number(expected, 17.);
+      REQUIRE(code.instructions() == expected.instructions());
+      REQUIRE(vm.interpret(code) == eml::Value{17.});
+    }
+
+    THEN("The code is stale once a global it inlined gets redefined")
+    {
+      REQUIRE(compiler.compile("let x = 3").has_value());
+      REQUIRE_THROWS_AS(vm.interpret(code), eml::StaleCodeError);
+    }
+
+    THEN("Redefining another global keeps the code valid")
+    {
+      REQUIRE(compiler.compile("let z = 3").has_value());
+      REQUIRE(compiler.compile("let z = 4").has_value());
+      REQUIRE(vm.interpret(code) == eml::Value{17.});
+    }
+  }
+
+  GIVEN("The same expression in register code")
+  {
+    eml::CompilerConfig register_config = config;
+    register_config.backend = eml::Backend::registers;
+    eml::Compiler registers{gc, register_config};
+    REQUIRE(registers.compile_program("let x = 2").has_value());
+    const auto result = registers.compile_program("x * 10 + 1");
+    REQUIRE(result.has_value());
+    const auto& program = std::get<0>(*result);
+
+    THEN("Folds to its value and gets stale the same way")
+    {
+      REQUIRE(std::get<eml::RegisterBytecode>(program).disassemble() ==
+              "k0 = 21\n"
+              "0000    return k0\n");
+      REQUIRE(vm.interpret(program) == eml::Value{21.});
+
+      REQUIRE(registers.compile_program("let x = 5").has_value());
+      REQUIRE_THROWS_AS(vm.interpret(program), eml::StaleCodeError);
+    }
+  }
+
+  GIVEN("The same expression in C++ code")
+  {
+    THEN("Compiles, since the value of the global is inlined")
+    {
+      REQUIRE(compiler.compile_to_cpp("x * 10 + 1", "inlined").has_value());
+    }
+  }
+}
+
+TEST_CASE("Peephole optimization", "[optimizer]")
+{
+  eml::GarbageCollector gc{};
+  eml::VM vm{gc};
+
+  const auto run = [&](const eml::Bytecode& code) {
+    const auto result = vm.interpret(code);
+    REQUIRE(result.has_value());
+    return result->unsafe_as_number();
+  };
+
+  GIVEN("A not followed by a jump if false")
+  {
+    eml::Bytecode code;
+    push_number(code, 1.);
+    push_number(code, 2.);
+    write_instruction(code, eml::op_less_f64);
+    write_instruction(code, eml::op_not);
+    write_jump(code, eml::op_jmp_false, 4);
+    push_number(code, 3.);
+    write_jump(code, eml::op_jmp, 2);
+    push_number(code, 4.);
+    const auto expected_result = run(code);
+    eml::peephole_optimize(code);
+
+    THEN("They fuse into a jump if true")
+    {
+      eml::Bytecode expected;
+      push_number(expected, 1.);
+      push_number(expected, 2.);
+      write_instruction(expected, eml::op_less_f64);
+      write_jump(expected, eml::op_jmp_true, 4);
+      push_number(expected, 3.);
+      write_jump(expected, eml::op_jmp, 2);
+      push_number(expected, 4.);
+      REQUIRE(code.instructions() == expected.instructions());
+      REQUIRE(code.lines().size() == code.instructions().size());
+      REQUIRE(run(code) == expected_result);
+    }
+  }
+
+  GIVEN("A jump if false on a constant true")
+  {
+    eml::Bytecode code;
+    write_instruction(code, eml::op_true);
+    write_jump(code, eml::op_jmp_false, 4);
+    push_number(code, 3.);
+    write_jump(code, eml::op_jmp, 2);
+    push_number(code, 4.);
+    eml::peephole_optimize(code);
+
+    THEN("Both get removed")
+    {
+      eml::Bytecode expected;
+      push_number(expected, 3.);
+      write_jump(expected, eml::op_jmp, 2);
+      push_number(expected, 4.);
+      REQUIRE(code.instructions() == expected.instructions());
+      REQUIRE(run(code) == 3.);
+    }
+  }
+
+  GIVEN("Two negations in a row")
+  {
+    eml::Bytecode code;
+    push_number(code, 3.);
+    write_instruction(code, eml::op_negate_f64);
+    write_instruction(code, eml::op_negate_f64);
+    eml::peephole_optimize(code);
+
+    THEN("They cancel out")
+    {
+      eml::Bytecode expected;
+      push_number(expected, 3.);
+      REQUIRE(code.instructions() == expected.instructions());
+    }
+  }
+
+  GIVEN("A jump to another jump")
+  {
+    eml::Bytecode code;
+    push_number(code, 1.);
+    push_number(code, 2.);
+    write_instruction(code, eml::op_less_f64);
+    write_jump(code, eml::op_jmp_false, 4);
+    push_number(code, 5.);
+    write_jump(code, eml::op_jmp, 2);
+    push_number(code, 6.);
+    write_jump(code, eml::op_jmp, 2);
+    push_number(code, 7.);
+    eml::peephole_optimize(code);
+
+    THEN("Goes to the final target directly")
+    {
+      eml::Bytecode expected;
+      push_number(expected, 1.);
+      push_number(expected, 2.);
+      write_instruction(expected, eml::op_less_f64);
+      write_jump(expected, eml::op_jmp_false, 4);
+      push_number(expected, 5.);
+      write_jump(expected, eml::op_jmp, 6);
+      push_number(expected, 6.);
+      write_jump(expected, eml::op_jmp, 2);
+      push_number(expected, 7.);
+      REQUIRE(code.instructions() == expected.instructions());
+      REQUIRE(run(code) == 5.);
+    }
+  }
+
+  GIVEN("Compilers with different optimization levels")
+  {
+    const auto source = "if (!(1 < 2)) {3} else {-(-4)}";
+    const auto compile = [&](eml::OptimizationLevel level) {
+      eml::CompilerConfig config;
+      config.optimization_level = level;
+      eml::Compiler compiler{gc, config};
+      return std::get<0>(*compiler.compile(source));
+    };
+    const auto none = compile(eml::OptimizationLevel::none);
+    const auto peephole = compile(eml::OptimizationLevel::peephole);
+
+    THEN("Only the higher levels optimize the code")
+    {
+      const auto has = [](const eml::Bytecode& code, eml::opcode op) {
+        const auto& instructions = code.instructions();
+        for (auto ip = instructions.begin(); ip != instructions.end();
+             ip += eml::instruction_size(static_cast<eml::opcode>(*ip))) {
+          if (*ip == std::byte{op}) {
+            return true;
+          }
+        }
+        return false;
+      };
+      REQUIRE(has(none, eml::op_not));
+      REQUIRE(!has(peephole, eml::op_not));
+      REQUIRE(has(peephole, eml::op_jmp_true));
+      REQUIRE(!has(peephole, eml::op_negate_f64));
+      REQUIRE(run(none) == 4.);
+      REQUIRE(run(peephole) == 4.);
+      REQUIRE(compile(eml::OptimizationLevel::full).instructions().size() == 2);
+    }
+  }
+}
@@ -0,0 +1,206 @@
+#include <cstdlib>
+#include <string>
+
+#include <catch2/catch.hpp>
+
+#include "eml.hpp"
+
+namespace {
+
+// Sources in the static subset, which the compiler evaluates to the same values
+constexpr const char* corpus[] = {
+    "(2 + 3) / 4 - 2 * 5",
+    "2 * 1.5 + 3",
+    "0.1 + 0.2",
+    "(1 + 2) * 4 - -2 / 2",
+    "-(-4)",
+    "!(1 < 2)",
+    "(1 + 1) == 2",
+    "true != false",
+    "0 / 0 == 0 / 0",
+    "0 / 0 != 0 / 0",
+    "if (1 < 2) {3} else if (4 < 5) {6} else {7}",
+    "if (!(1 == 2)) {if (true) {-1} else {2}} else {3}",
+    "if ((1 == 1) == (2 <= 3)) {1 >= 2} else {1 > 2}",
+};
+
+constexpr auto area_program =
+    eml::static_compile("if (r < 0) {0} else {3 * r * r + h * 0}");
+constexpr auto is_inside_program =
+    eml::static_compile("!(x < 0 == x > 1) == (x * x != x * x)");
+
+auto printed(eml::StaticValue v) -> std::string
+{
+  return v.type == eml::StaticType::number
+             ? eml::to_string(eml::NumberType{}, eml::Value{v.number})
+             : eml::to_string(eml::BoolType{}, eml::Value{v.boolean});
+}
+
+} // anonymous namespace
+
+TEST_CASE("Static evaluation", "[eml.static_eval]")
+{
+  GIVEN("Constant sources")
+  {
+    THEN("Evaluate at C++ compile time")
+    {
+      static_assert(eml::static_eval("1 + 2 * 3").as_number() == 7);
+      static_assert(eml::static_eval("(1 + 2) * 3").as_number() == 9);
+      static_assert(eml::static_eval("10 - 4 - 3").as_number() == 3);
+      static_assert(eml::static_eval("-2 * -2 == 4").as_boolean());
+      static_assert(eml::static_eval("1.25 * 4").as_number() == 5);
+      static_assert(
+          eml::static_eval("if (1 > 2) {1} else if (true) {2} else {3}")
+              .as_number() == 2);
+    }
+
+    THEN("Evaluate to the same values as the compiler")
+    {
+      for (const auto* source : corpus) {
+        CAPTURE(source);
+
+        eml::GarbageCollector gc{};
+        eml::Compiler compiler{gc};
+        eml::VM vm{gc};
+        const auto result = compiler.compile(source);
+        REQUIRE(result.has_value());
+        const auto& [code, type] = *result;
+        REQUIRE(printed(eml::static_eval(source)) ==
+                eml::to_string(type, *vm.interpret(code)));
+      }
+    }
+  }
+
+  GIVEN("A source with variables")
+  {
+    constexpr auto area = area_program;
+
+    THEN("The program takes them in order of first appearance")
+    {
+      static_assert(area.variable_count() == 2);
+      static_assert(area.variable_name(0) == "r");
+      static_assert(area.variable_name(1) == "h");
+      static_assert(area.type() == eml::StaticType::number);
+    }
+
+    THEN("The program evaluates with the values of the arguments")
+    {
+      static_assert(area(2, 5).as_number() == 12);
+      static_assert(area(-1., 5).as_number() == 0);
+
+      volatile double r = 3;
+      REQUIRE(area(r, 0).as_number() == 27);
+    }
+
+    THEN("Running it with the wrong number of arguments throws")
+    {
+      REQUIRE_THROWS_AS(area(1), eml::StaticEvalError);
+    }
+  }
+
+  GIVEN("A program compiled from a string that no longer exists")
+  {
+    const auto program = [] {
+      const std::string source = "radius * 2 + offset";
+      return eml::static_compile(source);
+    }();
+
+    THEN("The program keeps the names of its variables")
+    {
+      REQUIRE(program.variable_count() == 2);
+      REQUIRE(program.variable_name(0) == "radius");
+      REQUIRE(program.variable_name(1) == "offset");
+      REQUIRE(program(3, 1).as_number() == 7);
+    }
+  }
+
+  GIVEN("Number literals")
+  {
+    constexpr const char* literals[] = {
+        "0.1",
+        "1.50",
+        "0.000001",
+        "123456789012345",
+        "9007199254740992",
+        "0.9007199254740991",
+        "1000000000000000000000000000000",
+    };
+
+    THEN("Evaluate to the same numbers as the compiler")
+    {
+      static_assert(eml::static_eval("0.1").as_number() == 0.1);
+      for (const auto* literal : literals) {
+        CAPTURE(literal);
+        REQUIRE(eml::static_eval(literal).as_number() ==
+                std::strtod(literal, nullptr));
+      }
+    }
+
+    THEN("Literals that need more precision than a double throw")
+    {
+      for (const auto* literal :
+           {"0.1000000000000000055511151231257827", "9007199254740993",
+            "12345678901234567890", "0.00000000000000000000001"}) {
+        CAPTURE(literal);
+        REQUIRE_THROWS_AS(eml::static_compile(literal), eml::StaticEvalError);
+      }
+    }
+  }
+
+  GIVEN("The functions that static_function generates from programs")
+  {
+    constexpr auto area = eml::static_function<area_program>();
+    constexpr auto is_inside = eml::static_function<is_inside_program>();
+
+    THEN("They return C++ values of the type of the program")
+    {
+      static_assert(std::is_same_v<decltype(area(1., 2.)), double>);
+      static_assert(std::is_same_v<decltype(is_inside(1.)), bool>);
+    }
+
+    THEN("They evaluate to the same values as the programs")
+    {
+      static_assert(area(2, 5) == 12);
+      static_assert(is_inside(0.5));
+      static_assert(!is_inside(2));
+
+      for (const double x : {-3., -0.5, 0., 0.25, 1., 7.}) {
+        CAPTURE(x);
+        REQUIRE(area(x, 1.) == area_program(x, 1.).as_number());
+        REQUIRE(is_inside(x) == is_inside_program(x).as_boolean());
+      }
+    }
+  }
+
+  GIVEN("Sources outside of the static subset or with type errors")
+  {
+    constexpr const char* errors[] = {
+        "1 + true",
+        "!1",
+        "if (1) {2} else {3}",
+        "if (true) {2} else {false}",
+        "1 == true",
+        R"("str")",
+        "(1 + 2",
+        "1 2",
+        "let x = 1",
+    };
+
+    THEN("Compiling them throws")
+    {
+      for (const auto* source : errors) {
+        CAPTURE(source);
+        REQUIRE_THROWS_AS(eml::static_compile(source), eml::StaticEvalError);
+      }
+    }
+  }
+
+  GIVEN("A boolean result")
+  {
+    THEN("Asking for a number throws")
+    {
+      REQUIRE_THROWS_AS(eml::static_eval("1 < 2").as_number(),
+                        eml::StaticEvalError);
+    }
+  }
+}
@@ -1,3 +1,6 @@
+#include <cstring>
+#include <limits>
+
 #include <catch2/catch.hpp>
 
 #include "eml.hpp"
@@ -27,3 +30,265 @@ TEST_CASE("String tests", "[string]")
         .map_error([](const auto&) { FAIL("File to compile "); });
   }
 }
+
+TEST_CASE("String interning", "[string]")
+{
+  GIVEN("Two strings made from the same text")
+  {
+    eml::GarbageCollector gc;
+    const auto s1 = eml::make_string("hello", gc);
+    const auto s2 = eml::make_string("hello", gc);
+
+    THEN("They are the same object")
+    {
+      REQUIRE(s1 == s2);
+      REQUIRE(s1->is_interned());
+    }
+  }
+
+  GIVEN("An interned string that is no longer used")
+  {
+    eml::GarbageCollector gc;
+    [[maybe_unused]] const auto s1 = eml::make_string("hello", gc);
+    gc.collect();
+
+    THEN("The collection removes it from the interning table")
+    {
+      REQUIRE(gc.bytes_allocated() == 0);
+      const auto s2 = eml::make_string("hello", gc);
+      REQUIRE(std::memcmp(s2->data(), "hello", 5) == 0);
+    }
+  }
+
+  GIVEN("A short concatenation result")
+  {
+    eml::GarbageCollector gc;
+    const auto hello = eml::make_string("hello", gc);
+    const auto world = eml::make_string(" world", gc);
+    const auto s = eml::string_cat(hello, world, gc);
+
+    THEN("It is the interned string of its text")
+    {
+      REQUIRE(s == eml::make_string("hello world", gc));
+    }
+  }
+
+  GIVEN("A concatenation result over the interning limit")
+  {
+    eml::GcConfig config;
+    config.max_interned_cat_size = 4;
+    eml::GarbageCollector gc{config};
+    const auto hello = eml::make_string("hello", gc);
+    const auto world = eml::make_string(" world", gc);
+    const auto s = eml::string_cat(hello, world, gc);
+
+    THEN("It is not interned, but still equal to the same text")
+    {
+      const auto interned = eml::make_string("hello world", gc);
+      REQUIRE(!s->is_interned());
+      REQUIRE(!(s == interned));
+      REQUIRE(eml::Value{s} == eml::Value{interned});
+    }
+  }
+
+  GIVEN("Equal strings built by different concatenations")
+  {
+    const auto source = R"(("ab" ++ "c") == ("a" ++ "bc"))";
+
+    THEN("They are equal, whether the results are interned or not")
+    {
+      for (const std::size_t limit : {std::size_t{0}, std::size_t{64}}) {
+        eml::GcConfig config;
+        config.max_interned_cat_size = limit;
+        eml::GarbageCollector gc{config};
+        eml::Compiler compiler{gc};
+        eml::VM vm{gc};
+
+        const auto code = std::get<0>(*compiler.compile(source));
+        const auto result = vm.interpret(code);
+        REQUIRE(result.has_value());
+        REQUIRE(result->unsafe_as_boolean());
+      }
+    }
+  }
+
+  GIVEN("An interned concatenation result that is still in the nursery")
+  {
+    eml::GarbageCollector gc;
+    eml::Compiler compiler{gc};
+    eml::VM vm{gc};
+
+    const auto run = [&](std::string_view source) {
+      const auto code = std::get<0>(*compiler.compile(source));
+      const auto result = vm.interpret(code);
+      REQUIRE(result.has_value());
+      return result->unsafe_as_boolean();
+    };
+    REQUIRE(!run(R"(("a" ++ "b") == "x")"));
+
+    THEN("A literal of the same text uses a tenured copy of it")
+    {
+      REQUIRE(run(R"("ab" == ("a" ++ "b"))"));
+    }
+  }
+}
+
+TEST_CASE("Ropes", "[string]")
+{
+  const std::string left_text(eml::min_rope_length, 'a');
+  const std::string right_text(eml::min_rope_length, 'b');
+
+  GIVEN("A long concatenation result")
+  {
+    eml::GarbageCollector gc;
+    const auto left = eml::make_string(left_text, gc);
+    const auto right = eml::make_string(right_text, gc);
+    const auto s = eml::string_cat(left, right, gc);
+
+    THEN("It is a rope of the concatenated text")
+    {
+      const auto flat = eml::make_string(left_text + right_text, gc);
+      REQUIRE(eml::is_rope(*s));
+      REQUIRE(eml::to_std_string(*s) == left_text + right_text);
+      REQUIRE(s->hash() == flat->hash());
+      REQUIRE(eml::string_equal(*s, *flat));
+      REQUIRE(eml::string_equal(*flat, *s));
+      REQUIRE(!eml::string_equal(*s, *eml::string_cat(right, left, gc)));
+    }
+
+    THEN("Comparing it with a collector flattens it once")
+    {
+      const auto flat = eml::make_string(left_text + right_text, gc);
+      s->pin();
+      flat->pin();
+      right->pin();
+      REQUIRE(eml::string_equal(s, flat, gc));
+      REQUIRE(eml::as_rope(*s).right == nullptr);
+
+      const auto text = eml::flatten(s, gc);
+      REQUIRE(text.get() == eml::as_rope(*s).left);
+      gc.collect();
+      REQUIRE(eml::string_equal(*s, *flat));
+      REQUIRE(eml::to_std_string(*s) == left_text + right_text);
+      REQUIRE(eml::to_std_string(*eml::string_cat(s, right, gc)) ==
+              left_text + right_text + right_text);
+      right->unpin();
+      flat->unpin();
+      s->unpin();
+    }
+  }
+
+  GIVEN("A string that gets prepended and appended many times")
+  {
+    eml::GarbageCollector gc;
+    auto s = eml::make_string(left_text, gc);
+    s->pin();
+    std::string expected = left_text;
+    for (int i = 0; i < 1000; ++i) {
+      const auto text = std::to_string(i) + std::string(i % 7 * 20, 'c');
+      const auto piece = eml::make_string(text, gc);
+      piece->pin();
+      const auto prepend = i % 3 == 0;
+      const auto joined = prepend ? eml::string_cat(piece, s, gc)
+                                  : eml::string_cat(s, piece, gc);
+      joined->pin();
+      piece->unpin();
+      s->unpin();
+      s = joined;
+      expected = prepend ? text + expected : expected + text;
+    }
+
+    THEN("The rope stays shallow and keeps the text")
+    {
+      REQUIRE(eml::as_rope(*s).depth <= 24);
+      gc.collect();
+      REQUIRE(eml::to_std_string(*s) == expected);
+      const auto flat = eml::make_string(expected, gc);
+      REQUIRE(s->hash() == flat->hash());
+      REQUIRE(eml::string_equal(*s, *flat));
+    }
+    s->unpin();
+  }
+
+  GIVEN("Strings built from many pieces")
+  {
+    // The bytes that building a string of n pieces allocates, which are about
+    // four times as many for twice the pieces if a step copies the string
+    const auto allocated_bytes = [](std::size_t n, bool prepend) {
+      eml::GcConfig config;
+      config.initial_threshold = std::numeric_limits<std::size_t>::max() / 2;
+      config.nursery_size = 0;
+      eml::GarbageCollector gc{config};
+      const auto piece = eml::make_string("0123456789abcdef", gc);
+      auto s = piece;
+      for (std::size_t i = 1; i < n; ++i) {
+        s = prepend ? eml::string_cat(piece, s, gc)
+                    : eml::string_cat(s, piece, gc);
+      }
+      REQUIRE(eml::string_length(*s) == 16 * n);
+      return gc.bytes_allocated();
+    };
+
+    THEN("Appending and prepending do not copy the string")
+    {
+      for (const bool prepend : {false, true}) {
+        const auto bytes = allocated_bytes(4000, prepend);
+        REQUIRE(allocated_bytes(8000, prepend) < 3 * bytes);
+      }
+    }
+  }
+
+  GIVEN("A string that gets appended many times")
+  {
+    eml::GarbageCollector gc;
+    auto s = eml::make_string(left_text, gc);
+    s->pin();
+    std::string expected = left_text;
+    for (int i = 0; i < 1000; ++i) {
+      const auto piece = eml::make_string(std::to_string(i), gc);
+      piece->pin();
+      const auto appended = eml::string_cat(s, piece, gc);
+      appended->pin();
+      piece->unpin();
+      s->unpin();
+      s = appended;
+      expected += std::to_string(i);
+    }
+
+    THEN("The rope stays shallow and keeps the text")
+    {
+      REQUIRE(eml::as_rope(*s).depth <= 16);
+      gc.collect();
+      REQUIRE(eml::to_std_string(*s) == expected);
+      REQUIRE(s->hash() == eml::hash_bytes(
+                               eml::bit_cast<const std::byte*>(expected.data()),
+                               expected.size()));
+    }
+    s->unpin();
+  }
+
+  GIVEN("A vm with a tiny nursery that concatenates long strings")
+  {
+    eml::GarbageCollector gc{eml::GcConfig{0, 512}};
+    eml::Compiler compiler{gc};
+    eml::VM vm{gc};
+
+    std::string source = '"' + left_text + '"';
+    std::string expected = left_text;
+    for (int i = 0; i < 20; ++i) {
+      const auto text = std::string(eml::min_rope_length,
+                                    static_cast<char>('b' + i % 25));
+      source += " ++ (\"" + text + "\" ++ \"" + text + "\")";
+      expected += text + text;
+    }
+
+    THEN("Collections keep the ropes and the strings they refer to")
+    {
+      const auto code = std::get<0>(*compiler.compile(source));
+      const auto result = vm.interpret(code);
+      REQUIRE(result.has_value());
+      REQUIRE(eml::to_string(eml::StringType{}, *result, eml::PrintType::no) ==
+              '"' + expected + '"');
+    }
+  }
+}
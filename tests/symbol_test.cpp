@@ -0,0 +1,87 @@
+#include <catch2/catch.hpp>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "compiler.hpp"
+#include "symbol.hpp"
+
+TEST_CASE("Symbols", "[symbol]")
+{
+  GIVEN("Identifiers of the same name")
+  {
+    const eml::Symbol x{"symbol_test_x"};
+    const std::string name = "symbol_test_x";
+
+    THEN("They are the same symbol")
+    {
+      REQUIRE(eml::Symbol{name} == x);
+      REQUIRE(eml::Symbol{"symbol_test_y"} != x);
+      REQUIRE(x.name() == "symbol_test_x");
+    }
+
+    THEN("Finding the name does not intern it")
+    {
+      REQUIRE(eml::Symbol::find(name) == x);
+      REQUIRE(!eml::Symbol::find("symbol_test_never_interned").has_value());
+    }
+  }
+
+  GIVEN("Threads that intern the same names at once")
+  {
+    constexpr int name_count = 1000;
+    const auto intern_all = [](std::vector<eml::Symbol::Id>& ids) {
+      for (int i = 0; i < name_count; ++i) {
+        ids.push_back(
+            eml::Symbol{"symbol_test_thread_" + std::to_string(i)}.id());
+      }
+    };
+
+    std::vector<eml::Symbol::Id> first;
+    std::vector<eml::Symbol::Id> second;
+    std::thread thread{intern_all, std::ref(first)};
+    intern_all(second);
+    thread.join();
+
+    THEN("They get the same symbols")
+    {
+      REQUIRE(first == second);
+      REQUIRE(eml::Symbol{"symbol_test_thread_7"}.name() ==
+              "symbol_test_thread_7");
+    }
+  }
+
+  GIVEN("A global definition")
+  {
+    eml::GarbageCollector gc{};
+    eml::CompilerConfig config;
+    config.shadowing_policy = eml::SameScopeShadowing::allow;
+    eml::Compiler compiler{gc, config};
+    REQUIRE(compiler.compile("let symbol_test_global = 1").has_value());
+
+    THEN("The global can be found by its symbol and by its name")
+    {
+      const auto global =
+          compiler.get_global(eml::Symbol{"symbol_test_global"});
+      REQUIRE(global.has_value());
+      REQUIRE(global->second == eml::Value{1.});
+      REQUIRE(compiler.get_global("symbol_test_global") == global);
+      REQUIRE(!compiler.get_global("symbol_test_x").has_value());
+    }
+
+    THEN("The module has a slot for the global only")
+    {
+      const eml::Symbol unbound{"symbol_test_unbound"};
+      REQUIRE(!compiler.module().find(unbound).has_value());
+      REQUIRE(compiler.module().slot_count() == 1);
+    }
+
+    THEN("Redefining it replaces the value")
+    {
+      REQUIRE(compiler.compile("let symbol_test_global = 2").has_value());
+      REQUIRE(compiler.get_global("symbol_test_global")->second ==
+              eml::Value{2.});
+    }
+  }
+}
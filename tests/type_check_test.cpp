@@ -3,6 +3,10 @@
 
 #include <catch2/catch.hpp>
 
+#include <sstream>
+#include <thread>
+#include <vector>
+
 auto parse_and_type_check(eml::Compiler& compiler, std::string_view s,
                           eml::GarbageCollector& gc)
 {
@@ -383,3 +387,74 @@ TEST_CASE("Type check for branches")
     }
   }
 }
+
+TEST_CASE("Interned types")
+{
+  GIVEN("Primitive types")
+  {
+    THEN("Equal types have the same id")
+    {
+      REQUIRE(eml::Type{eml::NumberType{}} == eml::Type{eml::NumberType{}});
+      REQUIRE(eml::Type{eml::NumberType{}} != eml::Type{eml::BoolType{}});
+      REQUIRE(sizeof(eml::Type) == sizeof(eml::Type::Id));
+    }
+  }
+
+  GIVEN("Function types of the same structure")
+  {
+    const eml::Type predicate =
+        eml::FunctionType{eml::NumberType{}, eml::BoolType{}};
+    const eml::Type comparison =
+        eml::FunctionType{eml::NumberType{}, predicate};
+    const eml::Type same = eml::FunctionType{
+        eml::NumberType{},
+        eml::FunctionType{eml::NumberType{}, eml::BoolType{}}};
+
+    THEN("They are the same type")
+    {
+      REQUIRE(comparison == same);
+      REQUIRE(comparison != predicate);
+    }
+
+    THEN("Their parts are shared")
+    {
+      const auto& structure =
+          std::get<eml::FunctionType>(comparison.structure());
+      REQUIRE(structure.result == predicate);
+    }
+
+    THEN("They print with right associative arrows")
+    {
+      std::stringstream ss;
+      ss << comparison << ", "
+         << eml::Type{eml::FunctionType{comparison, eml::UnitType{}}};
+      REQUIRE(ss.str() ==
+              "Number -> Number -> Bool, (Number -> Number -> Bool) -> Unit");
+    }
+  }
+
+  GIVEN("Threads that build the same function types at once")
+  {
+    constexpr int depth = 1000;
+    const auto build_all = [](std::vector<eml::Type>& types) {
+      eml::Type t = eml::StringType{};
+      for (int i = 0; i < depth; ++i) {
+        t = eml::FunctionType{eml::UnitType{}, t};
+        types.push_back(t);
+      }
+    };
+
+    std::vector<eml::Type> first;
+    std::vector<eml::Type> second;
+    std::thread thread{build_all, std::ref(first)};
+    build_all(second);
+    thread.join();
+
+    THEN("They get the same types")
+    {
+      REQUIRE(first == second);
+      REQUIRE(std::get<eml::FunctionType>(first.back().structure()).result ==
+              first[depth - 2]);
+    }
+  }
+}
@@ -2,7 +2,9 @@
 #include "value.hpp"
 
 #include <catch2/catch.hpp>
+#include <cmath>
 #include <functional>
+#include <limits>
 #include <sstream>
 
 TEST_CASE("Values' RTTI 'unsafe_as_xxx' and 'is_xxx' function")
@@ -84,6 +86,69 @@ TEST_CASE("Values' RTTI 'unsafe_as_xxx' and 'is_xxx' function")
   }
 }
 
+TEST_CASE("Values keep special floating point numbers")
+{
+  GIVEN("A NaN")
+  {
+    const eml::Value v{std::numeric_limits<double>::quiet_NaN()};
+
+    THEN("Is still a number")
+    {
+      REQUIRE(v.is_number());
+      REQUIRE(!v.is_unit());
+      REQUIRE(!v.is_boolean());
+      REQUIRE(!v.is_reference());
+      REQUIRE(std::isnan(v.unsafe_as_number()));
+    }
+
+    THEN("Is not equal to itself")
+    {
+      REQUIRE(v != v);
+    }
+  }
+
+  GIVEN("A negative infinity")
+  {
+    const eml::Value v{-std::numeric_limits<double>::infinity()};
+
+    THEN("Is a number that round trips")
+    {
+      REQUIRE(v.is_number());
+      REQUIRE(v.unsafe_as_number() == -std::numeric_limits<double>::infinity());
+    }
+  }
+
+  GIVEN("A negative zero")
+  {
+    const eml::Value v{-0.0};
+
+    THEN("Keeps its sign and equals to zero")
+    {
+      REQUIRE(v.is_number());
+      REQUIRE(std::signbit(v.unsafe_as_number()));
+      REQUIRE(v == eml::Value{0.0});
+    }
+  }
+
+  GIVEN("A string")
+  {
+    eml::GarbageCollector gc{};
+    const auto s = eml::make_string("Hello", gc);
+    const eml::Value v{s};
+
+    THEN("Is a reference to the same object")
+    {
+      REQUIRE(v.is_reference());
+      REQUIRE(!v.is_number());
+      REQUIRE(v.unsafe_as_reference() == s);
+    }
+  }
+
+  if constexpr (eml::build_options.nan_boxing) {
+    REQUIRE(sizeof(eml::Value) == sizeof(double));
+  }
+}
+
 TEST_CASE("Value printing")
 {
   std::stringstream ss;
@@ -3,8 +3,42 @@
 #include <ApprovalTests.hpp>
 #include <catch2/catch.hpp>
 
+#include "eml.hpp"
 #include "vm_test_util.hpp"
 
+namespace {
+
+constexpr eml::Backend backends[] = {eml::Backend::stack,
+                                     eml::Backend::registers};
+
+// Compiles source for backend without optimizing it, so that the vm runs the
+// code of every subexpression
+auto compile(eml::GarbageCollector& gc, std::string_view source,
+             eml::Backend backend) -> eml::Program
+{
+  eml::Compiler compiler{
+      gc, eml::CompilerConfig{eml::SameScopeShadowing::warning,
+                              eml::OptimizationLevel::none, backend}};
+  auto result = compiler.compile_program(source);
+  REQUIRE(result.has_value());
+  return std::get<0>(std::move(*result));
+}
+
+// Runs source on backend, and returns the number it evaluates to
+auto run(std::string_view source, eml::Backend backend,
+         eml::VMConfig config = {}) -> double
+{
+  eml::GarbageCollector gc{};
+  const auto code = compile(gc, source, backend);
+  eml::VM machine{gc, config};
+  const auto result = machine.interpret(code);
+  REQUIRE(result.has_value());
+  REQUIRE(result->is_number());
+  return result->unsafe_as_number();
+}
+
+} // anonymous namespace
+
 TEST_CASE("Arithmatic instructions", "[eml.vm]")
 {
   using eml::Bytecode;
@@ -46,6 +80,24 @@ TEST_CASE("Arithmatic instructions", "[eml.vm]")
       REQUIRE(result->unsafe_as_number() == Approx(expected));
     }
   }
+
+  GIVEN("((2 3 +) 4 /) with constant right operands")
+  {
+    Bytecode code;
+    push_number(code, 2.);
+    write_constant_operation(code, eml::op_add_f64_k, 3.);
+    write_constant_operation(code, eml::op_divide_f64_k, 4.);
+
+    eml::GarbageCollector gc{};
+    eml::VM machine{gc};
+
+    THEN("Evaluate to 1.25")
+    {
+      const auto result = machine.interpret(code);
+      REQUIRE(result);
+      REQUIRE(result->unsafe_as_number() == Approx(1.25));
+    }
+  }
 }
 
 TEST_CASE("Jumps", "[eml.vm]")
@@ -122,3 +174,233 @@ TEST_CASE("Jumps", "[eml.vm]")
     }
   }
 }
+
+TEST_CASE("Prepared bytecode", "[eml.vm]")
+{
+  using eml::Bytecode;
+
+  GIVEN("(if (< 1 2) (+ 3 4) 5) with wide operands")
+  {
+    Bytecode code;
+    for (int i = 0; i < 300; ++i) {
+      [[maybe_unused]] const auto offset =
+          code.add_constant(eml::Value{static_cast<double>(i)});
+    }
+    push_number(code, 1.);
+    push_number(code, 2.);
+    write_instruction(code, eml::op_less_f64);
+    code.write(eml::op_jmp_false_long, eml::line_num{0});
+    code.write_long_operand(6, eml::line_num{0});
+    push_number(code, 3.);
+    write_constant_operation(code, eml::op_add_f64_k, 4.);
+    write_jump(code, eml::op_jmp, 2);
+    push_number(code, 5.);
+    code.write(eml::op_push_f64_long, eml::line_num{0});
+    code.write_long_operand(299, eml::line_num{0});
+    write_instruction(code, eml::op_add_f64);
+
+    const eml::PreparedBytecode prepared{code};
+
+    THEN("Has one instruction for each instruction of the bytecode")
+    {
+      const auto& instructions = prepared.instructions();
+      REQUIRE(instructions.size() == 10);
+      REQUIRE(instructions[3].op == eml::op_jmp_false);
+      REQUIRE(instructions[3].target == 7);
+      REQUIRE(instructions[6].target == 8);
+      REQUIRE(instructions[8].op == eml::op_push_f64);
+      REQUIRE(instructions[8].constant == eml::Value{299.});
+    }
+
+    THEN("Evaluates to 306 every time it runs")
+    {
+      eml::GarbageCollector gc{};
+      eml::VM machine{gc};
+      for (int i = 0; i < 3; ++i) {
+        const auto result = machine.interpret(prepared);
+        REQUIRE(result);
+        REQUIRE(result->unsafe_as_number() == Approx(306));
+      }
+      REQUIRE(machine.interpret(code)->unsafe_as_number() == Approx(306));
+    }
+  }
+
+  GIVEN("A chunk that changes after it ran")
+  {
+    eml::GarbageCollector gc{};
+    eml::VM machine{gc};
+    Bytecode code;
+    push_number(code, 1.);
+    REQUIRE(machine.interpret(code)->unsafe_as_number() == Approx(1));
+
+    write_constant_operation(code, eml::op_add_f64_k, 2.);
+
+    THEN("The vm runs the new code instead of the code it prepared before")
+    {
+      REQUIRE(machine.interpret(code)->unsafe_as_number() == Approx(3));
+
+      const Bytecode copy{code};
+      REQUIRE(machine.interpret(copy)->unsafe_as_number() == Approx(3));
+    }
+  }
+}
+
+TEST_CASE("Stack overflow", "[eml.vm]")
+{
+  using eml::Bytecode;
+
+  GIVEN("A chunk that pushes three values")
+  {
+    Bytecode code;
+    push_number(code, 1.);
+    push_number(code, 2.);
+    push_number(code, 3.);
+    write_instruction(code, eml::op_add_f64);
+    write_instruction(code, eml::op_add_f64);
+
+    eml::GarbageCollector gc{};
+
+    WHEN("Interpret by a vm with a stack capacity of 2")
+    {
+      eml::VM machine{gc, eml::VMConfig{2}};
+
+      THEN("Raises a stack overflow error")
+      {
+        REQUIRE_THROWS_AS(machine.interpret(code), eml::StackOverflowError);
+      }
+
+      THEN("The vm can still run chunks that fit in its stack")
+      {
+        REQUIRE_THROWS_AS(machine.interpret(code), eml::StackOverflowError);
+
+        Bytecode small_code;
+        push_number(small_code, 1.);
+        push_number(small_code, 2.);
+        write_instruction(small_code, eml::op_add_f64);
+
+        const auto result = machine.interpret(small_code);
+        REQUIRE(result);
+        REQUIRE(result->unsafe_as_number() == Approx(3));
+      }
+    }
+
+    WHEN("Interpret by a vm with a stack capacity of 3")
+    {
+      eml::VM machine{gc, eml::VMConfig{3}};
+
+      THEN("Evaluate to 6")
+      {
+        const auto result = machine.interpret(code);
+        REQUIRE(result);
+        REQUIRE(result->unsafe_as_number() == Approx(6));
+      }
+    }
+
+    WHEN("The recorded stack depth of the chunk is too low")
+    {
+      code.max_stack_depth = 1;
+      eml::VM machine{gc, eml::VMConfig{2}};
+
+      THEN("Still raises a stack overflow error")
+      {
+        REQUIRE_THROWS_AS(machine.interpret(code), eml::StackOverflowError);
+      }
+    }
+  }
+}
+
+TEST_CASE("Backends", "[eml.vm]")
+{
+  GIVEN("(2 + 3) / 4 - 2 * 5")
+  {
+    THEN("Evaluate to -8.75 on both backends")
+    {
+      for (const auto backend : backends) {
+        REQUIRE(run("(2 + 3) / 4 - 2 * 5", backend) == Approx(-8.75));
+      }
+    }
+  }
+
+  GIVEN("if (5 > 1) {2 + 3} else {4 - 6}")
+  {
+    THEN("Evaluate to 5 on both backends")
+    {
+      for (const auto backend : backends) {
+        REQUIRE(run("if (5 > 1) {2 + 3} else {4 - 6}", backend) == Approx(5));
+      }
+    }
+  }
+
+  GIVEN("if (5 < 1) {2 + 3} else {4 - 6}")
+  {
+    THEN("Evaluate to -2 on both backends")
+    {
+      for (const auto backend : backends) {
+        REQUIRE(run("if (5 < 1) {2 + 3} else {4 - 6}", backend) == Approx(-2));
+      }
+    }
+  }
+
+  GIVEN("Nested ifs whose conditions are not comparisons")
+  {
+    const auto source = "if (!(1 == 2)) {if (true) {-1} else {2}} else {3}";
+
+    THEN("Evaluate to -1 on both backends")
+    {
+      for (const auto backend : backends) {
+        REQUIRE(run(source, backend) == Approx(-1));
+      }
+    }
+  }
+
+  GIVEN("A concatenation of strings")
+  {
+    const auto source = R"(("Hello" ++ ", ") ++ ("world" ++ "!"))";
+
+    THEN("Evaluate to \"Hello, world!\" on both backends")
+    {
+      for (const auto backend : backends) {
+        eml::GarbageCollector gc{};
+        const auto code = compile(gc, source, backend);
+        eml::VM machine{gc};
+        const auto result = machine.interpret(code);
+        REQUIRE(result.has_value());
+        REQUIRE(eml::to_string(eml::StringType{}, *result,
+                               eml::PrintType::no) == R"("Hello, world!")");
+      }
+    }
+  }
+
+  GIVEN("A definition")
+  {
+    THEN("Evaluate to nothing on both backends")
+    {
+      for (const auto backend : backends) {
+        eml::GarbageCollector gc{};
+        const auto code = compile(gc, "let x = 1", backend);
+        eml::VM machine{gc};
+        REQUIRE(!machine.interpret(code).has_value());
+      }
+    }
+  }
+
+  GIVEN("(1 + 2) * (3 + 4), which needs three stack slots or two temporaries")
+  {
+    const auto source = "(1 + 2) * (3 + 4)";
+
+    THEN("Raises a stack overflow error on both backends with a capacity of 1")
+    {
+      for (const auto backend : backends) {
+        REQUIRE_THROWS_AS(run(source, backend, eml::VMConfig{1}),
+                          eml::StackOverflowError);
+      }
+    }
+
+    THEN("Evaluate to 21 on both backends with a capacity of 3")
+    {
+      for (const auto backend : backends) {
+        REQUIRE(run(source, backend, eml::VMConfig{3}) == Approx(21));
+      }
+    }
+  }
+}
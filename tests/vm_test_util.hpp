@@ -11,7 +11,7 @@ inline void write_jump(eml::Bytecode& chunk, eml::opcode instruction,
                        eml::line_num linum = eml::line_num{0})
 {
   chunk.write(instruction, linum);
-  chunk.write(eml::opcode{amount}, linum);
+  chunk.write(std::byte{amount}, linum);
 }
 
 // Write an instruction to vm
@@ -21,13 +21,37 @@ inline void write_instruction(eml::Bytecode& chunk, eml::opcode instruction,
   chunk.write(instruction, linum);
 }
 
+// Write an instruction on the global in slot to vm
+inline void write_global(eml::Bytecode& chunk, eml::opcode instruction,
+                         std::underlying_type_t<eml::opcode> slot,
+                         eml::line_num linum = eml::line_num{0})
+{
+  chunk.write(instruction, linum);
+  chunk.write(std::byte{slot}, linum);
+}
+
 // Push a constant number to vm
 inline void push_number(eml::Bytecode& chunk, double value,
                         eml::line_num linum = eml::line_num{0})
 {
-  chunk.write(eml::op_push_f64, linum);
   const auto offset = chunk.add_constant(eml::Value{value});
-  chunk.write(eml::opcode{*offset}, linum);
+  if (*offset <= eml::max_short_operand) {
+    chunk.write(eml::op_push_f64, linum);
+    chunk.write(static_cast<std::byte>(*offset), linum);
+  } else {
+    chunk.write(eml::op_push_f64_long, linum);
+    chunk.write_long_operand(*offset, linum);
+  }
+}
+
+// Write an operation whose right operand is a constant number to vm
+inline void write_constant_operation(eml::Bytecode& chunk,
+                                     eml::opcode instruction, double value,
+                                     eml::line_num linum = eml::line_num{0})
+{
+  const auto offset = chunk.add_constant(eml::Value{value});
+  chunk.write(instruction, linum);
+  chunk.write(static_cast<std::byte>(*offset), linum);
 }
 
 #endif // EML_VM_TEST_UTIL_HPP